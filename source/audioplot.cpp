@@ -6,19 +6,34 @@
 
 #include <GLFW/glfw3.h>
 
+#include "audioplot_cache.h"
 #include "audioplot_dr_flac.h"
 #include "audioplot_dr_mp3.h"
 #include "audioplot_dr_wav.h"
+#include "audioplot_filterbank.h"
+#include "audioplot_gl.h"
+#include "audioplot_minmax.h"
+#include "audioplot_mmap.h"
 #include "audioplot_pfd.h"
 #include "audioplot_stb_vorbis.h"
+#include "audioplot_thread_pool.h"
+#include "audioplot_tile_cache.h"
 #include "audioplot_kiss_fft.h"
 
 #include <algorithm>
 #include <cinttypes>
 #include <cmath>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <limits>
+#include <memory>
 #include <string>
 #include <array>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
 #include <vector>
 
 // settings
@@ -27,6 +42,32 @@ const int kWindowHeight = 1200;
 
 const uint32_t kMaxDetailLevels = 16;
 const uint64_t kMinDetailLevelPoints = 32768;
+const bool kDetailLevelOffsets = false;  // store where in each window its min and max occur
+
+const uint64_t kDecodeChunkFrames = 65536;
+const uint64_t kMappedChunkFrames = 1048576;   // frames of a mapped file processed between updates of the display
+const double kLoadingRedrawInterval = 0.05;    // seconds between redraws while loading
+const uint64_t kSegmentWindows = 65536;  // detail level windows resampled by each parallel task
+const uint64_t kMaxCacheSize = 4ull << 30;  // bytes of processed files kept in the user's cache directory
+const uint32_t kCacheDataVersion = 4;       // of the cached detail levels and spectrogram, incremented when they change
+const uint64_t kDefaultMemoryBudget = 4ull << 30;  // bytes of samples, detail levels and spectrogram kept in RAM
+const uint64_t kMinSpectrogramHop = 64;  // samples between spectrogram frames, when zoomed in furthest
+const int kMaxSpectrogramOverlap = 8;    // FFTs covering each sample, at most
+const double kLazySpectrogramDuration = 3600.0;  // seconds of samples above which spectrogram frames are only computed when viewed
+const uint64_t kSpectrogramTextureBudget = 512ull << 20;  // bytes of spectrogram textures kept by the GPU
+const uint64_t kSpectrogramBandsBudget = 256ull << 20;    // bytes of spectrogram frames in the bands of scales kept in RAM
+const uint64_t kWaveformBufferBudget = 256ull << 20;      // bytes of waveform points kept by the GPU
+const double kMinFrequencyTickSpacing = 0.04;  // of the height of a spectrogram plot, between ticks of a scale
+const float kDefaultSpectrogramMinDb = -25.0f;
+const float kDefaultSpectrogramMaxDb = 40.0f;
+const double kAutoLevelLowPercentile = 0.25;    // of spectrogram values, shown at the bottom of the colormap by auto levels
+const double kAutoLevelHighPercentile = 0.999;  // shown at the top
+const float kMinSpectrogramDbRange = 10.0f;
+
+const float kMinSharedRowHeight = 120.0f;  // pixels of the multiple plot mode's rows, below which they scroll rather than share the window
+const float kMinRowHeight = 40.0f;         // pixels the rows can be set to
+const float kRowHeightStep = 1.25f;        // factor the [ and ] keys change the row height by
+const int32_t kMaxHideableTraces = 64;     // traces with a bit in the visibility bitmap, beyond which traces are always shown
 
 const ImPlotColormap kDefaultColorMap = ImPlotColormap_Dark;
 
@@ -36,20 +77,79 @@ typedef ImVec4 Color;
 class AudioData
 {
 public:
-    AudioData(const char* filename)
+    AudioData(const char* filename, ThreadPool& threadPool, bool bUseCache = true, uint64_t memoryBudget = kDefaultMemoryBudget,
+              bool bLazySpectrogram = false, SpectrogramFormat spectrogramFormat = SPECTROGRAM_FORMAT_F32)
+    : m_threadPool(threadPool)
+    , m_bUseCache(bUseCache)
+    , m_memoryBudget(memoryBudget)
+    , m_tileCache(memoryBudget / 4)
+    , m_bLazySpectrogram(bLazySpectrogram)
+    , m_spectrogramFormat(spectrogramFormat)
     {
-        loadFromFile(filename);
+        m_spectrogram.initializeTiles(m_channelViews, m_mutex, std::max(threadPool.getNumThreads() / 2, 1u), memoryBudget / 8, []() {
+            glfwPostEmptyEvent();
+        });
+        startLoading(filename);
+    }
+
+    ~AudioData()
+    {
+        cancelLoading();
+    }
+
+    // Stop the loading thread, keeping whatever it has loaded so far, and the
+    // threads computing the spectrogram
+    void cancelLoading()
+    {
+        m_bCancelLoading = true;
+        if (m_loadingThread.joinable()) {
+            m_loadingThread.join();
+        }
+        if (m_spectrogramThread.joinable()) {
+            m_spectrogramThread.join();
+        }
+        m_spectrogram.stopTiles();
+    }
+
+    // Samples are loaded on a background thread, which holds this lock while it changes
+    // anything that is drawn, so it must be held while drawing. Data beyond what has been
+    // published, i.e. getNumValues() and getNumPoints(), is not read by the GUI thread.
+    std::mutex& getMutex()
+    {
+        return m_mutex;
+    }
+
+    bool isLoaded() const
+    {
+        return m_bLoaded;
+    }
+
+    float getLoadingProgress() const
+    {
+        return (m_expectedNumValues > 0 ? (float)getNumValues() / (float)m_expectedNumValues : 0.0f);
+    }
+
+    // Incremented whenever the loading thread publishes data
+    uint64_t getDataVersion() const
+    {
+        return m_dataVersion;
     }
 
     int32_t getNumChannels() const
     {
-        return m_channelData.size();
+        return m_channelViews.size();
+    }
+
+    // Number of values once loading has finished, taken from the file header until then
+    uint64_t getExpectedNumValues() const
+    {
+        return std::max(m_expectedNumValues, getNumValues());
     }
 
     uint64_t getNumValues() const
     {
-        if (m_channelData.size() > 0) {
-            return m_channelData[0].size();
+        if (m_channelViews.size() > 0) {
+            return m_channelViews[0].size();
         }
         else {
             return 0;
@@ -58,18 +158,33 @@ public:
 
     double getValue(int32_t channel, uint64_t index) const
     {
-        bool bValidChannel = (0 <= channel && channel < (int32_t)m_channelData.size());
-        if (bValidChannel && index < m_channelData[channel].size()) {
-            return m_channelData[channel][index];
+        bool bValidChannel = (0 <= channel && channel < (int32_t)m_channelViews.size());
+        if (bValidChannel && index < m_channelViews[channel].size()) {
+            return m_channelViews[channel][index];
         }
         return 0;
     }
 
+    const SampleView& getSampleView(int32_t channel) const
+    {
+        return m_channelViews[channel];
+    }
+
+    const std::vector<SampleView>& getSampleViews() const
+    {
+        return m_channelViews;
+    }
+
     double getTime(uint64_t index) const
     {
         return index * m_samplePeriod;
     }
 
+    double getSamplePeriod() const
+    {
+        return m_samplePeriod;
+    }
+
     double getMaxTime() const
     {
         return m_maxTime;
@@ -95,9 +210,13 @@ public:
         }
     }
 
+    // Only the first 64 traces can be hidden, as the bitmap has a bit for each of them
     bool isTraceVisible(int32_t trace) const
     {
-        return m_bTraceVisibleBitmap & (1 << trace);
+        if (trace < 0 || trace >= kMaxHideableTraces) {
+            return (trace >= 0);
+        }
+        return (m_bTraceVisibleBitmap & ((uint64_t)1 << trace)) != 0;
     }
 
     uint64_t getTracesVisibleBitmap() const
@@ -117,14 +236,16 @@ public:
 
     void toggleTraceVisible(int32_t trace)
     {
-        m_bTraceVisibleBitmap = (m_bTraceVisibleBitmap ^ (1 << trace));
+        if (trace >= 0 && trace < kMaxHideableTraces) {
+            m_bTraceVisibleBitmap = (m_bTraceVisibleBitmap ^ ((uint64_t)1 << trace));
+        }
     }
 
     int32_t getNumVisibleTraces() const
     {
         int32_t numTraces = 0;
         for (int32_t i = 0; i < (int32_t)m_traces.size(); i++) {
-            if (m_bTraceVisibleBitmap & (1 << i)) {
+            if (isTraceVisible(i)) {
                 numTraces++;
             }
         }
@@ -155,17 +276,105 @@ public:
 
     uint64_t getNumPoints(int32_t level) const
     {
-        if (m_traces.size() > 0) {
-            return m_traces[0].m_levels[level].m_points.size();
+        if (level == 0) {
+            return getNumValues();
+        }
+        else if (m_traces.size() > 0) {
+            return m_traces[0].m_levels[level].m_numPoints;
         }
         else {
             return 0;
         }
     }
 
-    const Point* getPointArray(int32_t trace, int32_t level) const
+    // Full detail level 0 is read from the samples, so only summary levels have value arrays
+    const float* getValueArray(int32_t trace, int32_t level) const
+    {
+        return m_traces[trace].m_levels[level].m_pValues;
+    }
+
+    // Sample index each point of a level is plotted at
+    uint64_t getPointIndex(int32_t level, uint64_t index) const
+    {
+        if (level == 0) {
+            return index;
+        }
+        return index * getPointSpacing(level);
+    }
+
+    // Samples between consecutive points of a level, when they are evenly spaced
+    uint64_t getPointSpacing(int32_t level) const
+    {
+        if (level == 0) {
+            return 1;
+        }
+        return m_traces[0].m_levels[level].m_windowSize / 2;
+    }
+
+    bool hasPointOffsets(int32_t level) const
+    {
+        return (level > 0) && kDetailLevelOffsets;
+    }
+
+    Point getPoint(int32_t trace, int32_t level, uint64_t index) const
+    {
+        if (level == 0) {
+            return Point(getTime(index), m_channelViews[trace][index]);
+        }
+
+        const TraceDetailLevel& detailLevel = m_traces[trace].m_levels[level];
+        uint64_t sampleIndex = index * (detailLevel.m_windowSize / 2);
+        if (detailLevel.m_pOffsets != nullptr) {
+            const uint64_t windowStart = (index / 2) * detailLevel.m_windowSize;
+            sampleIndex = windowStart + ((uint64_t)detailLevel.m_pOffsets[index] << detailLevel.m_offsetShift);
+        }
+        return Point(getTime(sampleIndex), detailLevel.m_pValues[index]);
+    }
+
+    // Largest magnitude of the values of a range of points, or -1 if the range is empty
+    double getMaxAbsValue(int32_t trace, int32_t level, uint64_t startIdx, uint64_t endIdx) const
     {
-        return &m_traces[trace].m_levels[level].m_points[0];
+        if (endIdx <= startIdx) {
+            return -1.0;
+        }
+
+        const MinMax range = findValueRange(trace, level, startIdx, endIdx - startIdx);
+        return std::max(std::abs((double)range.m_min), std::abs((double)range.m_max));
+    }
+
+    // Reduce the points of a level to the min and max of each of numColumns columns of
+    // pointsPerColumn points from firstPoint, written two to a column in the order they occur.
+    // Columns should be at least a point wide; one with no points repeats the one before it.
+    void reduceToColumns(int32_t trace, int32_t level, double firstPoint, double pointsPerColumn,
+                         int numColumns, float* pValues) const
+    {
+        const uint64_t numPoints = getNumPoints(level);
+        if (numPoints == 0) {
+            std::fill(pValues, pValues + (2 * numColumns), 0.0f);
+            return;
+        }
+
+        uint64_t startIdx = std::min((uint64_t)std::max(std::ceil(firstPoint), 0.0), numPoints);
+        for (int column = 0; column < numColumns; column++) {
+            const double columnEnd = std::ceil(firstPoint + ((column + 1) * pointsPerColumn));
+            const uint64_t endIdx = std::min((uint64_t)std::max(columnEnd, 0.0), numPoints);
+            if (endIdx > startIdx) {
+                const MinMax range = findValueRange(trace, level, startIdx, endIdx - startIdx);
+                const bool bMinFirst = (range.m_indexMin <= range.m_indexMax);
+                pValues[2 * column] = (bMinFirst ? range.m_min : range.m_max);
+                pValues[2 * column + 1] = (bMinFirst ? range.m_max : range.m_min);
+                startIdx = endIdx;
+            }
+            else if (column > 0) {
+                pValues[2 * column] = pValues[2 * column - 1];
+                pValues[2 * column + 1] = pValues[2 * column - 1];
+            }
+            else {
+                const MinMax range = findValueRange(trace, level, std::min(startIdx, numPoints - 1), 1);
+                pValues[0] = range.m_min;
+                pValues[1] = range.m_min;
+            }
+        }
     }
 
     uint32_t getNumLevels() const
@@ -173,17 +382,133 @@ public:
         return (uint32_t)m_traces[0].m_levels.size();
     }
 
+    // Ask for the points of a level about to be drawn to be read in, if they are mapped
+    // from a file, dropping the least recently drawn points beyond the memory budget
+    void pageInPoints(int32_t level, uint64_t startIdx, uint64_t endIdx)
+    {
+        if (endIdx <= startIdx) {
+            return;
+        }
+        if (m_bTilesMoved) {
+            m_tileCache.clear();
+            m_bTilesMoved = false;
+        }
+
+        for (int32_t trace = 0; trace < numTraces(); trace++) {
+            if (!isTraceVisible(trace)) {
+                continue;
+            }
+            if (level == 0) {
+                const SampleView& samples = m_channelViews[trace];
+                if (m_bSamplesMapped) {
+                    m_tileCache.use(samples.data(), samples.size() * samples.stride(),
+                                    startIdx * samples.stride(), (endIdx - startIdx) * samples.stride());
+                }
+                continue;
+            }
+
+            const TraceDetailLevel& detailLevel = m_traces[trace].m_levels[level];
+            if (detailLevel.m_values.isSpilled() || m_cache.isOpen()) {
+                m_tileCache.use(detailLevel.m_pValues, detailLevel.m_numPoints * sizeof(float),
+                                startIdx * sizeof(float), (endIdx - startIdx) * sizeof(float));
+            }
+            if ((detailLevel.m_offsets.isSpilled() || m_cache.isOpen()) && detailLevel.m_pOffsets != nullptr) {
+                m_tileCache.use(detailLevel.m_pOffsets, detailLevel.m_numPoints * sizeof(uint16_t),
+                                startIdx * sizeof(uint16_t), (endIdx - startIdx) * sizeof(uint16_t));
+            }
+        }
+    }
+
     const Spectrogram& spectrogram() const
     {
         return m_spectrogram;
     }
 
+    Spectrogram& spectrogram()
+    {
+        return m_spectrogram;
+    }
+
+    // Compute the spectrogram again with new settings, in the background, by the loading
+    // thread if it is still running. Call with the mutex held.
+    void setSpectrogramSettings(const SpectrogramSettings& settings)
+    {
+        m_spectrogram.setSettings(settings);
+        if (!m_spectrogram.hasPendingSettings() || m_bSpectrogramUpdating) {
+            return;
+        }
+        if (m_spectrogramThread.joinable()) {
+            m_spectrogramThread.join();  // it has finished, as it clears m_bSpectrogramUpdating last
+        }
+        m_bSpectrogramUpdating = true;
+        m_spectrogramThread = std::thread(&AudioData::updateSpectrogram, this);
+    }
+
 private:
+    // Min and max of a range of points, with where each first occurs
+    MinMax findValueRange(int32_t trace, int32_t level, uint64_t startIdx, uint64_t count) const
+    {
+        if (level > 0) {
+            return findMinMax(getValueArray(trace, level) + startIdx, count);
+        }
+        const SampleView& samples = m_channelViews[trace];
+        if (isContiguous<int16_t>(samples)) {
+            return findMinMax((const int16_t*)samples.data() + startIdx, count);
+        }
+        if (isContiguous<float>(samples)) {
+            return findMinMax((const float*)samples.data() + startIdx, count);
+        }
+
+        MinMax range;
+        range.m_min = range.m_max = (float)samples[startIdx];
+        range.m_indexMin = range.m_indexMax = 0;
+        for (uint64_t i = 1; i < count; i++) {
+            const float value = (float)samples[startIdx + i];
+            if (value < range.m_min) {
+                range.m_min = value;
+                range.m_indexMin = i;
+            }
+            if (value > range.m_max) {
+                range.m_max = value;
+                range.m_indexMax = i;
+            }
+        }
+        return range;
+    }
+
+    // Min and max value of each window, stored in the order they occur, so the
+    // time of each value is implied by its index rather than stored alongside it
     struct TraceDetailLevel
     {
-        std::vector<Point> m_points;
-        uint64_t m_windowSize;
-        double m_windowTime;
+        PagedArray<float> m_values;
+        PagedArray<uint16_t> m_offsets;   // position of each value in its window, if kDetailLevelOffsets
+        uint64_t m_windowSize = 1;
+        uint32_t m_offsetShift = 0;       // offsets are stored at this reduced resolution
+        uint64_t m_numPoints = 0;         // values published for drawing
+        const float* m_pValues = nullptr;       // m_values, or values mapped from the cache
+        const uint16_t* m_pOffsets = nullptr;   // m_offsets, or offsets mapped from the cache
+    };
+
+    // First section of a cache file, followed by the sections of each channel: its
+    // decoded samples if m_bSamples, the values (and offsets if m_bOffsets) of each
+    // summary detail level, and each level of its spectrogram
+    struct CacheInfo
+    {
+        uint32_t m_version;
+        uint32_t m_channels;
+        uint32_t m_sampleRate;
+        uint32_t m_sampleFormat;
+        uint64_t m_numValues;
+        uint32_t m_bSamples;
+        uint32_t m_bOffsets;
+        uint32_t m_numLevels;
+        int32_t m_numFrequencies;
+        int32_t m_numBins;
+        uint32_t m_numSpectrogramLevels;
+        int32_t m_fftSize;
+        int32_t m_hop;
+        uint32_t m_window;
+        uint32_t m_spectrogramFormat;
     };
 
     struct Trace
@@ -191,121 +516,251 @@ private:
         std::vector<TraceDetailLevel> m_levels;
     };
 
+    ThreadPool& m_threadPool;
+    std::thread m_loadingThread;
+    std::thread m_spectrogramThread;  // computing the spectrogram again once loaded
+    bool m_bSpectrogramUpdating = false;  // by either thread, guarded by m_mutex
+    std::atomic<bool> m_bCancelLoading{false};
+    std::mutex m_mutex;               // guards everything the loading thread publishes
+    uint64_t m_dataVersion = 0;
+    bool m_bLoaded = false;
+    std::chrono::steady_clock::time_point m_lastRedrawRequest;
+    std::unique_ptr<AudioDecoder> m_pDecoder;
+    WavPcmDataLayout m_wavLayout;
+    bool m_bUseCache = true;
+    CacheKey m_cacheKey;
+    CacheReader m_cache;              // mapping of the cached data, when the file was loaded from it
+    uint64_t m_memoryBudget;
+    TileCache m_tileCache;            // of mapped samples and detail levels
+    bool m_bTilesMoved = false;       // samples or detail levels were moved, so cached tiles are stale
+    bool m_bLazySpectrogram = false;
+    SpectrogramFormat m_spectrogramFormat = SPECTROGRAM_FORMAT_F32;  // of the frames computed
+    bool m_bSamplesMapped = false;    // from the file, the cache or scratch files
+
     uint64_t m_bTraceVisibleBitmap = 0;
 
     std::vector<std::string> m_channelNames;
-    std::vector<std::vector<double>> m_channelData;
+    std::vector<std::unique_ptr<ChannelBuffer>> m_channelBuffers;  // decoded samples, for files not read in place
+    std::vector<SampleView> m_channelViews;          // samples of each channel in their stored format
+    MappedFile m_mappedFile;
     std::vector<Trace> m_traces;
     Spectrogram m_spectrogram;
 
     double m_samplePeriod = 0.0;
     double m_maxTime = 0.0;
+    uint64_t m_expectedNumValues = 0;
 
-    void loadFromFile(const char* filename)
+    // Read the file header, then load the samples on a background thread,
+    // unless the file was processed before and is in the cache
+    void startLoading(const char* filename)
     {
         // std::cout << "Loading " << filename << "...\n";
+        const bool bMappedWav = (strstr(filename, ".wav") != NULL) && openMappedWavFile(filename);
+        m_bUseCache = m_bUseCache && getCacheKey(filename, &m_cacheKey);
+        if (m_bUseCache && loadCachedData(bMappedWav)) {
+            return;
+        }
+
+        if (bMappedWav) {
+            const WavPcmDataLayout& layout = m_wavLayout;
+            initializeChannels(layout.m_channels, layout.m_sampleRate, layout.m_totalFrameCount, getDefaultSpectrogramSettings());
+            spillLargeArrays(layout.m_totalFrameCount);
+            m_bSamplesMapped = true;
+            m_bSpectrogramUpdating = true;
+            m_loadingThread = std::thread(&AudioData::loadMappedWavSamples, this);
+            return;
+        }
+
         if (strstr(filename, ".wav") != NULL) {
-            loadFromWavFile(filename);
+            m_pDecoder.reset(createWavDecoder());
         }
         else if (strstr(filename, ".mp3") != NULL) {
-            loadFromMp3File(filename);
+            m_pDecoder.reset(createMp3Decoder());
         }
         else if (strstr(filename, ".ogg") != NULL) {
-            loadFromOggFile(filename);
+            m_pDecoder.reset(createOggDecoder());
         }
         else if (strstr(filename, ".flac") != NULL) {
-            loadFromFlacFile(filename);
+            m_pDecoder.reset(createFlacDecoder());
         }
-        // std::cout << "Finished loading.\n";
-    }
 
-    void loadFromMp3File(const char* filename)
-    {
-        unsigned int channelCount;
-        unsigned int sampleRate;
-        uint64_t frameCount;  // frame = 1 sample per channel
-        float* pSampleData = openMp3FileAndReadPcmFramesF32(filename, &channelCount,
-                                                            &sampleRate, &frameCount);
-        if (pSampleData) {
-            // std::cout << "    Loading .mp3 file with "
+        if (m_pDecoder && m_pDecoder->open(filename)) {
+            const uint32_t channelCount = m_pDecoder->getChannels();
+            const uint32_t sampleRate = m_pDecoder->getSampleRate();
+            const uint64_t expectedFrameCount = m_pDecoder->getTotalFrameCount();  // frame = 1 sample per channel
+            // std::cout << "    Loading file with "
             //           << channelCount << " channels, "
-            //           << frameCount << " frames at sample rate "
+            //           << expectedFrameCount << " frames at sample rate "
             //           << sampleRate << '\n';
-            processF32Samples(pSampleData, channelCount, sampleRate, frameCount);
-            freeMp3SampleData(pSampleData);
+            if (channelCount == 0) {
+                m_pDecoder->close();
+                return;
+            }
+
+            initializeChannels(channelCount, sampleRate, expectedFrameCount, getDefaultSpectrogramSettings());
+            spillLargeArrays(expectedFrameCount);
+            m_bSpectrogramUpdating = true;
+            m_loadingThread = std::thread(&AudioData::loadDecodedSamples, this);
         }
     }
 
-    void loadFromWavFile(const char* filename)
+    bool openMappedWavFile(const char* filename)
     {
-        unsigned int channelCount;
-        unsigned int sampleRate;
-        uint64_t frameCount;  // frame = 1 sample per channel
-        float* pSampleData = openWavFileAndReadPcmFramesF32(filename, &channelCount,
-                                                            &sampleRate, &frameCount);
-        if (pSampleData) {
-            // std::cout << "    Loading .wav file with "
-            //           << channelCount << " channels, "
-            //           << frameCount << " frames at sample rate "
-            //           << sampleRate << '\n';
-            processF32Samples(pSampleData, channelCount, sampleRate, frameCount);
-            freeWavSampleData(pSampleData);
-        }
+        WavPcmDataLayout& layout = m_wavLayout;
+        if (!getWavPcmDataLayout(filename, &layout) || !m_mappedFile.open(filename)) {
+            return false;
+        }
+
+        // Only use frames actually present, in case the file is truncated
+        const uint64_t dataEnd = std::min(layout.m_dataOffset + layout.m_dataSize, m_mappedFile.size());
+        if (dataEnd <= layout.m_dataOffset) {
+            m_mappedFile.close();
+            return false;
+        }
+        layout.m_totalFrameCount = std::min(layout.m_totalFrameCount,
+                                            (dataEnd - layout.m_dataOffset) / layout.m_bytesPerFrame);
+        // std::cout << "    Mapping .wav file with "
+        //           << layout.m_channels << " channels, "
+        //           << layout.m_totalFrameCount << " frames at sample rate "
+        //           << layout.m_sampleRate << '\n';
+        return true;
     }
 
-    void loadFromOggFile(const char* filename)
+    // Samples are read in place from the interleaved frames of the data chunk
+    std::vector<SampleView> getMappedWavViews(uint64_t frameCount) const
     {
-        unsigned int channelCount;
-        unsigned int sampleRate;
-        uint64_t frameCount;  // frame = 1 sample per channel
-        float* pSampleData = openOggFileAndReadPcmFramesF32(filename, &channelCount,
-                                                            &sampleRate, &frameCount);
-        if (pSampleData) {
-            // std::cout << "    Loading .ogg file with "
-            //           << channelCount << " channels, "
-            //           << frameCount << " frames at sample rate "
-            //           << sampleRate << '\n';
-            processF32Samples(pSampleData, channelCount, sampleRate, frameCount);
-            freeOggSampleData(pSampleData);
+        const WavPcmDataLayout& layout = m_wavLayout;
+        const uint8_t* pFrames = m_mappedFile.data() + layout.m_dataOffset;
+        const uint32_t bytesPerSample = sampleFormatSize(layout.m_format);
+        std::vector<SampleView> views(layout.m_channels);
+        for (size_t channel = 0; channel < layout.m_channels; channel++) {
+            views[channel] = SampleView(pFrames + (channel * bytesPerSample), frameCount,
+                                        layout.m_bytesPerFrame, layout.m_format);
+        }
+        return views;
+    }
+
+    void loadMappedWavSamples()
+    {
+        const WavPcmDataLayout& layout = m_wavLayout;
+
+        // Samples are processed a chunk at a time so each is shown as soon as it is ready.
+        // Files larger than a quarter of the memory budget are not kept in RAM once processed.
+        const bool bDropProcessedFrames = (layout.m_totalFrameCount * layout.m_bytesPerFrame > m_memoryBudget / 4);
+        std::vector<SampleView> views(layout.m_channels);
+        uint64_t frameCount = 0;
+        while (frameCount < layout.m_totalFrameCount && !m_bCancelLoading) {
+            const uint64_t chunkStart = frameCount;
+            frameCount = std::min(frameCount + kMappedChunkFrames, layout.m_totalFrameCount);
+            views = getMappedWavViews(frameCount);
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_channelViews = views;
+                m_dataVersion++;
+            }
+            updateChannels(views);
+            if (bDropProcessedFrames) {
+                adviseDontNeed(m_mappedFile.data() + layout.m_dataOffset + (chunkStart * layout.m_bytesPerFrame),
+                               (frameCount - chunkStart) * layout.m_bytesPerFrame);
+            }
         }
+
+        finalizeChannels(views);
     }
 
-    void loadFromFlacFile(const char* filename)
+    void loadDecodedSamples()
     {
-        unsigned int channelCount;
-        unsigned int sampleRate;
-        uint64_t frameCount;  // frame = 1 sample per channel
-        float* pSampleData = openFlacFileAndReadPcmFramesF32(filename, &channelCount,
-                                                             &sampleRate, &frameCount);
-        if (pSampleData) {
-            // std::cout << "    Loading .flac file with "
-            //           << channelCount << " channels, "
-            //           << frameCount << " frames at sample rate "
-            //           << sampleRate << '\n';
-            processF32Samples(pSampleData, channelCount, sampleRate, frameCount);
-            freeFlacSampleData(pSampleData);
+        AudioDecoder& decoder = *m_pDecoder;
+        std::vector<SampleView> views(decoder.getChannels());
+        if (decoder.getNativeFormat() == SAMPLE_FORMAT_S16) {
+            decodeSamples<int16_t>(decoder, views);
+        }
+        else {
+            decodeSamples<float>(decoder, views);
         }
+        decoder.close();
+
+        finalizeChannels(views);
     }
 
-    void processF32Samples(float* pSampleData, uint32_t channelCount, uint32_t sampleRate, uint64_t frameCount)
+    static uint64_t readPcmFrames(AudioDecoder& decoder, uint64_t framesToRead, float* pFramesOut)
     {
-        m_channelNames.reserve(channelCount);
-        m_channelData.reserve(channelCount);
+        return decoder.readPcmFramesF32(framesToRead, pFramesOut);
+    }
 
+    static uint64_t readPcmFrames(AudioDecoder& decoder, uint64_t framesToRead, int16_t* pFramesOut)
+    {
+        return decoder.readPcmFramesS16(framesToRead, pFramesOut);
+    }
+
+    template<typename T>
+    void decodeSamples(AudioDecoder& decoder, std::vector<SampleView>& views)
+    {
+        const uint32_t channelCount = decoder.getChannels();
+
+        // Samples are kept in the decoder's native width, in scratch files if they
+        // would take more than a quarter of the memory budget
+        const bool bSpill = (channelCount * decoder.getTotalFrameCount() * sizeof(T) > m_memoryBudget / 4);
+        const std::string directory = (bSpill ? getCacheDirectory() : "");
+        // The tile cache pages samples out, which is only safe if every channel is in a scratch file
+        bool bSpilled = bSpill;
+        std::vector<SampleBuffer<T>*> buffers;
         for (size_t channel = 0; channel < channelCount; channel++) {
-            std::string columnName = "Channel " + std::to_string(channel + 1);
-            m_channelNames.push_back(columnName);
+            SampleBuffer<T>* pBuffer = new SampleBuffer<T>();
+            if (bSpill && !pBuffer->spill(directory)) {
+                bSpilled = false;
+            }
+            if (!pBuffer->reserve(decoder.getTotalFrameCount())) {
+                bSpilled = false;
+            }
+            m_channelBuffers.push_back(std::unique_ptr<ChannelBuffer>(pBuffer));
+            buffers.push_back(pBuffer);
+        }
+        m_bSamplesMapped = bSpilled;
 
-            std::vector<double> samples;
-            samples.reserve(frameCount);
+        // Decode and process one chunk at a time, so only a single chunk of
+        // interleaved samples is resident, instead of a copy of the whole file
+        std::vector<T> chunk(kDecodeChunkFrames * channelCount);
+        while (!m_bCancelLoading) {
+            const uint64_t frameCount = readPcmFrames(decoder, kDecodeChunkFrames, chunk.data());
+            if (frameCount == 0) {
+                break;
+            }
 
-            for (size_t sample = 0; sample < frameCount; sample++) {
-                const float value = pSampleData[(sample * channelCount) + channel];  // samples are interleaved
-                samples.push_back((double)value);
+            {
+                // Appending can move the samples, so it is not done while they are drawn
+                std::lock_guard<std::mutex> lock(m_mutex);
+                std::atomic<bool> bMovedToRam(false);
+                m_threadPool.parallelFor(channelCount, [&](uint64_t channel, uint32_t) {
+                    if (!buffers[channel]->append(&chunk[channel], frameCount, channelCount)) {  // samples are interleaved
+                        bMovedToRam = true;
+                    }
+                });
+                if (bMovedToRam) {
+                    m_bSamplesMapped = false;
+                }
+                for (size_t channel = 0; channel < channelCount; channel++) {
+                    views[channel] = buffers[channel]->view();
+                    if (views[channel].data() != m_channelViews[channel].data()) {
+                        m_bTilesMoved = true;
+                    }
+                }
+                m_channelViews = views;
+                m_dataVersion++;
             }
+            updateChannels(views);
+        }
+    }
 
-            m_channelData.push_back(std::move(samples));
+    void initializeChannels(uint32_t channelCount, uint32_t sampleRate, uint64_t expectedFrameCount,
+                            const SpectrogramSettings& spectrogramSettings)
+    {
+        m_channelNames.reserve(channelCount);
+        for (size_t channel = 0; channel < channelCount; channel++) {
+            std::string columnName = "Channel " + std::to_string(channel + 1);
+            m_channelNames.push_back(columnName);
         }
+        m_channelViews.resize(channelCount);
 
         if (sampleRate > 0) {
             m_samplePeriod = (1.0 / (double)sampleRate);
@@ -314,97 +769,633 @@ private:
             m_samplePeriod = 1.0;
         }
 
-        m_maxTime = (double)((double)frameCount / (double)sampleRate);
+        // Until loading finishes, the length is taken from the file header
+        m_expectedNumValues = expectedFrameCount;
+        m_maxTime = getTime(expectedFrameCount);
 
-        initializeTraceData();
+        initializeTraceData(expectedFrameCount);
 
-        m_spectrogram.initialize(m_channelData, sampleRate);
+        m_spectrogram.initialize(channelCount, sampleRate, expectedFrameCount, spectrogramSettings);
+        m_spectrogram.setLazy(m_bLazySpectrogram || (getTime(expectedFrameCount) > kLazySpectrogramDuration));
     }
 
-    TraceDetailLevel createDetailLevel(uint64_t windowSize, int32_t channel, uint64_t numValues) const
+    // Keep arrays that would take more than a quarter of the memory budget in scratch
+    // files rather than RAM: the spectrogram, and the finest summary detail levels,
+    // leaving the coarsest levels that fit in RAM
+    void spillLargeArrays(uint64_t expectedFrameCount)
+    {
+        const uint64_t limit = m_memoryBudget / 4;
+        const uint64_t numChannels = getNumChannels();
+        const std::string directory = getCacheDirectory();
+        if (directory.empty() || m_traces.empty()) {
+            return;
+        }
+
+        const uint64_t numFrames = expectedFrameCount / m_spectrogram.hop();
+        if (!m_spectrogram.isLazy() && numChannels * numFrames * m_spectrogram.frame_bytes() > limit) {
+            m_spectrogram.spill(directory);
+        }
+
+        const uint64_t bytesPerPoint = sizeof(float) + (kDetailLevelOffsets ? sizeof(uint16_t) : 0);
+        uint64_t residentSize = 0;
+        for (size_t i = m_traces[0].m_levels.size() - 1; i > 0; i--) {
+            residentSize += numChannels * expectedNumPoints(m_traces[0].m_levels[i].m_windowSize, expectedFrameCount) * bytesPerPoint;
+            if (residentSize <= limit) {
+                continue;
+            }
+            for (Trace& trace : m_traces) {
+                if (!trace.m_levels[i].m_values.spill(directory) ||
+                    (kDetailLevelOffsets && !trace.m_levels[i].m_offsets.spill(directory))) {
+                    return;  // the rest stay in RAM
+                }
+            }
+        }
+    }
+
+    // Add newly published samples to the detail levels and spectrogram
+    void updateChannels(const std::vector<SampleView>& views)
+    {
+        updateTraceData(views, false);
+        m_spectrogram.update(views, m_threadPool, m_mutex, m_bCancelLoading);
+        requestRedraw(false);
+    }
+
+    void finalizeChannels(const std::vector<SampleView>& views)
+    {
+        if (!m_bCancelLoading) {
+            finalizeTraceData(views);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_expectedNumValues = getNumValues();
+            m_maxTime = getTime(getNumValues());
+            m_bLoaded = true;
+            m_dataVersion++;
+        }
+        requestRedraw(true);
+        // std::cout << "Finished loading.\n";
+
+        if (m_bUseCache && !m_bCancelLoading) {
+            saveCachedData(views);
+        }
+
+        finishSpectrogramUpdates(views);
+    }
+
+    void updateSpectrogram()
+    {
+        std::vector<SampleView> views;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            views = m_channelViews;
+        }
+        finishSpectrogramUpdates(views);
+    }
+
+    // Compute the spectrogram with any settings changed before it could be, until there are none
+    void finishSpectrogramUpdates(const std::vector<SampleView>& views)
+    {
+        while (true) {
+            m_spectrogram.update(views, m_threadPool, m_mutex, m_bCancelLoading);
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_bCancelLoading || !m_spectrogram.hasPendingSettings()) {
+                m_bSpectrogramUpdating = false;
+                return;
+            }
+        }
+    }
+
+    // Use the detail levels, spectrogram and, unless they are read in place from a
+    // mapped .wav file, the samples in the cache, reading them in place from its mapping
+    bool loadCachedData(bool bMappedWav)
+    {
+        uint64_t size = 0;
+        const CacheInfo* pInfo = (m_cache.open(m_cacheKey) ? (const CacheInfo*)m_cache.getSection(0, &size) : nullptr);
+        if (pInfo == nullptr || size != sizeof(CacheInfo) || !isValidCache(*pInfo, bMappedWav)) {
+            m_cache.close();
+            return false;
+        }
+
+        const CacheInfo& info = *pInfo;
+        const SampleFormat format = (SampleFormat)info.m_sampleFormat;
+        initializeChannels(info.m_channels, info.m_sampleRate, info.m_numValues, getCachedSpectrogramSettings(info));
+        m_spectrogram.setLazy((info.m_numBins == 0) && (info.m_numValues >= (uint64_t)m_spectrogram.n_fft()));  // as it was when cached
+        m_bSamplesMapped = true;
+
+        std::vector<SampleView> views = (bMappedWav ? getMappedWavViews(info.m_numValues) : std::vector<SampleView>(info.m_channels));
+        uint32_t section = 1;
+        for (int32_t column = 0; column < getNumChannels(); column++) {
+            if (info.m_bSamples) {
+                views[column] = SampleView(m_cache.getSection(section++, &size), info.m_numValues, sampleFormatSize(format), format);
+            }
+
+            Trace& trace = m_traces[column];
+            trace.m_levels.resize(1);
+            for (uint32_t i = 1; i < info.m_numLevels; i++) {
+                trace.m_levels.push_back(createDetailLevel((uint64_t)1 << (i + 1)));
+                TraceDetailLevel& level = trace.m_levels.back();
+                level.m_numPoints = expectedNumPoints(level.m_windowSize, info.m_numValues);
+                level.m_pValues = (const float*)m_cache.getSection(section++, &size);
+                if (info.m_bOffsets) {
+                    level.m_pOffsets = (const uint16_t*)m_cache.getSection(section++, &size);
+                }
+            }
+
+            for (uint32_t i = 0; i < info.m_numSpectrogramLevels; i++) {
+                m_spectrogram.load(column, i, (const uint8_t*)m_cache.getSection(section++, &size), info.m_numBins >> i);
+            }
+            m_spectrogram.loadHistogram(column, (const uint64_t*)m_cache.getSection(section++, &size));
+        }
+
+        m_channelViews = views;
+        m_expectedNumValues = info.m_numValues;
+        m_maxTime = getTime(info.m_numValues);
+        m_bLoaded = true;
+        m_dataVersion++;
+        // std::cout << "Loaded from cache.\n";
+        return true;
+    }
+
+    static SpectrogramSettings getCachedSpectrogramSettings(const CacheInfo& info)
+    {
+        SpectrogramSettings settings;
+        settings.m_fftSize = info.m_fftSize;
+        settings.m_hop = info.m_hop;
+        settings.m_window = (SpectrogramWindow)info.m_window;
+        settings.m_format = (SpectrogramFormat)info.m_spectrogramFormat;
+        return settings;
+    }
+
+    SpectrogramSettings getDefaultSpectrogramSettings() const
+    {
+        SpectrogramSettings settings;
+        settings.m_format = m_spectrogramFormat;
+        return settings;
+    }
+
+    // Whether the cache is for data processed the way it is now, and has every section it should
+    bool isValidCache(const CacheInfo& info, bool bMappedWav) const
+    {
+        const uint32_t numSectionsPerChannel = (info.m_bSamples ? 1 : 0) + ((info.m_numLevels - 1) * (info.m_bOffsets ? 2 : 1)) + info.m_numSpectrogramLevels + 1;
+        bool bValid = (info.m_version == kCacheDataVersion) &&
+                      (info.m_channels > 0) &&
+                      ((info.m_bSamples != 0) != bMappedWav) &&
+                      ((info.m_bOffsets != 0) == kDetailLevelOffsets) &&
+                      (info.m_numLevels >= 1) && (info.m_numLevels <= kMaxDetailLevels + 1) &&
+                      (info.m_sampleFormat <= SAMPLE_FORMAT_F64) &&
+                      isValidSpectrogramSettings(getCachedSpectrogramSettings(info)) &&
+                      (info.m_spectrogramFormat == (uint32_t)m_spectrogramFormat) &&
+                      (info.m_numFrequencies == (info.m_fftSize / 2) + 1) &&
+                      (info.m_numBins >= 0) &&
+                      (info.m_numSpectrogramLevels >= 1) && (info.m_numSpectrogramLevels <= 32) &&
+                      (m_cache.getNumSections() == 1 + (info.m_channels * numSectionsPerChannel));
+        if (bValid && bMappedWav) {
+            bValid = (info.m_channels == m_wavLayout.m_channels) &&
+                     (info.m_sampleRate == m_wavLayout.m_sampleRate) &&
+                     (info.m_numValues == m_wavLayout.m_totalFrameCount);
+        }
+
+        uint32_t section = 1;
+        uint64_t size = 0;
+        for (uint32_t column = 0; column < info.m_channels && bValid; column++) {
+            if (info.m_bSamples) {
+                m_cache.getSection(section++, &size);
+                bValid = bValid && (size == info.m_numValues * sampleFormatSize((SampleFormat)info.m_sampleFormat));
+            }
+            for (uint32_t i = 1; i < info.m_numLevels; i++) {
+                const uint64_t numPoints = expectedNumPoints((uint64_t)1 << (i + 1), info.m_numValues);
+                m_cache.getSection(section++, &size);
+                bValid = bValid && (size == numPoints * sizeof(float));
+                if (info.m_bOffsets) {
+                    m_cache.getSection(section++, &size);
+                    bValid = bValid && (size == numPoints * sizeof(uint16_t));
+                }
+            }
+            for (uint32_t i = 0; i < info.m_numSpectrogramLevels; i++) {
+                m_cache.getSection(section++, &size);
+                bValid = bValid && (size == (uint64_t)info.m_numFrequencies * (info.m_numBins >> i) *
+                                             getSpectrogramFormatSize(m_spectrogramFormat));
+            }
+            m_cache.getSection(section++, &size);
+            bValid = bValid && (size == kSpectrogramHistogramBins * sizeof(uint64_t));
+        }
+        return bValid;
+    }
+
+    void saveCachedData(const std::vector<SampleView>& views)
+    {
+        // Decoded samples are cached too, so reopening the file skips decoding
+        const bool bSamples = !m_mappedFile.isOpen();
+        const uint64_t numValues = getNumValues();
+        const uint32_t numLevels = getNumLevels();
+
+        CacheInfo info;
+        memset(&info, 0, sizeof(info));
+        info.m_version = kCacheDataVersion;
+        info.m_channels = (uint32_t)getNumChannels();
+        info.m_sampleRate = (uint32_t)std::lround(1.0 / m_samplePeriod);
+        info.m_sampleFormat = (views.empty() ? SAMPLE_FORMAT_F32 : views[0].format());
+        info.m_numValues = numValues;
+        info.m_bSamples = bSamples;
+        info.m_bOffsets = kDetailLevelOffsets;
+        info.m_numLevels = numLevels;
+        info.m_numFrequencies = m_spectrogram.n_frq();
+        info.m_numBins = m_spectrogram.n_bin();
+        info.m_numSpectrogramLevels = (uint32_t)m_spectrogram.n_levels();
+        info.m_fftSize = m_spectrogram.settings().m_fftSize;
+        info.m_hop = m_spectrogram.settings().m_hop;
+        info.m_window = m_spectrogram.settings().m_window;
+        info.m_spectrogramFormat = m_spectrogram.settings().m_format;
+
+        uint64_t cacheSize = 0;
+        for (int32_t column = 0; column < getNumChannels(); column++) {
+            if (bSamples) {
+                cacheSize += numValues * sampleFormatSize(views[column].format());
+            }
+            for (uint32_t i = 1; i < numLevels; i++) {
+                cacheSize += getNumPoints(i) * (sizeof(float) + (kDetailLevelOffsets ? sizeof(uint16_t) : 0));
+            }
+            for (uint32_t i = 0; i < info.m_numSpectrogramLevels; i++) {
+                cacheSize += m_spectrogram.frame_bytes() * m_spectrogram.n_bin(i);
+            }
+            cacheSize += kSpectrogramHistogramBins * sizeof(uint64_t);
+        }
+        if (numValues == 0 || cacheSize > kMaxCacheSize) {
+            return;
+        }
+
+        // Histograms are copied while tiles can't be adding to them
+        std::vector<uint64_t> histograms;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            for (int32_t column = 0; column < getNumChannels(); column++) {
+                histograms.insert(histograms.end(), m_spectrogram.histogram(column), m_spectrogram.histogram(column) + kSpectrogramHistogramBins);
+            }
+        }
+
+        // std::cout << "Saving to cache...\n";
+        CacheWriter writer;
+        bool bSuccess = writer.open(m_cacheKey) && writer.addSection(&info, sizeof(info));
+        for (int32_t column = 0; column < getNumChannels() && bSuccess && !m_bCancelLoading; column++) {
+            if (bSamples) {
+                bSuccess = writer.addSection(views[column].data(), numValues * sampleFormatSize(views[column].format()));
+            }
+            const Trace& trace = m_traces[column];
+            for (uint32_t i = 1; i < numLevels && bSuccess; i++) {
+                const TraceDetailLevel& level = trace.m_levels[i];
+                bSuccess = writer.addSection(level.m_pValues, level.m_numPoints * sizeof(float));
+                if (kDetailLevelOffsets && bSuccess) {
+                    bSuccess = writer.addSection(level.m_pOffsets, level.m_numPoints * sizeof(uint16_t));
+                }
+            }
+            for (uint32_t i = 0; i < info.m_numSpectrogramLevels && bSuccess; i++) {
+                bSuccess = writer.addSection(m_spectrogram.data(column, i), m_spectrogram.frame_bytes() * m_spectrogram.n_bin(i));
+            }
+            if (bSuccess) {
+                bSuccess = writer.addSection(&histograms[(size_t)column * kSpectrogramHistogramBins], kSpectrogramHistogramBins * sizeof(uint64_t));
+            }
+        }
+        if (bSuccess && !m_bCancelLoading) {
+            writer.commit(kMaxCacheSize);
+        }
+    }
+
+    // Wake the GUI thread to draw newly published data, at most every
+    // kLoadingRedrawInterval seconds unless bForce
+    void requestRedraw(bool bForce)
+    {
+        const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        if (bForce || std::chrono::duration<double>(now - m_lastRedrawRequest).count() >= kLoadingRedrawInterval) {
+            m_lastRedrawRequest = now;
+            glfwPostEmptyEvent();
+        }
+    }
+
+    TraceDetailLevel createDetailLevel(uint64_t windowSize) const
     {
         TraceDetailLevel level;
         level.m_windowSize = windowSize;
-        level.m_windowTime = getTime(windowSize);
+        while ((windowSize - 1) >> level.m_offsetShift > std::numeric_limits<uint16_t>::max()) {
+            level.m_offsetShift++;
+        }
+        return level;
+    }
+
+    // Resample windows [windowStart, windowEnd) of the first summary level from the samples
+    static void resampleWindows(TraceDetailLevel& level, const SampleView& samples, uint64_t windowStart, uint64_t windowEnd)
+    {
+        switch (samples.format()) {
+            case SAMPLE_FORMAT_S16:
+                windowStart = reduceSampleWindows<int16_t>(level, samples, windowStart, windowEnd);
+                resampleWindows<int16_t>(level, samples, windowStart, windowEnd);
+                break;
+            case SAMPLE_FORMAT_S24: resampleWindows<Sample24>(level, samples, windowStart, windowEnd); break;
+            case SAMPLE_FORMAT_S32: resampleWindows<int32_t>(level, samples, windowStart, windowEnd); break;
+            case SAMPLE_FORMAT_F32:
+                windowStart = reduceSampleWindows<float>(level, samples, windowStart, windowEnd);
+                resampleWindows<float>(level, samples, windowStart, windowEnd);
+                break;
+            case SAMPLE_FORMAT_F64: resampleWindows<double>(level, samples, windowStart, windowEnd); break;
+        }
+    }
 
-        // Resample using the min and max point in each window
-        level.m_points.reserve(numValues + 1);
-        for (uint64_t indexStart = 0; indexStart < numValues; indexStart += windowSize) {
+    // Samples that can be read in place as an array of T
+    template<typename T>
+    static bool isContiguous(const SampleView& samples)
+    {
+        return (samples.format() == SampleFormatOf<T>::value) && (samples.stride() == sizeof(T)) &&
+               ((uintptr_t)samples.data() % alignof(T) == 0);
+    }
 
-            double xMin = 0.0;
-            double xMax = 0.0;
+    // Resample whole windows of 16-bit or float samples with the vectorized kernels,
+    // gathering interleaved samples a block at a time, and return the first window
+    // left to the scalar loop. The kernels do not track where in each window the
+    // values occur, so offsets use the scalar loop.
+    template<typename T>
+    static uint64_t reduceSampleWindows(TraceDetailLevel& level, const SampleView& samples, uint64_t windowStart, uint64_t windowEnd)
+    {
+        const uint64_t wholeWindowEnd = std::min(windowEnd, samples.size() / 4);  // the first summary level has 4 sample windows
+        if (kDetailLevelOffsets || wholeWindowEnd <= windowStart) {
+            return windowStart;
+        }
+
+        const uint64_t numWindows = wholeWindowEnd - windowStart;
+        float* pValuesOut = &level.m_values[2 * windowStart];
+        if (isContiguous<T>(samples)) {
+            reduceMinMax4((const T*)samples.data() + (4 * windowStart), numWindows, pValuesOut);
+        }
+        else {
+            const uint64_t kBlockWindows = 4096;
+            std::vector<T> block(4 * std::min(kBlockWindows, numWindows));
+            for (uint64_t window = 0; window < numWindows; window += kBlockWindows) {
+                const uint64_t blockWindows = std::min(kBlockWindows, numWindows - window);
+                const uint64_t indexStart = 4 * (windowStart + window);
+                for (uint64_t i = 0; i < 4 * blockWindows; i++) {
+                    block[i] = samples.get<T>(indexStart + i);
+                }
+                reduceMinMax4(block.data(), blockWindows, pValuesOut + (2 * window));
+            }
+        }
+        return wholeWindowEnd;
+    }
+
+    template<typename T>
+    static void resampleWindows(TraceDetailLevel& level, const SampleView& samples, uint64_t windowStart, uint64_t windowEnd)
+    {
+        const uint64_t windowSize = level.m_windowSize;
+        const uint64_t numValues = samples.size();
+
+        // Resample using the min and max point in each window, the last of which may be partial
+        for (uint64_t window = windowStart; window < windowEnd; window++) {
+            const uint64_t indexStart = window * windowSize;
+            uint64_t indexMin = indexStart;
+            uint64_t indexMax = indexStart;
             double yMin = std::numeric_limits<double>::max();
             double yMax = -std::numeric_limits<double>::max();
             const uint64_t indexEnd = std::min(indexStart + windowSize, numValues);
             for (uint64_t index = indexStart; index < indexEnd; index++) {
-                const double y = getValue(channel, index); // -1 to +1
+                const double y = sampleToDouble(samples.get<T>(index)); // -1 to +1
                 if (y < yMin) {
-                    xMin = getTime(index);
+                    indexMin = index;
                     yMin = y;
                 }
-                if (y > yMax) {
-                    xMax = getTime(index);
-                    yMax = y;
+                if (y > yMax) {
+                    indexMax = index;
+                    yMax = y;
+                }
+            }
+
+            if (indexMin < indexMax) {
+                setDetailValue(level, 2 * window, (float)yMin, indexMin - indexStart);
+                setDetailValue(level, 2 * window + 1, (float)yMax, indexMax - indexStart);
+            }
+            else {
+                setDetailValue(level, 2 * window, (float)yMax, indexMax - indexStart);
+                setDetailValue(level, 2 * window + 1, (float)yMin, indexMin - indexStart);
+            }
+        }
+    }
+
+    // Resample windows [windowStart, windowEnd) of a level from the level below it, whose
+    // windows are half as wide, so that the samples themselves are only scanned once,
+    // for the first summary level
+    static void reduceWindows(TraceDetailLevel& level, const TraceDetailLevel& child, uint64_t windowStart, uint64_t windowEnd)
+    {
+        const uint64_t numChildValues = child.m_values.size();
+
+        // Whole windows are reduced with the vectorized kernel, unless offsets are tracked
+        const uint64_t wholeWindowEnd = std::min(windowEnd, numChildValues / 4);
+        if (!kDetailLevelOffsets && (wholeWindowEnd > windowStart)) {
+            reduceMinMax4(&child.m_values[4 * windowStart], wholeWindowEnd - windowStart, &level.m_values[2 * windowStart]);
+            windowStart = wholeWindowEnd;
+        }
+
+        // Each window covers two child windows, i.e. four child values in time order,
+        // the last of which may be partial
+        for (uint64_t window = windowStart; window < windowEnd; window++) {
+            const uint64_t indexStart = 4 * window;
+            uint64_t indexMin = indexStart;
+            uint64_t indexMax = indexStart;
+            float yMin = child.m_values[indexStart];
+            float yMax = child.m_values[indexStart];
+            const uint64_t indexEnd = std::min(indexStart + 4, numChildValues);
+            for (uint64_t index = indexStart + 1; index < indexEnd; index++) {
+                const float y = child.m_values[index];
+                if (y < yMin) {
+                    indexMin = index;
+                    yMin = y;
+                }
+                if (y > yMax) {
+                    indexMax = index;
+                    yMax = y;
+                }
+            }
+
+            if (indexMin < indexMax) {
+                setDetailValue(level, 2 * window, yMin, getChildOffset(child, indexStart, indexMin));
+                setDetailValue(level, 2 * window + 1, yMax, getChildOffset(child, indexStart, indexMax));
+            }
+            else {
+                setDetailValue(level, 2 * window, yMax, getChildOffset(child, indexStart, indexMax));
+                setDetailValue(level, 2 * window + 1, yMin, getChildOffset(child, indexStart, indexMin));
+            }
+        }
+    }
+
+    // Position within the parent window of a child value
+    static uint64_t getChildOffset(const TraceDetailLevel& child, uint64_t indexStart, uint64_t index)
+    {
+        if (child.m_offsets.empty()) {
+            return 0;
+        }
+        const uint64_t windowOffset = ((index - indexStart) / 2) * child.m_windowSize;
+        return windowOffset + ((uint64_t)child.m_offsets[index] << child.m_offsetShift);
+    }
+
+    static void setDetailValue(TraceDetailLevel& level, uint64_t index, float value, uint64_t offset)
+    {
+        level.m_values[index] = value;
+        if (kDetailLevelOffsets) {
+            level.m_offsets[index] = (uint16_t)(offset >> level.m_offsetShift);
+        }
+    }
+
+    static uint64_t expectedNumPoints(uint64_t windowSize, uint64_t numValues)
+    {
+        if (windowSize == 1) {
+            return numValues;
+        }
+        return 2 * ((numValues + windowSize - 1) / windowSize);
+    }
+
+    void initializeTraceData(uint64_t expectedNumValues)
+    {
+        // std::cout << "    Processing Channel Data...\n";
+
+        const int32_t numChannels = getNumChannels();
+
+        setAllTracesVisible(true);
+
+        m_traces.resize(numChannels);
+        for (int32_t column = 0; column < numChannels; column++) {
+
+            Trace& trace = m_traces[column];
+
+            // Add full detail level, which is read directly from the samples
+            trace.m_levels.push_back(createDetailLevel(1));
+
+            // Add the summary detail levels the expected number of values calls for
+            uint64_t windowSize = 4;
+            for (uint32_t i = 0; i < kMaxDetailLevels; i++) {
+                if (expectedNumPoints(trace.m_levels[i].m_windowSize, expectedNumValues) < kMinDetailLevelPoints) {
+                    break;
+                }
+                trace.m_levels.push_back(createDetailLevel(windowSize));
+                trace.m_levels.back().m_values.reserve(expectedNumPoints(windowSize, expectedNumValues));
+                if (kDetailLevelOffsets) {
+                    trace.m_levels.back().m_offsets.reserve(expectedNumPoints(windowSize, expectedNumValues));
                 }
-            }
-
-            if (xMin < xMax) {
-                level.m_points.push_back(Point(xMin, yMin));
-                level.m_points.push_back(Point(xMax, yMax));
-            }
-            else {
-                level.m_points.push_back(Point(xMax, yMax));
-                level.m_points.push_back(Point(xMin, yMin));
+                windowSize *= 2;
             }
         }
-        level.m_points.push_back(Point(getTime(numValues-1), getValue(channel, numValues-1)));
-
-        return level;
     }
 
-    void initializeTraceData()
+    // Resample windows [windowStart, windowEnd) of a summary level of every channel. The
+    // windows are split into segments resampled in parallel, each writing only its own
+    // values, so the result is the same for any number of threads.
+    void resampleDetailLevels(size_t i, const std::vector<SampleView>& views, uint64_t windowStart, uint64_t windowEnd)
     {
-        // std::cout << "    Processing Channel Data...\n";
+        if (windowEnd <= windowStart) {
+            return;
+        }
 
         const int32_t numChannels = getNumChannels();
-        const uint64_t numValues = getNumValues();
+        const uint64_t numSegments = (windowEnd - windowStart + kSegmentWindows - 1) / kSegmentWindows;
+        m_threadPool.parallelFor(numChannels * numSegments, [&](uint64_t task, uint32_t) {
+            const int32_t column = (int32_t)(task / numSegments);
+            const uint64_t segmentStart = windowStart + ((task % numSegments) * kSegmentWindows);
+            const uint64_t segmentEnd = std::min(segmentStart + kSegmentWindows, windowEnd);
+            Trace& trace = m_traces[column];
+            if (i == 1) {
+                resampleWindows(trace.m_levels[i], views[column], segmentStart, segmentEnd);
+            }
+            else {
+                reduceWindows(trace.m_levels[i], trace.m_levels[i - 1], segmentStart, segmentEnd);
+            }
+        });
+    }
 
-        setAllTracesVisible(true);
+    // Extend the summary detail levels with the windows the samples now cover, including
+    // a final partial window if bFinal. The levels are resized while the data lock is held,
+    // so values are never moved while they are drawn, then resampled without it, and published.
+    void updateTraceData(const std::vector<SampleView>& views, bool bFinal)
+    {
+        if (m_traces.empty() || views.empty()) {
+            return;
+        }
 
-        m_traces.reserve(numChannels);
-        for (int32_t column = 0; column < numChannels; column++) {
+        const size_t numLevels = m_traces[0].m_levels.size();
+        std::vector<uint64_t> windowStarts(numLevels, 0);
+        std::vector<uint64_t> windowEnds(numLevels, 0);
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+
+            // Each window covers four samples, or two windows of the level below it
+            uint64_t numWindows = (bFinal ? (views[0].size() + 3) / 4 : views[0].size() / 4);
+            for (size_t i = 1; i < numLevels; i++) {
+                windowStarts[i] = m_traces[0].m_levels[i].m_values.size() / 2;
+                windowEnds[i] = std::max(numWindows, windowStarts[i]);
+                for (Trace& trace : m_traces) {
+                    TraceDetailLevel& level = trace.m_levels[i];
+                    level.m_values.resize(2 * windowEnds[i]);
+                    if (level.m_values.data() != level.m_pValues) {
+                        level.m_pValues = level.m_values.data();
+                        m_bTilesMoved = true;
+                    }
+                    if (kDetailLevelOffsets) {
+                        level.m_offsets.resize(2 * windowEnds[i]);
+                        if (level.m_offsets.data() != level.m_pOffsets) {
+                            level.m_pOffsets = level.m_offsets.data();
+                            m_bTilesMoved = true;
+                        }
+                    }
+                }
+                numWindows = (bFinal ? (numWindows + 1) / 2 : numWindows / 2);
+            }
+        }
 
-            Trace trace;
+        for (size_t i = 1; i < numLevels; i++) {
+            resampleDetailLevels(i, views, windowStarts[i], windowEnds[i]);
+        }
 
-            // Add full detail level
-            {
-                TraceDetailLevel level;
-                level.m_windowSize = 1;
-                level.m_windowTime = getMaxTime();
-                level.m_points.reserve(numValues);
-                for (uint64_t index = 0; index < numValues; index++) {
-                    double x = getTime(index);
-                    double y = getValue(column, index); // -1 to +1
-                    level.m_points.push_back(Point(x, y));
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            for (Trace& trace : m_traces) {
+                for (size_t i = 1; i < numLevels; i++) {
+                    trace.m_levels[i].m_numPoints = trace.m_levels[i].m_values.size();
                 }
-                trace.m_levels.push_back(std::move(level));
             }
+            m_dataVersion++;
+        }
+    }
+
+    void finalizeTraceData(const std::vector<SampleView>& views)
+    {
+        const uint64_t numValues = (views.empty() ? 0 : views[0].size());
+        if (numValues == 0) {
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
 
-            // Add summary detail levels
+            // Keep summary detail levels while the previous level is large enough, creating
+            // any levels the expected number of values did not account for. Every channel
+            // has the same number of values, so they all have the same levels.
+            size_t numLevels = 1;
+            uint64_t numPoints = numValues;
             uint64_t windowSize = 4;
-            for (uint32_t i = 0; i < kMaxDetailLevels; i++) {
-                if (trace.m_levels[i].m_points.size() < kMinDetailLevelPoints) {
-                    break;
+            while (numLevels <= kMaxDetailLevels && numPoints >= kMinDetailLevelPoints) {
+                if (numLevels == m_traces[0].m_levels.size()) {
+                    for (Trace& trace : m_traces) {
+                        trace.m_levels.push_back(createDetailLevel(windowSize));
+                    }
                 }
-                TraceDetailLevel level = createDetailLevel(windowSize, column, numValues);
-                trace.m_levels.push_back(std::move(level));
+                numPoints = expectedNumPoints(windowSize, numValues);
                 windowSize *= 2;
+                numLevels++;
+            }
+            for (Trace& trace : m_traces) {
+                trace.m_levels.resize(numLevels);
             }
 
-            m_traces.push_back(std::move(trace));
-            // std::cout << "        Channel " << column << " processed\n";
+            // The levels may have shrunk, so the GUI must clamp its level before it next draws
+            m_dataVersion++;
         }
 
+        updateTraceData(views, true);
+
         // std::cout << "    Finished Processing.\n";
     }
 };
@@ -428,11 +1419,22 @@ std::array<bool,20> g_bTraceTogglePressed = {};  // Keys 0-9, with and without s
 bool g_bTraceToggleExclusive = false;
 bool g_bPlotModeSwitchPressed = false;
 bool g_bColorMapPressed = false;
+bool g_bSpectrogramFftSizePressed = false;
+bool g_bSpectrogramOverlapPressed = false;
+bool g_bSpectrogramWindowPressed = false;
+bool g_bSpectrogramScalePressed = false;
+bool g_bAutoLevelsPressed = false;
+bool g_bCursorSpectrumPressed = false;
+bool g_bRowHeightDecrPressed = false;
+bool g_bRowHeightIncrPressed = false;
+bool g_bPageUpPressed = false;
+bool g_bPageDownPressed = false;
 
 class GuiRenderer
 {
 public:
-    GuiRenderer(AudioData& data, GLFWwindow* window)
+    GuiRenderer(AudioData& data, GLFWwindow* window, float multiPlotRowHeight = 0.0f)
+    : m_spectrogramBands(kSpectrogramBandsBudget)
     {
         // Setup Dear ImGui context
         IMGUI_CHECKVERSION();
@@ -451,15 +1453,22 @@ public:
 #endif
         ImGui_ImplGlfw_InitForOpenGL(window, true);
         ImGui_ImplOpenGL3_Init(glsl_version);
+        m_spectrogramTextures.initialize(glsl_version, kSpectrogramTextureBudget);
+        m_waveformBuffers.initialize(glsl_version, kWaveformBufferBudget);
+        m_plotItemBuffers.initialize(glsl_version);
 
         // Setup Style
         ImGui::StyleColorsDark();
         ImPlot::PushColormap(m_colorMapIdx);
 
-        m_frameCount = data.getNumValues();
+        // Samples may still be loading, so the cursor and axes cover the expected length
+        m_frameCount = data.getExpectedNumValues();
         m_frameCurrent = m_frameCount / 2;
+        m_maxTime = data.getMaxTime();
+        m_dataVersion = data.getDataVersion();
 
         m_plotMode = (data.numTraces() > 8 ? PLOT_MODE_COMBINED : PLOT_MODE_SPREAD);
+        m_multiPlotRowHeight = (multiPlotRowHeight > 0.0f ? std::max(multiPlotRowHeight, kMinRowHeight) : 0.0f);
 
         resetXAxis(data);
         resetYAxis();
@@ -467,6 +1476,9 @@ public:
 
     void shutdown()
     {
+        m_spectrogramTextures.shutdown();
+        m_waveformBuffers.shutdown();
+        m_plotItemBuffers.shutdown();
         ImGui_ImplOpenGL3_Shutdown();
         ImGui_ImplGlfw_Shutdown();
         ImPlot::DestroyContext();
@@ -482,6 +1494,12 @@ public:
         //ImGui::GetIO().FontGlobalScale = 2.5;
         ImGui::PushStyleVar(ImGuiStyleVar_WindowRounding, 0);
 
+        m_bDataChanged = (data.getDataVersion() != m_dataVersion);
+        if (m_bDataChanged) {
+            m_dataVersion = data.getDataVersion();
+            processDataChanges(data);
+        }
+
         processKeyboardCommands(data);
 
         drawColumnViewWindow(data);
@@ -494,7 +1512,15 @@ public:
         else if (m_plotMode == PLOT_MODE_SPECTROGRAM) {
             drawSpectrogramPlotWindow(data);
         }
+        m_waveformBuffers.endFrame();
+        m_plotItemBuffers.endFrame();
         m_bPlotModeChanged = false;
+        if (m_bShowCursorSpectrum) {
+            drawCursorSpectrumWindow(data);
+        }
+        else {
+            m_cursorSpectrumFrame = UINT64_MAX;  // as the samples may change while it is hidden
+        }
 
         // ImGui::ShowMetricsWindow();
 
@@ -516,6 +1542,22 @@ public:
         }
     }
 
+    // Pick up data published by the loading thread
+    void processDataChanges(AudioData& data)
+    {
+        m_frameCount = data.getExpectedNumValues();
+        if (m_frameCurrent >= m_frameCount) {
+            m_frameCurrent = (m_frameCount > 0 ? m_frameCount - 1 : 0);
+        }
+        m_levelCurrent = std::min(m_levelCurrent, data.getNumLevels() - 1);
+
+        // Keep showing the whole file if its length changed once it was loaded
+        if ((m_xAxisMinNext == 0.0) && (m_xAxisMaxNext == m_maxTime)) {
+            m_xAxisMaxNext = data.getMaxTime();
+        }
+        m_maxTime = data.getMaxTime();
+    }
+
     void processKeyboardCommands(AudioData& data)
     {
         // Handle Keyboard Combined/Multi Plot Toggle
@@ -659,6 +1701,49 @@ public:
             g_bColorMapPressed = false;
             cycleToNextColorMap();
         }
+
+        if (g_bSpectrogramScalePressed) {
+            g_bSpectrogramScalePressed = false;
+            m_spectrogramScale = (SpectrogramScale)((m_spectrogramScale + 1) % NUM_SPECTROGRAM_SCALES);
+        }
+
+        if (g_bAutoLevelsPressed) {
+            g_bAutoLevelsPressed = false;
+            m_bAutoLevels = !m_bAutoLevels;
+        }
+
+        if (g_bCursorSpectrumPressed) {
+            g_bCursorSpectrumPressed = false;
+            m_bShowCursorSpectrum = !m_bShowCursorSpectrum;
+        }
+
+        // Handle Keyboard Multiple Plot Row Height, from the height the rows have now
+        if (g_bRowHeightDecrPressed || g_bRowHeightIncrPressed) {
+            const float step = (g_bRowHeightIncrPressed ? kRowHeightStep : 1.0f / kRowHeightStep);
+            m_multiPlotRowHeight = std::max(std::floor(m_multiPlotRowHeightCurrent * step), kMinRowHeight);
+            g_bRowHeightDecrPressed = false;
+            g_bRowHeightIncrPressed = false;
+        }
+
+        // Handle Keyboard Spectrogram Settings
+        if (g_bSpectrogramFftSizePressed || g_bSpectrogramOverlapPressed || g_bSpectrogramWindowPressed) {
+            SpectrogramSettings settings = data.spectrogram().requestedSettings();
+            int overlap = settings.m_fftSize / settings.m_hop;
+            if (g_bSpectrogramFftSizePressed) {
+                settings.m_fftSize = (settings.m_fftSize < kMaxSpectrogramFftSize ? settings.m_fftSize * 2 : kMinSpectrogramFftSize);
+            }
+            if (g_bSpectrogramOverlapPressed) {
+                overlap = (overlap < kMaxSpectrogramOverlap ? overlap * 2 : 1);
+            }
+            if (g_bSpectrogramWindowPressed) {
+                settings.m_window = (SpectrogramWindow)((settings.m_window + 1) % NUM_SPECTROGRAM_WINDOWS);
+            }
+            settings.m_hop = settings.m_fftSize / overlap;
+            data.setSpectrogramSettings(settings);
+            g_bSpectrogramFftSizePressed = false;
+            g_bSpectrogramOverlapPressed = false;
+            g_bSpectrogramWindowPressed = false;
+        }
     }
 
     void drawColumnViewWindow(AudioData& data)
@@ -683,8 +1768,11 @@ public:
                  "Frame %" PRIu64 " / %" PRIu64 "          Time %.3f / %.3f",
                  m_frameCurrent + 1u, m_frameCount, data.getTime(m_frameCurrent), data.getMaxTime());
         static uint64_t min = 0;
-        static uint64_t max = (m_frameCount - 1);
+        uint64_t max = (m_frameCount - 1);
         ImGui::SliderScalar("##Slider", ImGuiDataType_U64, &m_frameCurrent, &min, &max, lbl);
+        if (!data.isLoaded()) {
+            ImGui::ProgressBar(data.getLoadingProgress(), ImVec2(-1, 0));
+        }
         ImGui::PopItemWidth();
 
         ImGui::Columns(data.getNumChannels() + 2);
@@ -735,7 +1823,12 @@ public:
             for (uint64_t frame = minFrame; frame <= maxFrame; frame++) {
                 ImColor traceColor = data.getTraceColor(trace);
                 ImColor color = (frame == m_frameCurrent ? highlightColor : traceColor);
-                ImGui::TextColored(color, "%12.8f", data.getValue(trace, frame));
+                if (frame < data.getNumValues()) {
+                    ImGui::TextColored(color, "%12.8f", data.getValue(trace, frame));
+                }
+                else {
+                    ImGui::TextColored(color, "%12s", "");
+                }
             }
             ImGui::NextColumn();
         }
@@ -747,21 +1840,16 @@ public:
 
     void fitYLimitsToData(const AudioData& data)
     {
-        double yMax = -std::numeric_limits<double>::max();
+        double yMax = -1.0;
         for (int32_t trace = 0; trace < data.numTraces(); trace++) {
             if (!data.isTraceVisible(trace)) {
                 continue;
             }
 
-            for (uint64_t ix = m_plotStartIdx; ix < m_plotEndIdx; ix++) {
-                const double value = std::abs(data.getPointArray(trace, m_levelCurrent)[ix].y);
-                if (value > yMax) {
-                    yMax = value;
-                }
-            }
+            yMax = std::max(yMax, data.getMaxAbsValue(trace, m_levelCurrent, m_plotStartIdx, m_plotEndIdx));
         }
 
-        if (yMax != -std::numeric_limits<double>::max()) {
+        if (yMax >= 0.0) {
             m_yAxisMinNext = -1.05 * yMax;
             m_yAxisMaxNext =  1.05 * yMax;
         }
@@ -824,15 +1912,16 @@ public:
             detectPlotLimitsChangesFromMouse(plotLimits);
 
             const double timeRange = plotLimits.X.Size();
+            const int numColumns = std::max((int)ImPlot::GetPlotSize().x, 1);
 
             uint64_t numPointsVisible = data.getNumPointsInRange(timeRange, m_levelCurrent);
 
-            if (bPlotLimitsChanged) {
-                numPointsVisible = adjustPlotDetailLevel(data, timeRange, numPointsVisible);
+            if (bPlotLimitsChanged || m_bDataChanged || (numColumns != m_numPlotColumns)) {
+                numPointsVisible = adjustPlotDetailLevel(data, timeRange, numColumns);
                 adjustDataBounds(data, plotLimits.X.Min, plotLimits.X.Max);
             }
 
-            const bool bShowMarkers = numPointsVisible < 250;
+            const bool bShowMarkers = !m_bPixelColumns && (numPointsVisible < 250);
 
             drawTraceLines(data, 0, data.numTraces(), bShowMarkers, bSpreadEnabled);
 
@@ -846,6 +1935,9 @@ public:
         ImGui::End();
     }
 
+    // A row for each visible trace, of m_multiPlotRowHeight or sharing the window down to
+    // kMinSharedRowHeight, scrolled when they don't fit. Only the rows in view are drawn,
+    // and what the rows share is worked out once a frame.
     void drawMultiPlotWindow(AudioData& data)
     {
         ImGuiViewport* pMainViewport = ImGui::GetMainViewport();
@@ -862,42 +1954,57 @@ public:
                      ImGuiWindowFlags_NoScrollbar |
                      ImGuiWindowFlags_NoScrollWithMouse);
 
-        const int32_t numVisibleTraces = data.getNumVisibleTraces();
+        // The rows' x axes are linked through m_multiPlotXMin/Max, so panning or zooming one moves the rest
         const bool bPlotLimitsChanged = processPlotLimitsChanges();
-        const ImPlotSubplotFlags subplotFlags = ImPlotSubplotFlags_NoResize |
-                                                ImPlotSubplotFlags_ShareItems |
-                                                ImPlotSubplotFlags_LinkCols |
-                                                ImPlotSubplotFlags_LinkAllX;
-        if (ImPlot::BeginSubplots("##Plots", numVisibleTraces, 1, ImGui::GetContentRegionAvail(), subplotFlags)) {
-            for (int32_t trace = 0; trace < data.numTraces(); trace++) {
-                if (!data.isTraceVisible(trace)) {
-                    continue;
-                }
+        if (bPlotLimitsChanged) {
+            m_multiPlotXMin = m_xAxisMin;
+            m_multiPlotXMax = m_xAxisMax;
+        }
 
+        m_multiPlotTraces.clear();
+        for (int32_t trace = 0; trace < data.numTraces(); trace++) {
+            if (data.isTraceVisible(trace)) {
+                m_multiPlotTraces.push_back(trace);
+            }
+        }
+        const int numRows = (int)m_multiPlotTraces.size();
+        const ImVec2 regionSize = ImGui::GetContentRegionAvail();
+        const float fitRowHeight = std::floor(regionSize.y / std::max(numRows, 1));
+        m_multiPlotRowHeightCurrent = (m_multiPlotRowHeight > 0.0f ? m_multiPlotRowHeight : std::max(fitRowHeight, kMinSharedRowHeight));
+
+        const double yticks[] = {m_yAxisMin, 0.0, m_yAxisMax};
+        char ylabelstrs[3][32];
+        snprintf(ylabelstrs[0], sizeof(ylabelstrs[0]), "%.4lf", m_yAxisMin);
+        snprintf(ylabelstrs[1], sizeof(ylabelstrs[1]), "0.0");
+        snprintf(ylabelstrs[2], sizeof(ylabelstrs[2]), "%.4lf", m_yAxisMax);
+        const char* const ylabels[] = {ylabelstrs[0], ylabelstrs[1], ylabelstrs[2]};
+
+        // The mouse wheel zooms the plots, so the rows are scrolled with the scrollbar or the keyboard
+        ImGui::PushStyleVar(ImGuiStyleVar_ItemSpacing, ImVec2(0.0f, 0.0f));
+        ImGui::BeginChild("##Rows", regionSize, false, ImGuiWindowFlags_NoScrollWithMouse);
+        if (g_bPageUpPressed || g_bPageDownPressed) {
+            const float page = std::max(std::floor(regionSize.y / m_multiPlotRowHeightCurrent), 1.0f) * m_multiPlotRowHeightCurrent;
+            ImGui::SetScrollY(ImGui::GetScrollY() + (g_bPageDownPressed ? page : -page));
+            g_bPageUpPressed = false;
+            g_bPageDownPressed = false;
+        }
+
+        bool bFirstRow = true;
+        uint64_t numPointsVisible = 0;
+        ImGuiListClipper clipper;
+        clipper.Begin(numRows, m_multiPlotRowHeightCurrent);
+        while (clipper.Step()) {
+            for (int row = clipper.DisplayStart; row < clipper.DisplayEnd; row++) {
+                const int32_t trace = m_multiPlotTraces[row];
+                ImGui::PushID(trace);
                 const ImPlotFlags plotFlags = ImPlotFlags_NoMenus | ImPlotFlags_NoBoxSelect;
-                if (ImPlot::BeginPlot("", ImVec2(), plotFlags)) {
+                if (ImPlot::BeginPlot("##Trace", ImVec2(-1.0f, m_multiPlotRowHeightCurrent), plotFlags)) {
 
-                    if (trace == 0) {
-                        ImPlot::SetupLegend(ImPlotLocation_North, ImPlotLegendFlags_Horizontal | ImPlotLegendFlags_Outside);
-                    }
-
-                    if (bPlotLimitsChanged) {
-                        ImPlot::SetupAxisLimits(ImAxis_X1, m_xAxisMin, m_xAxisMax, ImGuiCond_Always);
-                        ImPlot::SetupAxisLimits(ImAxis_Y1, m_yAxisMin, m_yAxisMax, ImGuiCond_Always);
-
-                    }
-                    else {
-                        ImPlot::SetupAxisLimits(ImAxis_X1, 0.0, data.getMaxTime(), ImGuiCond_Once);
-                        ImPlot::SetupAxisLimits(ImAxis_Y1, -1.0, 1.0, ImGuiCond_Once);
-                    }
-
-                    const std::array<double, 3> yticks = {m_yAxisMin, 0.0, m_yAxisMax};
-                    static char ylabelstrs[yticks.size()][32];
-                    snprintf(ylabelstrs[0], sizeof(ylabelstrs[0]), "%.4lf", m_yAxisMin);
-                    snprintf(ylabelstrs[1], sizeof(ylabelstrs[1]), "0.0");
-                    snprintf(ylabelstrs[2], sizeof(ylabelstrs[2]), "%.4lf", m_yAxisMax);
-                    const char* const ylabels[] = {ylabelstrs[0], ylabelstrs[1], ylabelstrs[2]};
-                    ImPlot::SetupAxisTicks(ImAxis_Y1, yticks.data(), yticks.size(), ylabels);
+                    ImPlot::SetupLegend(ImPlotLocation_NorthEast);
+                    ImPlot::SetupAxisLinks(ImAxis_X1, &m_multiPlotXMin, &m_multiPlotXMax);
+                    // Rows scrolled into view are created as they appear, so each takes the shared y limits every frame
+                    ImPlot::SetupAxisLimits(ImAxis_Y1, m_yAxisMin, m_yAxisMax, ImGuiCond_Always);
+                    ImPlot::SetupAxisTicks(ImAxis_Y1, yticks, 3, ylabels);
 
                     const ImPlotAxisFlags xAxisFlags = ImPlotAxisFlags_NoHighlight;
                     const ImPlotAxisFlags yAxisFlags = ImPlotAxisFlags_NoHighlight | ImPlotAxisFlags_Lock;
@@ -906,29 +2013,116 @@ public:
                     const ImPlotRect plotLimits = ImPlot::GetPlotLimits();
                     detectPlotLimitsChangesFromMouse(plotLimits);
 
-                    const double timeRange = plotLimits.X.Size();
-
-                    uint64_t numPointsVisible = data.getNumPointsInRange(timeRange, m_levelCurrent);
-
-                    const bool bFirstTrace = (trace == 0);
-                    if (bPlotLimitsChanged && bFirstTrace) {
-                        numPointsVisible = adjustPlotDetailLevel(data, timeRange, numPointsVisible);
-                        adjustDataBounds(data, plotLimits.X.Min, plotLimits.X.Max);
+                    // Every row is as wide, with the same x limits, so the first row in view sets them up for all
+                    if (bFirstRow) {
+                        const double timeRange = plotLimits.X.Size();
+                        const int numColumns = std::max((int)ImPlot::GetPlotSize().x, 1);
+                        numPointsVisible = data.getNumPointsInRange(timeRange, m_levelCurrent);
+                        if (bPlotLimitsChanged || m_bDataChanged || (numColumns != m_numPlotColumns)) {
+                            numPointsVisible = adjustPlotDetailLevel(data, timeRange, numColumns);
+                            adjustDataBounds(data, plotLimits.X.Min, plotLimits.X.Max);
+                        }
+                        updateCursorPosition(data);
+                        bFirstRow = false;
                     }
 
-                    const bool bShowMarkers = numPointsVisible < 250;
+                    const bool bShowMarkers = !m_bPixelColumns && (numPointsVisible < 250);
                     const bool bSpreadEnabled = false;
 
                     drawTraceLines(data, trace, trace + 1, bShowMarkers, bSpreadEnabled);
 
-                    updateCursorPosition(data);
-
                     drawCursorLine(data);
 
                     ImPlot::EndPlot();
                 }
+                ImGui::PopID();
             }
-            ImPlot::EndSubplots();
+        }
+        clipper.End();
+        ImGui::EndChild();
+        ImGui::PopStyleVar();
+        ImGui::End();
+    }
+
+    // Spectrum of the samples around the cursor, computed again only when the cursor, the
+    // settings or the samples change, so dragging the cursor costs one FFT per channel a frame
+    void drawCursorSpectrumWindow(AudioData& data)
+    {
+        ImGuiViewport* pMainViewport = ImGui::GetMainViewport();
+        ImGui::SetNextWindowSize(ImVec2(pMainViewport->Size.x / 3.0f, pMainViewport->Size.y / 3.0f), ImGuiCond_FirstUseEver);
+        ImGui::SetNextWindowPos(ImVec2(pMainViewport->Pos.x + 2.0f * pMainViewport->Size.x / 3.0f,
+                                       pMainViewport->Pos.y + pMainViewport->Size.y / 6.0f), ImGuiCond_FirstUseEver);
+        if (!ImGui::Begin("Cursor Spectrum", &m_bShowCursorSpectrum)) {
+            ImGui::End();
+            return;
+        }
+
+        bool bChanged = false;
+        ImGui::SetNextItemWidth(80.0f);
+        char fftSizeLabel[16];
+        snprintf(fftSizeLabel, sizeof(fftSizeLabel), "%d", m_cursorSpectrumSettings.m_fftSize);
+        if (ImGui::BeginCombo("FFT", fftSizeLabel)) {
+            for (int fftSize = kMinSpectrogramFftSize; fftSize <= kMaxSpectrogramFftSize; fftSize *= 2) {
+                snprintf(fftSizeLabel, sizeof(fftSizeLabel), "%d", fftSize);
+                if (ImGui::Selectable(fftSizeLabel, fftSize == m_cursorSpectrumSettings.m_fftSize)) {
+                    m_cursorSpectrumSettings.m_fftSize = fftSize;
+                    m_cursorSpectrumSettings.m_hop = fftSize;
+                    bChanged = true;
+                }
+            }
+            ImGui::EndCombo();
+        }
+        ImGui::SameLine();
+        ImGui::SetNextItemWidth(130.0f);
+        if (ImGui::BeginCombo("Window", getSpectrogramWindowName(m_cursorSpectrumSettings.m_window))) {
+            for (int window = 0; window < NUM_SPECTROGRAM_WINDOWS; window++) {
+                if (ImGui::Selectable(getSpectrogramWindowName((SpectrogramWindow)window), window == m_cursorSpectrumSettings.m_window)) {
+                    m_cursorSpectrumSettings.m_window = (SpectrogramWindow)window;
+                    bChanged = true;
+                }
+            }
+            ImGui::EndCombo();
+        }
+        ImGui::SameLine();
+        ImGui::SetNextItemWidth(80.0f);
+        if (ImGui::SliderInt("Averages", &m_cursorSpectrumAverages, 1, 64)) {
+            m_cursorSpectrum.setNumAverages(m_cursorSpectrumAverages);
+        }
+        ImGui::SameLine();
+        ImGui::Checkbox("Peak Hold", &m_bCursorSpectrumPeakHold);
+        ImGui::SameLine();
+        if (ImGui::Button("Reset")) {
+            m_cursorSpectrum.reset();
+            bChanged = true;
+        }
+
+        if (bChanged || m_bDataChanged || m_frameCurrent != m_cursorSpectrumFrame) {
+            m_cursorSpectrum.update(data.getSampleViews(), m_frameCurrent, m_cursorSpectrumSettings);
+            m_cursorSpectrumFrame = m_frameCurrent;
+        }
+
+        const ImPlotFlags plotFlags = ImPlotFlags_NoMenus | ImPlotFlags_NoBoxSelect | ImPlotFlags_NoLegend;
+        if (data.getNumChannels() > 0 && ImPlot::BeginPlot("##CursorSpectrum", ImVec2(-1, -1), plotFlags)) {
+            const double maxFrequency = 0.5 / data.getTime(1);
+            ImPlot::SetupAxes("Hz", "dB", ImPlotAxisFlags_NoHighlight, ImPlotAxisFlags_NoHighlight);
+            ImPlot::SetupAxisLimits(ImAxis_X1, 0.0, maxFrequency, ImGuiCond_Once);
+            ImPlot::SetupAxisLimits(ImAxis_Y1, m_minDb - 30.0, m_maxDb + 10.0, ImGuiCond_Once);
+
+            const int numFrequencies = m_cursorSpectrum.n_frq();
+            const double frequencyStep = maxFrequency / (numFrequencies - 1);
+            for (int32_t trace = 0; trace < data.numTraces(); trace++) {
+                if (!data.isTraceVisible(trace)) {
+                    continue;
+                }
+                ImVec4 color = data.getTraceColor(trace);
+                if (m_bCursorSpectrumPeakHold) {
+                    ImPlot::SetNextLineStyle(ImVec4(color.x, color.y, color.z, 0.4f));
+                    ImPlot::PlotLine("##Peaks", m_cursorSpectrum.peaks(trace), numFrequencies, frequencyStep);
+                }
+                ImPlot::SetNextLineStyle(color);
+                ImPlot::PlotLine(data.getTraceName(trace), m_cursorSpectrum.spectrum(trace), numFrequencies, frequencyStep);
+            }
+            ImPlot::EndPlot();
         }
         ImGui::End();
     }
@@ -951,6 +2145,30 @@ public:
 
         ImPlot::PushColormap(ImPlotColormap_Plasma);
 
+        // Tiles queued for the last frame but no longer needed are skipped
+        data.spectrogram().clearTileRequests();
+        bool bFirstPlot = true;
+
+        const SpectrogramSettings& settings = data.spectrogram().requestedSettings();
+        ImGui::Text("FFT %d   Overlap %.1f%%   %s Window   %s Scale",
+                    settings.m_fftSize, 100.0 * (settings.m_fftSize - settings.m_hop) / settings.m_fftSize,
+                    getSpectrogramWindowName(settings.m_window), getSpectrogramScaleName(m_spectrogramScale));
+
+        // Levels only change the range the shader or heatmap maps to the colormap, so the frames are left as they are
+        if (m_bAutoLevels) {
+            updateAutoLevels(data);
+        }
+        ImGui::SameLine(0.0f, 40.0f);
+        ImGui::Checkbox("Auto Levels", &m_bAutoLevels);
+        ImGui::SameLine();
+        ImGui::SetNextItemWidth(400.0f);
+        const float maxHistogramDb = kSpectrogramHistogramMinDb + kSpectrogramHistogramBins * kSpectrogramHistogramStep;
+        if (ImGui::DragFloatRange2("Levels", &m_minDb, &m_maxDb, 0.25f, kSpectrogramHistogramMinDb, maxHistogramDb,
+                                   "Min %.1f dB", "Max %.1f dB", ImGuiSliderFlags_AlwaysClamp)) {
+            m_bAutoLevels = false;
+            m_maxDb = std::max(m_maxDb, m_minDb + 1.0f);
+        }
+
         const int32_t numVisibleTraces = data.getNumVisibleTraces();
         const bool bPlotLimitsChanged = processPlotLimitsChanges();
         const ImPlotSubplotFlags subplotFlags = ImPlotSubplotFlags_NoResize |
@@ -982,16 +2200,16 @@ public:
                         ImPlot::SetupAxisLimits(ImAxis_X1, 0.0, data.getMaxTime(), ImGuiCond_Once);
                         ImPlot::SetupAxisLimits(ImAxis_Y1, 0.0, maxFreqKhz, ImGuiCond_Once);
                     }
+                    setupFrequencyAxis(maxFreqKhz);
+
+                    const ImPlotRect plotLimits = ImPlot::GetPlotLimits();
+                    if (bFirstPlot && plotLimits.X.Min != m_spectrogramXMin) {
+                        m_spectrogramPanDirection = (plotLimits.X.Min > m_spectrogramXMin ? 1 : -1);
+                        m_spectrogramXMin = plotLimits.X.Min;
+                    }
+                    bFirstPlot = false;
 
-                    ImPlot::PlotHeatmap("",
-                                        data.spectrogram().data(trace).data(),
-                                        data.spectrogram().n_frq(),
-                                        data.spectrogram().n_bin(),
-                                        data.spectrogram().min_db(),
-                                        data.spectrogram().max_db(),
-                                        NULL,
-                                        {0.0, data.spectrogram().min_frq()},
-                                        {data.getMaxTime(), maxFreqKhz});
+                    drawSpectrogram(data, trace, plotLimits, ImPlot::GetPlotSize().x);
 
                     updateCursorPosition(data);
 
@@ -1004,13 +2222,179 @@ public:
         }
         ImPlot::PopColormap();
         ImGui::End();
+
+        m_spectrogramTextures.endFrame();
+        m_spectrogramBands.endFrame();
+    }
+
+    // Label the frequency axis of a spectrogram plot in Hz, with ticks at round frequencies
+    // if the scale isn't linear, as the axis is in positions of the scale
+    void setupFrequencyAxis(double maxFrequency)
+    {
+        if (m_spectrogramScale == SPECTROGRAM_SCALE_LINEAR) {
+            return;
+        }
+        static const double kTickFrequencies[] = {20, 50, 100, 200, 500, 1000, 2000, 5000, 10000, 20000, 50000, 100000};
+        double ticks[sizeof(kTickFrequencies) / sizeof(kTickFrequencies[0])];
+        int numTicks = 0;
+        for (double frequency : kTickFrequencies) {
+            const double position = getScalePosition(m_spectrogramScale, frequency, maxFrequency);
+            const bool bSpaced = (numTicks == 0 || position - ticks[numTicks - 1] >= maxFrequency * kMinFrequencyTickSpacing);
+            if (position >= 0.0 && position <= maxFrequency && bSpaced) {
+                ticks[numTicks++] = position;
+            }
+        }
+        m_spectrogramMaxFrequency = maxFrequency;
+        ImPlot::SetupAxisFormat(ImAxis_Y1, formatScaleFrequency, this);
+        ImPlot::SetupAxisTicks(ImAxis_Y1, ticks, numTicks);
+    }
+
+    static int formatScaleFrequency(double value, char* buff, int size, void* pUserData)
+    {
+        const GuiRenderer* pRenderer = (const GuiRenderer*)pUserData;
+        const double frequency = getScaleFrequency(pRenderer->m_spectrogramScale, value, pRenderer->m_spectrogramMaxFrequency);
+        return snprintf(buff, size, "%.0f", frequency);
+    }
+
+    // Spread the values of the visible channels over the colormap, from the percentiles of their histograms
+    void updateAutoLevels(const AudioData& data)
+    {
+        m_histogram.assign(kSpectrogramHistogramBins, 0);
+        for (int32_t trace = 0; trace < data.numTraces(); trace++) {
+            if (data.isTraceVisible(trace)) {
+                const uint64_t* pCounts = data.spectrogram().histogram(trace);
+                for (int i = 0; i < kSpectrogramHistogramBins; i++) {
+                    m_histogram[i] += pCounts[i];
+                }
+            }
+        }
+
+        float minDb = 0.0f;
+        float maxDb = 0.0f;
+        if (getSpectrogramPercentile(m_histogram.data(), kAutoLevelLowPercentile, &minDb) &&
+            getSpectrogramPercentile(m_histogram.data(), kAutoLevelHighPercentile, &maxDb)) {
+            m_minDb = minDb;
+            m_maxDb = std::max(maxDb, minDb + kMinSpectrogramDbRange);
+        }
+    }
+
+    // Draw only the visible frames of the spectrogram level with about one frame per pixel,
+    // or when zoomed in beyond level 0 or in lazy mode, tiles of frames at that hop computed
+    // in the background, so the cost depends on the size of the plot rather than the file.
+    // Level frames are drawn in blocks the size of a tile, so each can be kept in a texture.
+    void drawSpectrogram(AudioData& data, int32_t trace, const ImPlotRect& plotLimits, float plotWidth)
+    {
+        // Only the FFT frames computed so far are shown while loading
+        Spectrogram& spectrogram = data.spectrogram();
+        if ((spectrogram.n_bin() == 0 && !spectrogram.isLazy()) || plotWidth < 1.0f) {
+            return;
+        }
+
+        // Each frame is centred on the samples of its FFT, or FFTs for pooled frames
+        const double samplesPerPixel = plotLimits.X.Size() / data.getTime(1) / plotWidth;
+        const uint64_t levelHop = spectrogram.hop();
+        const uint64_t maxHop = (spectrogram.isLazy() ? std::max(data.getNumValues(), kMinSpectrogramHop)
+                                                      : levelHop << (spectrogram.n_levels() - 1));
+        uint64_t hop = std::min(kMinSpectrogramHop, levelHop);
+        while (hop < samplesPerPixel && hop < maxHop) {
+            hop *= 2;
+        }
+
+        const double firstBin = std::max(std::floor(plotLimits.X.Min / data.getTime(hop)), 0.0);
+        const double lastBin = std::max(std::ceil(plotLimits.X.Max / data.getTime(hop)), firstBin);
+        if (hop >= levelHop && !spectrogram.isLazy()) {
+            int level = 0;
+            while ((levelHop << level) < hop) {
+                level++;
+            }
+            const uint64_t blockBins = spectrogram.tile_bins();
+            const uint64_t binEnd = (uint64_t)std::min(lastBin, (double)spectrogram.n_bin(level));
+            for (uint64_t binStart = ((uint64_t)firstBin / blockBins) * blockBins; binStart < binEnd; binStart += blockBins) {
+                const SpectrogramBlockKey key = {trace, hop, binStart / blockBins, false, m_spectrogramScale};
+                drawSpectrogramFrames(data, key, spectrogram.generation(),
+                                      spectrogram.data(trace, level) + (binStart * spectrogram.frame_bytes()),
+                                      spectrogram.settings().m_format, spectrogram.n_frq(),
+                                      (int)std::min(blockBins, (uint64_t)spectrogram.n_bin(level) - binStart),
+                                      binStart * hop, hop, ((double)spectrogram.n_fft() - (double)levelHop) / 2.0);
+            }
+            return;
+        }
+
+        // Tiles just beyond the view, in the direction it is panning, are computed once the visible ones are done
+        const uint64_t tileBins = spectrogram.tile_bins();
+        const uint64_t numTilesAvailable = ((data.getExpectedNumValues() / hop) / tileBins) + 1;
+        const uint64_t firstTile = (uint64_t)firstBin / tileBins;
+        const uint64_t lastTile = std::min((uint64_t)lastBin / tileBins, numTilesAvailable - 1);
+        for (uint64_t index = firstTile; index <= lastTile; index++) {
+            std::shared_ptr<const SpectrogramTile> pTile = spectrogram.tile(trace, hop, index);
+            if (!pTile) {
+                continue;
+            }
+            const SpectrogramBlockKey key = {trace, hop, index, true, m_spectrogramScale};
+            drawSpectrogramFrames(data, key, pTile->m_generation, pTile->m_frames.data(), pTile->m_format, (pTile->m_fftSize / 2) + 1,
+                                  pTile->m_numBins, pTile->m_binStart * hop, hop, ((double)pTile->m_fftSize - (double)hop) / 2.0);
+        }
+        const uint64_t numTiles = lastTile - firstTile + 1;
+        if (m_spectrogramPanDirection > 0) {
+            for (uint64_t index = lastTile + 1; index <= lastTile + numTiles && index < numTilesAvailable; index++) {
+                spectrogram.prefetchTile(trace, hop, index);
+            }
+        }
+        else if (m_spectrogramPanDirection < 0) {
+            for (uint64_t index = firstTile; index > 0 && index + numTiles > firstTile; index--) {
+                spectrogram.prefetchTile(trace, hop, index - 1);
+            }
+        }
+    }
+
+    // Draw a block of frames, in the bands of the scale of the key, from a texture if possible, or as a heatmap
+    void drawSpectrogramFrames(AudioData& data, const SpectrogramBlockKey& key, uint64_t generation, const uint8_t* pFrames,
+                               SpectrogramFormat format, int numFrequencies, int numBins, uint64_t start, uint64_t hop,
+                               double offset)
+    {
+        const Spectrogram& spectrogram = data.spectrogram();
+        if (numBins <= 0) {
+            return;
+        }
+        if (key.m_scale != SPECTROGRAM_SCALE_LINEAR) {
+            pFrames = m_spectrogramBands.getBands(key, generation, pFrames, format, numFrequencies, numBins, spectrogram.max_frq(),
+                                                  &numFrequencies);
+        }
+        const ImPlotPoint boundsMin(data.getTime(start) + data.getTime(1) * offset, spectrogram.min_frq());
+        const ImPlotPoint boundsMax(data.getTime(start + numBins * hop) + data.getTime(1) * offset, spectrogram.max_frq());
+        if (m_spectrogramTextures.draw(key, generation, pFrames, format, numFrequencies, numBins, spectrogram.tile_bins(),
+                                       boundsMin, boundsMax, m_minDb, m_maxDb)) {
+            return;
+        }
+
+        // ImPlot 0.14 misplaces the values of column major heatmaps, so the frames are drawn transposed
+        m_spectrogramFrame.resize(numFrequencies);
+        m_spectrogramRows.resize((size_t)numFrequencies * numBins);
+        const size_t frameBytes = (size_t)numFrequencies * getSpectrogramFormatSize(format);
+        for (int b = 0; b < numBins; b++) {
+            dequantizeSpectrogramValues(pFrames + (size_t)b * frameBytes, numFrequencies, format, m_spectrogramFrame.data());
+            for (int f = 0; f < numFrequencies; f++) {
+                m_spectrogramRows[(size_t)f * numBins + b] = m_spectrogramFrame[f];
+            }
+        }
+        ImPlot::PlotHeatmap("",
+                            m_spectrogramRows.data(),
+                            numFrequencies,
+                            numBins,
+                            m_minDb,
+                            m_maxDb,
+                            NULL,
+                            boundsMin,
+                            boundsMax);
     }
 
-    struct SpreadLinePlot
+    struct TraceLinePlot
     {
-        SpreadLinePlot(const char* traceName, const Point* pointArray, uint64_t numPoints, double yScale, double yOffset)
-        : m_traceName(traceName)
-        , m_pointArray(pointArray)
+        TraceLinePlot(const AudioData& data, int32_t trace, int32_t level, uint64_t startIdx, uint64_t numPoints, double yScale, double yOffset)
+        : m_data(data)
+        , m_trace(trace)
+        , m_level(level)
+        , m_startIdx(startIdx)
         , m_numPoints(numPoints)
         , m_yScale(yScale)
         , m_yOffset(yOffset)
@@ -1019,21 +2403,22 @@ public:
 
         void PlotLine() const
         {
-            ImPlot::PlotLineG(m_traceName, &SpreadLinePlot::getPoint, (void*)this, m_numPoints);
+            ImPlot::PlotLineG(m_data.getTraceName(m_trace), &TraceLinePlot::getPoint, (void*)this, m_numPoints);
         }
 
         static ImPlotPoint getPoint(int idx, void* data)
         {
-            const SpreadLinePlot* _this = (SpreadLinePlot*)data;
-            const Point* pointArray = _this->m_pointArray;
-            Point p = pointArray[idx];
+            const TraceLinePlot* _this = (TraceLinePlot*)data;
+            Point p = _this->m_data.getPoint(_this->m_trace, _this->m_level, _this->m_startIdx + idx);
             p.y *= _this->m_yScale;
             p.y += _this->m_yOffset;
             return p;
         }
 
-        const char* m_traceName;
-        const Point* m_pointArray;
+        const AudioData& m_data;
+        const int32_t m_trace;
+        const int32_t m_level;
+        const uint64_t m_startIdx;
         const uint64_t m_numPoints;
         const double m_yScale;
         const double m_yOffset;
@@ -1049,24 +2434,27 @@ public:
             if (data.isTraceVisible(trace)) {
                 ImPlot::PushStyleColor(ImPlotCol_Line, data.getTraceColor(trace));
 
-                const Point* pointArray = data.getPointArray(trace, m_levelCurrent);
                 const int numPoints = m_plotEndIdx - m_plotStartIdx;
-                if (bSpread) {
-                    const int32_t numTraces = traceEnd - traceStart;
-                    const double yScale = (1.0 / (double)numTraces) * yMaxForZoomLevel(m_yAxisZoomLevel);
-                    const double yOffset = (1.0 - ((trace + 0.5) * (2.0 / (double)numTraces)));
-                    SpreadLinePlot slp(data.getTraceName(trace),
-                                       &pointArray[m_plotStartIdx],
-                                       numPoints, yScale, yOffset);
-                    slp.PlotLine();
+                const int32_t numTraces = traceEnd - traceStart;
+                const double yScale = (bSpread ? (1.0 / (double)numTraces) * yMaxForZoomLevel(m_yAxisZoomLevel) : 1.0);
+                const double yOffset = (bSpread ? (1.0 - ((trace + 0.5) * (2.0 / (double)numTraces))) : 0.0);
+                if (m_bDrawBuffers && !bShowMarkers && drawTraceBuffers(data, trace, yScale, yOffset)) {
+                    // Drawn from the points kept by the GPU
                 }
                 else {
-                    const int offset = 0;
-                    const size_t stride = sizeof(Point);
-                    const ImPlotLineFlags flags = 0;
-                    ImPlot::PlotLine(data.getTraceName(trace),
-                                     &pointArray[m_plotStartIdx].x, &pointArray[m_plotStartIdx].y,
-                                     numPoints, flags, offset, stride);
+                    // Drawn by ImPlot only until it stays the same, and then from the vertices it drew
+                    PlotItemKey key;
+                    key.m_level = m_levelCurrent;
+                    key.m_startIdx = m_plotStartIdx;
+                    key.m_endIdx = m_plotEndIdx;
+                    key.m_yScale = yScale;
+                    key.m_yOffset = yOffset;
+                    key.m_dataVersion = m_dataVersion;
+                    if (!m_plotItemBuffers.draw(trace, data.getTraceName(trace), key)) {
+                        m_plotItemBuffers.beginCapture(data.getTraceName(trace));
+                        drawTraceLine(data, trace, numPoints, yScale, yOffset, bSpread);
+                        m_plotItemBuffers.endCapture(trace, key);
+                    }
                 }
 
                 ImPlot::PopStyleColor(1);
@@ -1078,58 +2466,173 @@ public:
         }
     }
 
-    uint64_t adjustPlotDetailLevel(AudioData& data, double timeRange, uint64_t numPointsVisible)
+    void drawTraceLine(AudioData& data, int32_t trace, int numPoints, double yScale, double yOffset, bool bSpread)
     {
-        // Try to decrease detail level (make fewer points visible)
-        while (m_levelCurrent + 1 < data.getNumLevels()) {
-            uint32_t numPointsVisibleNextLevel = data.getNumPointsInRange(timeRange, m_levelCurrent + 1);
-            if (numPointsVisibleNextLevel > (kMinDetailLevelPoints / 2)) {
-                m_levelCurrent = (m_levelCurrent + 1);
-                numPointsVisible = numPointsVisibleNextLevel;
-            }
-            else {
-                break;
-            }
+        if (m_bPixelColumns) {
+            drawPixelColumns(data, trace, yScale, yOffset);
+        }
+        else if (data.hasPointOffsets(m_levelCurrent)) {
+            TraceLinePlot tlp(data, trace, m_levelCurrent, m_plotStartIdx, numPoints, yScale, yOffset);
+            tlp.PlotLine();
+        }
+        else if (bSpread) {
+            drawSpreadLine(data, trace, numPoints, yScale, yOffset);
+        }
+        else if (m_levelCurrent == 0) {
+            drawSampleLine(data, trace, numPoints);
+        }
+        else {
+            // Values are evenly spaced half a window apart
+            const float* valueArray = data.getValueArray(trace, m_levelCurrent);
+            const double xScale = data.getTime(data.getPointSpacing(m_levelCurrent));
+            const double xStart = data.getTime(data.getPointIndex(m_levelCurrent, m_plotStartIdx));
+            const ImPlotLineFlags flags = 0;
+            ImPlot::PlotLine(data.getTraceName(trace), &valueArray[m_plotStartIdx], numPoints, xScale, xStart, flags);
         }
+    }
 
-        // Try to increase detail level (make more points visible)
-        while (m_levelCurrent > 0) {
-            uint32_t numPointsVisiblePrevLevel = data.getNumPointsInRange(timeRange, m_levelCurrent - 1);
-            if (numPointsVisiblePrevLevel < (kMinDetailLevelPoints / 2)) {
-                m_levelCurrent = (m_levelCurrent - 1);
-                numPointsVisible = numPointsVisiblePrevLevel;
-            }
-            else {
-                break;
+    // The visible points of the current level, uploaded to the GPU as they come into view and
+    // then drawn by it, so the CPU's work a frame doesn't depend on how many points are visible
+    bool drawTraceBuffers(AudioData& data, int32_t trace, double yScale, double yOffset)
+    {
+        const uint64_t numPoints = data.getNumPoints(m_levelCurrent);
+        const SampleView points = (m_levelCurrent == 0 ? data.getSampleView(trace) :
+                                   SampleView(data.getValueArray(trace, m_levelCurrent), numPoints, sizeof(float), SAMPLE_FORMAT_F32));
+        const double pointTime = data.getTime(data.getPointSpacing(m_levelCurrent));
+        return m_waveformBuffers.draw(data.getTraceName(trace), trace, m_levelCurrent, points, numPoints,
+                                      m_plotStartIdx, m_plotEndIdx, pointTime, yScale, yOffset);
+    }
+
+    // A min and max for each pixel column of the plot, so the points drawn are bounded by its
+    // width however much of the file is visible. They are reduced from the current level again
+    // only when the plot's limits or width, the trace's scale or the data change.
+    void drawPixelColumns(AudioData& data, int32_t trace, double yScale, double yOffset)
+    {
+        if (m_pixelColumns.size() != (size_t)data.numTraces()) {
+            m_pixelColumns.assign(data.numTraces(), PixelColumns());
+        }
+
+        const ImPlotRect plotLimits = ImPlot::GetPlotLimits();
+        PixelColumns& columns = m_pixelColumns[trace];
+        if ((columns.m_xMin != plotLimits.X.Min) || (columns.m_xMax != plotLimits.X.Max) ||
+            (columns.m_numPlotColumns != m_numPlotColumns) || (columns.m_level != m_levelCurrent) ||
+            (columns.m_yScale != yScale) || (columns.m_yOffset != yOffset) ||
+            (columns.m_dataVersion != m_dataVersion)) {
+            columns.m_xMin = plotLimits.X.Min;
+            columns.m_xMax = plotLimits.X.Max;
+            columns.m_numPlotColumns = m_numPlotColumns;
+            columns.m_level = m_levelCurrent;
+            columns.m_yScale = yScale;
+            columns.m_yOffset = yOffset;
+            columns.m_dataVersion = m_dataVersion;
+
+            // Only the columns with samples under them are drawn
+            const double columnWidth = plotLimits.X.Size() / m_numPlotColumns;
+            const double dataEnd = data.getTime(data.getNumValues());
+            const int firstColumn = (int)std::min(std::max(std::floor(-plotLimits.X.Min / columnWidth), 0.0), (double)m_numPlotColumns);
+            const int endColumn = (int)std::min(std::max(std::ceil((dataEnd - plotLimits.X.Min) / columnWidth), (double)firstColumn), (double)m_numPlotColumns);
+            const double pointTime = data.getTime(data.getPointSpacing(m_levelCurrent));
+            const double xStart = plotLimits.X.Min + (firstColumn * columnWidth);
+            columns.m_values.resize(2 * (endColumn - firstColumn));
+            data.reduceToColumns(trace, m_levelCurrent, xStart / pointTime, columnWidth / pointTime,
+                                 endColumn - firstColumn, columns.m_values.data());
+            if ((yScale != 1.0) || (yOffset != 0.0)) {
+                for (float& value : columns.m_values) {
+                    value = (float)((value * yScale) + yOffset);
+                }
             }
+
+            // Each column's two values are drawn a quarter of the way in from its edges
+            columns.m_xStep = columnWidth / 2.0;
+            columns.m_xStart = xStart + (columnWidth / 4.0);
+        }
+
+        const ImPlotLineFlags flags = 0;
+        ImPlot::PlotLine(data.getTraceName(trace), columns.m_values.data(), (int)columns.m_values.size(),
+                         columns.m_xStep, columns.m_xStart, flags);
+    }
+
+    // The visible points of a spread trace, scaled and offset into a buffer so they're plotted
+    // as evenly spaced values like any other, not point by point through a getter
+    void drawSpreadLine(AudioData& data, int32_t trace, int numPoints, double yScale, double yOffset)
+    {
+        m_spreadValues.resize(numPoints);
+        if (m_levelCurrent == 0) {
+            data.getSampleView(trace).read(m_plotStartIdx, numPoints, m_spreadValues.data());
         }
+        else {
+            const float* valueArray = data.getValueArray(trace, m_levelCurrent);
+            std::copy(&valueArray[m_plotStartIdx], &valueArray[m_plotStartIdx] + numPoints, m_spreadValues.begin());
+        }
+        for (float& value : m_spreadValues) {
+            value = (float)((value * yScale) + yOffset);
+        }
+
+        const double xScale = data.getTime(data.getPointSpacing(m_levelCurrent));
+        const double xStart = data.getTime(data.getPointIndex(m_levelCurrent, m_plotStartIdx));
+        const ImPlotLineFlags flags = 0;
+        ImPlot::PlotLine(data.getTraceName(trace), m_spreadValues.data(), numPoints, xScale, xStart, flags);
+    }
+
+    void drawSampleLine(AudioData& data, int32_t trace, int numPoints)
+    {
+        // Float samples are plotted in place with evenly spaced times, other formats are converted as they are read
+        const SampleView& samples = data.getSampleView(trace);
+        const double xScale = data.getSamplePeriod();
+        const double xStart = data.getTime(m_plotStartIdx);
+        const ImPlotLineFlags flags = 0;
+        const int offset = 0;
+        if (samples.format() == SAMPLE_FORMAT_F32) {
+            const float* pValues = (const float*)(samples.data() + (m_plotStartIdx * samples.stride()));
+            ImPlot::PlotLine(data.getTraceName(trace), pValues, numPoints, xScale, xStart, flags, offset, samples.stride());
+        }
+        else if (samples.format() == SAMPLE_FORMAT_F64) {
+            const double* pValues = (const double*)(samples.data() + (m_plotStartIdx * samples.stride()));
+            ImPlot::PlotLine(data.getTraceName(trace), pValues, numPoints, xScale, xStart, flags, offset, samples.stride());
+        }
+        else {
+            TraceLinePlot tlp(data, trace, 0, m_plotStartIdx, numPoints, 1.0, 0.0);
+            tlp.PlotLine();
+        }
+    }
 
+    // Pick the coarsest level with at least a min and max for each pixel column of the plot,
+    // to reduce to one of each, or draw the samples as they are if there are few enough
+    uint64_t adjustPlotDetailLevel(AudioData& data, double timeRange, int numColumns)
+    {
+        const uint64_t numColumnPoints = 2 * (uint64_t)numColumns;
+        m_levelCurrent = 0;
+        while ((m_levelCurrent + 1 < data.getNumLevels()) &&
+               (data.getNumPointsInRange(timeRange, m_levelCurrent + 1) >= numColumnPoints)) {
+            m_levelCurrent = (m_levelCurrent + 1);
+        }
+
+        // Each level has half the points of the one below it, so the GPU draws the points of any
+        // but the coarsest level as they are. It may have many more when zoomed out, and is reduced.
+        const uint64_t numPointsVisible = data.getNumPointsInRange(timeRange, m_levelCurrent);
+        m_numPlotColumns = numColumns;
+        m_bPixelColumns = (numPointsVisible > numColumnPoints);
+        m_bDrawBuffers = (numPointsVisible <= 2 * numColumnPoints) && !data.hasPointOffsets(m_levelCurrent);
         return numPointsVisible;
     }
 
     void adjustDataBounds(AudioData& data, double xMin, double xMax)
     {
         // Cull points to avoid segfault when there are > 2^32 points
-        const Point* pointArray = data.getPointArray(0, m_levelCurrent);
         const uint64_t numPoints = data.getNumPoints(m_levelCurrent);
-        const Point* pArrayStart = &pointArray[0];
-        const Point* pArrayEnd = &pointArray[numPoints];
 
-        const Point* pPlotStart = std::lower_bound(pArrayStart, pArrayEnd, xMin,
-                                                   [](const Point& p, double limit) { return p.x < limit; });
+        // Points are evenly spaced in time (to within their window), so the visible range is found directly
+        const double spacing = data.getTime(data.getPointSpacing(m_levelCurrent));
+        const double firstIdx = std::min(std::max(std::ceil(xMin / spacing), 0.0), (double)numPoints);
+        const double lastIdx = std::min(std::max(std::floor(xMax / spacing) + 1.0, firstIdx), (double)numPoints);
+        m_plotStartIdx = (uint64_t)firstIdx;
+        m_plotEndIdx = (uint64_t)lastIdx;
 
-        m_plotStartIdx = (uint64_t)(pPlotStart - pArrayStart);
-        if (m_plotStartIdx > 0) {
-            m_plotStartIdx--;
-        }
-
-        const Point* pPlotEnd = std::upper_bound(pPlotStart, pArrayEnd, xMax,
-                                                 [](double limit, const Point& p) { return limit < p.x; });
+        const uint64_t margin = (data.hasPointOffsets(m_levelCurrent) ? 2 : 1);
+        m_plotStartIdx = (m_plotStartIdx > margin ? m_plotStartIdx - margin : 0);
+        m_plotEndIdx = std::min(m_plotEndIdx + margin, numPoints);
 
-        m_plotEndIdx = (uint64_t)(pPlotEnd - pArrayStart);
-        if (m_plotEndIdx < numPoints) {
-            m_plotEndIdx++;
-        }
+        data.pageInPoints(m_levelCurrent, m_plotStartIdx, m_plotEndIdx);
     }
 
     void updateCursorPosition(AudioData& data)
@@ -1218,6 +2721,11 @@ public:
         ImGui::Text("%20s : %" PRIu64, "m_plotStartIdx", m_plotStartIdx);
         ImGui::Text("%20s : %" PRIu64, "m_plotEndIdx", m_plotEndIdx);
         ImGui::Text("%20s : %" PRIu32, "m_levelCurrent", m_levelCurrent);
+        ImGui::Text("%20s : %d", "m_bPixelColumns", m_bPixelColumns);
+        ImGui::Text("%20s : %d", "m_bDrawBuffers", m_bDrawBuffers);
+        ImGui::Text("%20s : %" PRIu64, "items from buffers", m_plotItemBuffers.getNumDrawn());
+        ImGui::Text("%20s : %" PRIu64, "item buffer bytes", m_plotItemBuffers.getBytes());
+        ImGui::Text("%20s : %d", "m_numPlotColumns", m_numPlotColumns);
         ImGui::Text("%20s : %" PRIu64, "m_frameCurrent", m_frameCurrent);
         ImGui::Text("%20s : %" PRIu64, "m_frameCount", m_frameCount);
         ImGui::Text("%20s : %" PRIi32, "data.getNumChannels()", data.getNumChannels());
@@ -1262,10 +2770,28 @@ private:
         NUM_PLOT_MODES,
     };
 
+    // Visible points of a trace reduced to pixel columns, and what they were reduced for
+    struct PixelColumns
+    {
+        double m_xMin = 0;
+        double m_xMax = 0;
+        int m_numPlotColumns = 0;
+        uint32_t m_level = 0;
+        double m_yScale = 1;
+        double m_yOffset = 0;
+        uint64_t m_dataVersion = UINT64_MAX;
+        double m_xStart = 0;     // of the first value
+        double m_xStep = 0;      // between values
+        std::vector<float> m_values;  // min and max of each column, in the order they occur
+    };
+
     PlotMode m_plotMode = PLOT_MODE_COMBINED;
     bool m_bPlotModeChanged = false;
     bool m_bExclusiveTraceMode = false;
     bool m_bYFitRequested = false;
+    bool m_bDataChanged = false;
+    uint64_t m_dataVersion = 0;
+    double m_maxTime = 0;
     uint64_t m_previousTracesVisibleBitmap = 0;
     double m_xAxisMin = 0;
     double m_xAxisMax = 0;
@@ -1279,8 +2805,38 @@ private:
     uint64_t m_plotStartIdx = 0;
     uint64_t m_plotEndIdx = 0;
     uint32_t m_levelCurrent = 0;
+    int m_numPlotColumns = 0;        // pixel columns of the plot the level was picked for
+    bool m_bPixelColumns = false;    // reduce the level's points to a min and max per column
+    bool m_bDrawBuffers = false;     // or have the GPU draw them
+    std::vector<PixelColumns> m_pixelColumns;  // of each trace
+    std::vector<float> m_spreadValues;         // of a trace, scaled and offset
+    float m_multiPlotRowHeight = 0.0f;         // pixels, or 0 to share the window
+    float m_multiPlotRowHeightCurrent = 0.0f;
+    double m_multiPlotXMin = 0;                // linked by the rows' x axes
+    double m_multiPlotXMax = 0;
+    std::vector<int32_t> m_multiPlotTraces;    // of the rows
     uint64_t m_frameCurrent = 0;
     uint64_t m_frameCount = 0;
+    double m_spectrogramXMin = 0;
+    int32_t m_spectrogramPanDirection = 0;   // of the spectrogram's view, for prefetching tiles
+    SpectrogramTextures m_spectrogramTextures;
+    WaveformBuffers m_waveformBuffers;
+    PlotItemBuffers m_plotItemBuffers;
+    std::vector<float> m_spectrogramRows;    // frames transposed for heatmaps
+    std::vector<float> m_spectrogramFrame;   // dB values of a frame, for heatmaps
+    SpectrogramBands m_spectrogramBands;
+    bool m_bShowCursorSpectrum = false;
+    Spectrum m_cursorSpectrum;
+    SpectrogramSettings m_cursorSpectrumSettings;
+    int m_cursorSpectrumAverages = 1;
+    bool m_bCursorSpectrumPeakHold = false;
+    uint64_t m_cursorSpectrumFrame = UINT64_MAX;  // the spectrum was computed at
+    SpectrogramScale m_spectrogramScale = SPECTROGRAM_SCALE_LINEAR;
+    double m_spectrogramMaxFrequency = 0;    // of the plots' frequency axes, for their labels
+    bool m_bAutoLevels = true;
+    float m_minDb = kDefaultSpectrogramMinDb;  // of the spectrogram, shown at the bottom of the colormap
+    float m_maxDb = kDefaultSpectrogramMaxDb;  // at the top
+    std::vector<uint64_t> m_histogram;        // of the visible channels, for auto levels
     ImPlotColormap m_colorMapIdx = kDefaultColorMap;
 };
 
@@ -1349,6 +2905,36 @@ void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods
             case GLFW_KEY_C:
                 g_bColorMapPressed = true;
                 break;
+            case GLFW_KEY_Z:
+                g_bSpectrogramFftSizePressed = true;
+                break;
+            case GLFW_KEY_X:
+                g_bSpectrogramOverlapPressed = true;
+                break;
+            case GLFW_KEY_V:
+                g_bSpectrogramWindowPressed = true;
+                break;
+            case GLFW_KEY_B:
+                g_bSpectrogramScalePressed = true;
+                break;
+            case GLFW_KEY_L:
+                g_bAutoLevelsPressed = true;
+                break;
+            case GLFW_KEY_P:
+                g_bCursorSpectrumPressed = true;
+                break;
+            case GLFW_KEY_LEFT_BRACKET:
+                g_bRowHeightDecrPressed = true;
+                break;
+            case GLFW_KEY_RIGHT_BRACKET:
+                g_bRowHeightIncrPressed = true;
+                break;
+            case GLFW_KEY_PAGE_UP:
+                g_bPageUpPressed = true;
+                break;
+            case GLFW_KEY_PAGE_DOWN:
+                g_bPageDownPressed = true;
+                break;
             case GLFW_KEY_1:
             case GLFW_KEY_2:
             case GLFW_KEY_3:
@@ -1393,14 +2979,52 @@ void errorCallback(int error, const char* description)
 int main(int argc, const char** argv)
 {
     std::string filename;
-    if (argc > 2) {
-        return -1;
-    }
-    else if (argc == 2) {
-        // Load the filename provided
-        filename = argv[1];
+    uint32_t numThreads = 0;  // one per hardware thread
+    bool bUseCache = true;
+    uint64_t memoryBudget = kDefaultMemoryBudget;
+    bool bLazySpectrogram = false;
+    SpectrogramFormat spectrogramFormat = SPECTROGRAM_FORMAT_F32;
+    float rowHeight = 0.0f;  // of the multiple plot mode, sharing the window
+    bool bValidArguments = true;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            numThreads = (uint32_t)std::max(atoi(argv[++i]), 0);
+        }
+        else if (strcmp(argv[i], "--no-cache") == 0) {
+            bUseCache = false;
+        }
+        else if (strcmp(argv[i], "--memory-budget") == 0 && i + 1 < argc) {
+            memoryBudget = (uint64_t)std::max(atoll(argv[++i]), 1LL) << 20;
+        }
+        else if (strcmp(argv[i], "--lazy-spectrogram") == 0) {
+            bLazySpectrogram = true;
+        }
+        else if (strcmp(argv[i], "--spectrogram-format") == 0 && i + 1 < argc) {
+            const char* name = argv[++i];
+            int format = 0;
+            while (format < NUM_SPECTROGRAM_FORMATS && strcmp(name, getSpectrogramFormatName((SpectrogramFormat)format)) != 0) {
+                format++;
+            }
+            spectrogramFormat = (SpectrogramFormat)format;
+            bValidArguments = (format < NUM_SPECTROGRAM_FORMATS);
+        }
+        else if (strcmp(argv[i], "--row-height") == 0 && i + 1 < argc) {
+            rowHeight = (float)std::max(atof(argv[++i]), 0.0);
+        }
+        else if (filename == "") {
+            // Load the filename provided
+            filename = argv[i];
+        }
+        else {
+            bValidArguments = false;
+        }
+        if (!bValidArguments) {
+            std::cerr << "Usage: audioplot [--threads N] [--no-cache] [--memory-budget MB] [--lazy-spectrogram]"
+                         " [--spectrogram-format f32|u16|u8] [--row-height PIXELS] [filename]\n";
+            return -1;
+        }
     }
-    else {
+    if (filename == "") {
         filename = promptForFilename();
     }
 
@@ -1409,20 +3033,26 @@ int main(int argc, const char** argv)
         return -1;
     }
 
-    // Load the data to plotted
-    AudioData audioData(filename.c_str());
+    // glfw: initialize and configure
+    // ------------------------------
+    // (before loading starts, as the loading thread wakes the render loop as data arrives)
+    glfwSetErrorCallback(errorCallback);
+    if (!glfwInit()) {
+        return -1;
+    }
+
+    // Start loading the data to plotted, which continues in the background
+    ThreadPool threadPool(numThreads);
+    AudioData audioData(filename.c_str(), threadPool, bUseCache, memoryBudget, bLazySpectrogram, spectrogramFormat);
 
-    if (audioData.getNumValues() == 0) {
+    if (audioData.getNumChannels() == 0) {
         std::cerr << "Unable to load file: " << filename << "\n";
+        glfwTerminate();
         return -1;
     }
 
     // std::cout << "Initializing GUI...\n");
 
-    // glfw: initialize and configure
-    // ------------------------------
-    glfwSetErrorCallback(errorCallback);
-    glfwInit();
 #if defined(__APPLE__)
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 2);
@@ -1442,6 +3072,7 @@ int main(int argc, const char** argv)
     if (window == NULL)
     {
         std::cerr << "Failed to create GLFW window" << std::endl;
+        audioData.cancelLoading();
         glfwTerminate();
         return -1;
     }
@@ -1450,7 +3081,9 @@ int main(int argc, const char** argv)
     glfwSetMouseButtonCallback(window, mouseButtonCallback);
     glfwSetKeyCallback(window, keyCallback);
 
-    GuiRenderer guiRenderer(audioData, window);
+    std::unique_lock<std::mutex> lock(audioData.getMutex());
+    GuiRenderer guiRenderer(audioData, window, rowHeight);
+    lock.unlock();
 
     // std::cout << "Finished Initializing.\n");
 
@@ -1461,7 +3094,9 @@ int main(int argc, const char** argv)
         glClearColor(1.0, 1.0, 1.0, 1.0);
         glClear(GL_COLOR_BUFFER_BIT);
 
+        lock.lock();
         guiRenderer.drawGui(audioData);
+        lock.unlock();
 
         glfwSwapBuffers(window);
         glfwWaitEvents();
@@ -1469,6 +3104,7 @@ int main(int argc, const char** argv)
 
     // clean up
     // --------
+    audioData.cancelLoading();
     guiRenderer.shutdown();
 
     // glfw: terminate, clearing all previously allocated GLFW resources.
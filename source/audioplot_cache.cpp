@@ -0,0 +1,373 @@
+#include "audioplot_cache.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#if defined(_WIN32)
+#include <direct.h>
+#include <process.h>
+#include <sys/utime.h>
+#else
+#include <unistd.h>
+#include <utime.h>
+#endif
+
+static const char kCacheMagic[8] = {'A', 'P', 'L', 'T', 'C', 'A', 'C', 'H'};
+static const uint32_t kCacheFormatVersion = 1;
+static const uint64_t kCacheAlignment = 64;      // of each section, for vectorized loads
+static const uint64_t kHashBlockSize = 16384;
+static const uint64_t kHashBlocks = 32;          // blocks hashed, spread evenly through the file
+
+struct CacheFileHeader
+{
+    char m_magic[8];
+    uint32_t m_version;
+    uint32_t m_numSections;
+    uint64_t m_tableOffset;                      // of the array of CacheSection
+    CacheKey m_key;
+};
+
+#if defined(_WIN32)
+static const char kPathSeparator = '\\';
+#else
+static const char kPathSeparator = '/';
+#endif
+
+static uint64_t hashBytes(uint64_t hash, const void* pData, uint64_t size)
+{
+    // FNV-1a
+    const uint8_t* pBytes = (const uint8_t*)pData;
+    for (uint64_t i = 0; i < size; i++) {
+        hash ^= pBytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+static bool getFileInfo(const std::string& path, uint64_t* pSize, int64_t* pTime)
+{
+#if defined(_WIN32)
+    struct _stati64 st;
+    if (_stati64(path.c_str(), &st) != 0 || (st.st_mode & S_IFMT) != S_IFREG) {
+        return false;
+    }
+#else
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0 || (st.st_mode & S_IFMT) != S_IFREG) {
+        return false;
+    }
+#endif
+    *pSize = (uint64_t)st.st_size;
+    *pTime = (int64_t)st.st_mtime;
+    return true;
+}
+
+static std::string getCacheDirectoryPath()
+{
+#if defined(_WIN32)
+    const char* pLocalAppData = getenv("LOCALAPPDATA");
+    if (pLocalAppData != NULL && *pLocalAppData != '\0') {
+        return std::string(pLocalAppData) + "\\audioplot\\cache";
+    }
+#else
+    const char* pCacheHome = getenv("XDG_CACHE_HOME");
+    if (pCacheHome != NULL && *pCacheHome != '\0') {
+        return std::string(pCacheHome) + "/audioplot";
+    }
+    const char* pHome = getenv("HOME");
+    if (pHome != NULL && *pHome != '\0') {
+        return std::string(pHome) + "/.cache/audioplot";
+    }
+#endif
+    return "";
+}
+
+// Create a directory along with any missing parent directories
+static bool makeDirectories(const std::string& path)
+{
+    for (size_t pos = path.find(kPathSeparator, 1); ; pos = path.find(kPathSeparator, pos + 1)) {
+        const std::string directory = path.substr(0, pos);
+#if defined(_WIN32)
+        _mkdir(directory.c_str());
+#else
+        mkdir(directory.c_str(), 0755);
+#endif
+        if (pos == std::string::npos) {
+            break;
+        }
+    }
+
+    struct stat st;
+    return (stat(path.c_str(), &st) == 0) && ((st.st_mode & S_IFMT) == S_IFDIR);
+}
+
+std::string getCacheDirectory()
+{
+    const std::string directory = getCacheDirectoryPath();
+    if (directory.empty() || !makeDirectories(directory)) {
+        return "";
+    }
+    return directory;
+}
+
+static std::string getCachePath(const std::string& directory, const CacheKey& key)
+{
+    uint64_t name = hashBytes(14695981039346656037ull, &key.m_fileSize, sizeof(key.m_fileSize));
+    name = hashBytes(name, &key.m_fileTime, sizeof(key.m_fileTime));
+    name = hashBytes(name, &key.m_contentHash, sizeof(key.m_contentHash));
+
+    char filename[32];
+    snprintf(filename, sizeof(filename), "%016llx.apc", (unsigned long long)name);
+    return directory + kPathSeparator + filename;
+}
+
+static bool isSameKey(const CacheKey& a, const CacheKey& b)
+{
+    return (a.m_fileSize == b.m_fileSize) && (a.m_fileTime == b.m_fileTime) && (a.m_contentHash == b.m_contentHash);
+}
+
+// Remove the least recently used files in the cache directory until the rest fit in maxCacheSize
+static void evictCacheFiles(const std::string& directory, uint64_t maxCacheSize)
+{
+    struct CacheFile
+    {
+        std::string m_path;
+        uint64_t m_size;
+        int64_t m_time;
+    };
+
+    DIR* pDir = opendir(directory.c_str());
+    if (pDir == NULL) {
+        return;
+    }
+    std::vector<CacheFile> files;
+    uint64_t totalSize = 0;
+    while (struct dirent* pEntry = readdir(pDir)) {
+        CacheFile file;
+        file.m_path = directory + kPathSeparator + pEntry->d_name;
+        if (getFileInfo(file.m_path, &file.m_size, &file.m_time)) {
+            files.push_back(file);
+            totalSize += file.m_size;
+        }
+    }
+    closedir(pDir);
+
+    std::sort(files.begin(), files.end(), [](const CacheFile& a, const CacheFile& b) {
+        return a.m_time < b.m_time;
+    });
+    for (size_t i = 0; i < files.size() && totalSize > maxCacheSize; i++) {
+        // std::cout << "Evicting " << files[i].m_path << '\n';
+        if (remove(files[i].m_path.c_str()) == 0) {
+            totalSize -= files[i].m_size;
+        }
+    }
+}
+
+bool getCacheKey(const char* filename, CacheKey* pKey)
+{
+    CacheKey key;
+    if (!getFileInfo(filename, &key.m_fileSize, &key.m_fileTime)) {
+        return false;
+    }
+
+    MappedFile file;
+    if (!file.open(filename) || file.size() != key.m_fileSize) {
+        return false;
+    }
+
+    // Small files are hashed whole, otherwise only blocks spread through the file are read
+    uint64_t hash = 14695981039346656037ull;
+    if (file.size() <= kHashBlocks * kHashBlockSize) {
+        hash = hashBytes(hash, file.data(), file.size());
+    }
+    else {
+        const uint64_t blockSpacing = (file.size() - kHashBlockSize) / (kHashBlocks - 1);
+        for (uint64_t block = 0; block < kHashBlocks; block++) {
+            hash = hashBytes(hash, file.data() + (block * blockSpacing), kHashBlockSize);
+        }
+    }
+    key.m_contentHash = hash;
+
+    *pKey = key;
+    return true;
+}
+
+CacheWriter::CacheWriter()
+{
+}
+
+CacheWriter::~CacheWriter()
+{
+    abandon();
+}
+
+bool CacheWriter::open(const CacheKey& key)
+{
+    abandon();
+
+    const std::string directory = getCacheDirectory();
+    if (directory.empty()) {
+        return false;
+    }
+
+#if defined(_WIN32)
+    const int pid = _getpid();
+#else
+    const int pid = (int)getpid();
+#endif
+    m_path = getCachePath(directory, key);
+    m_tempPath = m_path + ".tmp" + std::to_string(pid);  // in case another instance writes the same file
+    m_pFile = fopen(m_tempPath.c_str(), "wb");
+    if (m_pFile == NULL) {
+        return false;
+    }
+
+    // The header is written once the sections are known
+    m_key = key;
+    m_sections.clear();
+    m_offset = 0;
+    return writePadding(sizeof(CacheFileHeader));
+}
+
+bool CacheWriter::addSection(const void* pData, uint64_t size)
+{
+    if (m_pFile == NULL || !writePadding((kCacheAlignment - (m_offset % kCacheAlignment)) % kCacheAlignment)) {
+        return false;
+    }
+
+    CacheSection section;
+    section.m_offset = m_offset;
+    section.m_size = size;
+    if (size > 0 && fwrite(pData, 1, (size_t)size, m_pFile) != size) {
+        return false;
+    }
+    m_offset += size;
+    m_sections.push_back(section);
+    return true;
+}
+
+bool CacheWriter::commit(uint64_t maxCacheSize)
+{
+    if (m_pFile == NULL || !writePadding((8 - (m_offset % 8)) % 8)) {
+        abandon();
+        return false;
+    }
+
+    CacheFileHeader header = CacheFileHeader();
+    memcpy(header.m_magic, kCacheMagic, sizeof(header.m_magic));
+    header.m_version = kCacheFormatVersion;
+    header.m_numSections = (uint32_t)m_sections.size();
+    header.m_tableOffset = m_offset;
+    header.m_key = m_key;
+
+    bool bSuccess = (fwrite(m_sections.data(), sizeof(CacheSection), m_sections.size(), m_pFile) == m_sections.size());
+    bSuccess = bSuccess && (fseek(m_pFile, 0, SEEK_SET) == 0);
+    bSuccess = bSuccess && (fwrite(&header, sizeof(header), 1, m_pFile) == 1);
+    bSuccess = (fclose(m_pFile) == 0) && bSuccess;
+    m_pFile = NULL;
+    if (!bSuccess) {
+        remove(m_tempPath.c_str());
+        return false;
+    }
+
+#if defined(_WIN32)
+    remove(m_path.c_str());  // rename does not replace files on Windows
+#endif
+    if (rename(m_tempPath.c_str(), m_path.c_str()) != 0) {
+        remove(m_tempPath.c_str());
+        return false;
+    }
+
+    evictCacheFiles(m_path.substr(0, m_path.rfind(kPathSeparator)), maxCacheSize);
+    return true;
+}
+
+void CacheWriter::abandon()
+{
+    if (m_pFile != NULL) {
+        fclose(m_pFile);
+        m_pFile = NULL;
+        remove(m_tempPath.c_str());
+    }
+}
+
+bool CacheWriter::writePadding(uint64_t size)
+{
+    static const uint8_t zeros[kCacheAlignment] = {};
+    while (size > 0) {
+        const uint64_t count = std::min(size, kCacheAlignment);
+        if (fwrite(zeros, 1, (size_t)count, m_pFile) != count) {
+            return false;
+        }
+        m_offset += count;
+        size -= count;
+    }
+    return true;
+}
+
+bool CacheReader::open(const CacheKey& key)
+{
+    close();
+
+    const std::string directory = getCacheDirectoryPath();
+    if (directory.empty()) {
+        return false;
+    }
+    const std::string path = getCachePath(directory, key);
+    if (!m_file.open(path.c_str())) {
+        return false;
+    }
+
+    // Check the file is for this key, and complete
+    CacheFileHeader header;
+    bool bValid = (m_file.size() >= sizeof(header));
+    if (bValid) {
+        memcpy(&header, m_file.data(), sizeof(header));
+        bValid = (memcmp(header.m_magic, kCacheMagic, sizeof(kCacheMagic)) == 0) &&
+                 (header.m_version == kCacheFormatVersion) &&
+                 isSameKey(header.m_key, key) &&
+                 (header.m_tableOffset % 8 == 0) &&
+                 (header.m_tableOffset <= m_file.size()) &&
+                 (header.m_numSections <= (m_file.size() - header.m_tableOffset) / sizeof(CacheSection));
+    }
+    if (bValid) {
+        m_pSections = (const CacheSection*)(m_file.data() + header.m_tableOffset);
+        m_numSections = header.m_numSections;
+        for (uint32_t i = 0; i < m_numSections && bValid; i++) {
+            bValid = (m_pSections[i].m_offset <= header.m_tableOffset) &&
+                     (m_pSections[i].m_size <= header.m_tableOffset - m_pSections[i].m_offset);
+        }
+    }
+    if (!bValid) {
+        close();
+        return false;
+    }
+
+    // Files are evicted least recently used first, by modification time
+#if defined(_WIN32)
+    _utime(path.c_str(), NULL);
+#else
+    utime(path.c_str(), NULL);
+#endif
+    return true;
+}
+
+void CacheReader::close()
+{
+    m_file.close();
+    m_pSections = nullptr;
+    m_numSections = 0;
+}
+
+const void* CacheReader::getSection(uint32_t index, uint64_t* pSize) const
+{
+    if (index >= m_numSections) {
+        return nullptr;
+    }
+    *pSize = m_pSections[index].m_size;
+    return m_file.data() + m_pSections[index].m_offset;
+}
@@ -0,0 +1,81 @@
+#ifndef AUDIOPLOT_CACHE_H
+#define AUDIOPLOT_CACHE_H
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "audioplot_mmap.h"
+
+// Identifies the contents of a file without reading all of it: its size and
+// modification time, and a hash of blocks sampled throughout it
+struct CacheKey
+{
+    uint64_t m_fileSize = 0;
+    int64_t m_fileTime = 0;
+    uint64_t m_contentHash = 0;
+};
+
+bool getCacheKey(const char* filename, CacheKey* pKey);
+
+// Directory for cache files, created if needed, or empty if there is none
+std::string getCacheDirectory();
+
+struct CacheSection
+{
+    uint64_t m_offset = 0;
+    uint64_t m_size = 0;
+};
+
+// Writes the cache file for a key as a sequence of sections, each aligned so it can
+// be used in place once mapped. Files are kept in the user's cache directory, and
+// only replace any previous file for the key once they are complete.
+class CacheWriter
+{
+public:
+    CacheWriter();
+    ~CacheWriter();
+
+    bool open(const CacheKey& key);
+    bool addSection(const void* pData, uint64_t size);
+
+    // Finish the file, then remove the least recently used cache files until
+    // they take up no more than maxCacheSize bytes
+    bool commit(uint64_t maxCacheSize);
+
+    // Discard a file that has not been committed
+    void abandon();
+
+private:
+    CacheWriter(const CacheWriter&);
+    CacheWriter& operator=(const CacheWriter&);
+
+    bool writePadding(uint64_t size);
+
+    FILE* m_pFile = nullptr;
+    std::string m_path;
+    std::string m_tempPath;
+    CacheKey m_key;
+    std::vector<CacheSection> m_sections;
+    uint64_t m_offset = 0;
+};
+
+// Memory mapping of the cache file for a key, if there is a complete one
+class CacheReader
+{
+public:
+    bool open(const CacheKey& key);  // also marks the file as recently used
+    void close();
+
+    bool isOpen() const { return m_file.isOpen(); }
+    uint32_t getNumSections() const { return m_numSections; }
+    const void* getSection(uint32_t index, uint64_t* pSize) const;
+
+private:
+    MappedFile m_file;
+    const CacheSection* m_pSections = nullptr;
+    uint32_t m_numSections = 0;
+};
+
+#endif // AUDIOPLOT_CACHE_H
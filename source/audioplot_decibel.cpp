@@ -0,0 +1,212 @@
+#include "audioplot_decibel.h"
+
+#include <cstdint>
+#include <cstring>
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__)))
+#define AUDIOPLOT_DECIBEL_SSE2 1
+#define AUDIOPLOT_DECIBEL_AVX2 1
+#include <emmintrin.h>
+#include <immintrin.h>
+#define AUDIOPLOT_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+// Natural log of m in [sqrt(0.5), sqrt(2)) as x + x^3 * P(x) - x^2 / 2 with x = m - 1 (from Cephes logf),
+// and ln(2) split so that e * kLn2High is exact
+static const float kLogP0 = 7.0376836292e-2f;
+static const float kLogP1 = -1.1514610310e-1f;
+static const float kLogP2 = 1.1676998740e-1f;
+static const float kLogP3 = -1.2420140846e-1f;
+static const float kLogP4 = 1.4249322787e-1f;
+static const float kLogP5 = -1.6668057665e-1f;
+static const float kLogP6 = 2.0000714765e-1f;
+static const float kLogP7 = -2.4999993993e-1f;
+static const float kLogP8 = 3.3333331174e-1f;
+static const float kLn2High = 0.693359375f;
+static const float kLn2Low = -2.12194440e-4f;
+static const float kSqrtHalf = 0.707106781186547524f;
+static const float kDecibelsPerNeper = 4.34294481903251828f;  // 10 / ln(10)
+static const float kMinPower = 1.17549435e-38f;               // smallest normal float
+
+// Scalar
+//
+// Every step is done as a separate float operation, in the same order as the vector
+// versions, so they give the same results. This needs the file built with
+// -ffp-contract=off, as otherwise where FMA is available the compiler fuses some of
+// the multiplies and adds, differently in each version.
+
+static inline float toDecibels(float re, float im)
+{
+    float power = re * re + im * im;
+    power = (power > kMinPower ? power : kMinPower);
+
+    // Split power into m * 2^e with m in [0.5, 1), then double m if it is below sqrt(0.5)
+    uint32_t bits;
+    memcpy(&bits, &power, sizeof(bits));
+    float e = (float)((int32_t)(bits >> 23) - 126);
+    bits = (bits & 0x007fffffu) | 0x3f000000u;
+    float m;
+    memcpy(&m, &bits, sizeof(m));
+    const bool bSmall = (m < kSqrtHalf);
+    e = e - (bSmall ? 1.0f : 0.0f);
+    const float x = (m - 1.0f) + (bSmall ? m : 0.0f);
+
+    const float z = x * x;
+    float y = kLogP0;
+    y = y * x + kLogP1;
+    y = y * x + kLogP2;
+    y = y * x + kLogP3;
+    y = y * x + kLogP4;
+    y = y * x + kLogP5;
+    y = y * x + kLogP6;
+    y = y * x + kLogP7;
+    y = y * x + kLogP8;
+    y = (y * x) * z;
+    y = y + e * kLn2Low;
+    y = y - z * 0.5f;
+    const float ln = (x + y) + e * kLn2High;
+    return ln * kDecibelsPerNeper;
+}
+
+void powerToDecibelsScalar(const float* pComplex, int count, float* pOut)
+{
+    for (int i = 0; i < count; i++) {
+        pOut[count - 1 - i] = toDecibels(pComplex[2 * i], pComplex[2 * i + 1]);
+    }
+}
+
+#if defined(AUDIOPLOT_DECIBEL_SSE2)
+
+// SSE2
+//
+// 4 values at a time, with the real and imaginary parts deinterleaved as they are
+// loaded and the results reversed before they are stored.
+
+static inline __m128 toDecibels(__m128 re, __m128 im)
+{
+    const __m128 one = _mm_set1_ps(1.0f);
+    __m128 power = _mm_add_ps(_mm_mul_ps(re, re), _mm_mul_ps(im, im));
+    power = _mm_max_ps(power, _mm_set1_ps(kMinPower));
+
+    const __m128i bits = _mm_castps_si128(power);
+    __m128 e = _mm_cvtepi32_ps(_mm_sub_epi32(_mm_srli_epi32(bits, 23), _mm_set1_epi32(126)));
+    const __m128 m = _mm_castsi128_ps(_mm_or_si128(_mm_and_si128(bits, _mm_set1_epi32(0x007fffff)), _mm_set1_epi32(0x3f000000)));
+    const __m128 small = _mm_cmplt_ps(m, _mm_set1_ps(kSqrtHalf));
+    e = _mm_sub_ps(e, _mm_and_ps(small, one));
+    const __m128 x = _mm_add_ps(_mm_sub_ps(m, one), _mm_and_ps(small, m));
+
+    const __m128 z = _mm_mul_ps(x, x);
+    __m128 y = _mm_set1_ps(kLogP0);
+    y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(kLogP1));
+    y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(kLogP2));
+    y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(kLogP3));
+    y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(kLogP4));
+    y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(kLogP5));
+    y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(kLogP6));
+    y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(kLogP7));
+    y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(kLogP8));
+    y = _mm_mul_ps(_mm_mul_ps(y, x), z);
+    y = _mm_add_ps(y, _mm_mul_ps(e, _mm_set1_ps(kLn2Low)));
+    y = _mm_sub_ps(y, _mm_mul_ps(z, _mm_set1_ps(0.5f)));
+    const __m128 ln = _mm_add_ps(_mm_add_ps(x, y), _mm_mul_ps(e, _mm_set1_ps(kLn2High)));
+    return _mm_mul_ps(ln, _mm_set1_ps(kDecibelsPerNeper));
+}
+
+static void powerToDecibelsSse2(const float* pComplex, int count, float* pOut)
+{
+    const int numBlocks = count / 4;
+    for (int block = 0; block < numBlocks; block++) {
+        const __m128 a = _mm_loadu_ps(pComplex + 8 * block);
+        const __m128 b = _mm_loadu_ps(pComplex + 8 * block + 4);
+        const __m128 re = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+        const __m128 im = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+        const __m128 decibels = toDecibels(re, im);
+        _mm_storeu_ps(pOut + count - 4 * (block + 1), _mm_shuffle_ps(decibels, decibels, _MM_SHUFFLE(0, 1, 2, 3)));
+    }
+    for (int i = 4 * numBlocks; i < count; i++) {
+        pOut[count - 1 - i] = toDecibels(pComplex[2 * i], pComplex[2 * i + 1]);
+    }
+}
+
+#endif // AUDIOPLOT_DECIBEL_SSE2
+
+#if defined(AUDIOPLOT_DECIBEL_AVX2)
+
+// AVX2
+//
+// 8 values at a time. Deinterleaving within 128-bit lanes leaves the values in the
+// order 0 1 4 5 2 3 6 7, which the permute that reverses them accounts for.
+
+AUDIOPLOT_TARGET_AVX2
+static inline __m256 toDecibelsAvx2(__m256 re, __m256 im)
+{
+    const __m256 one = _mm256_set1_ps(1.0f);
+    __m256 power = _mm256_add_ps(_mm256_mul_ps(re, re), _mm256_mul_ps(im, im));
+    power = _mm256_max_ps(power, _mm256_set1_ps(kMinPower));
+
+    const __m256i bits = _mm256_castps_si256(power);
+    __m256 e = _mm256_cvtepi32_ps(_mm256_sub_epi32(_mm256_srli_epi32(bits, 23), _mm256_set1_epi32(126)));
+    const __m256 m = _mm256_castsi256_ps(_mm256_or_si256(_mm256_and_si256(bits, _mm256_set1_epi32(0x007fffff)), _mm256_set1_epi32(0x3f000000)));
+    const __m256 small = _mm256_cmp_ps(m, _mm256_set1_ps(kSqrtHalf), _CMP_LT_OQ);
+    e = _mm256_sub_ps(e, _mm256_and_ps(small, one));
+    const __m256 x = _mm256_add_ps(_mm256_sub_ps(m, one), _mm256_and_ps(small, m));
+
+    const __m256 z = _mm256_mul_ps(x, x);
+    __m256 y = _mm256_set1_ps(kLogP0);
+    y = _mm256_add_ps(_mm256_mul_ps(y, x), _mm256_set1_ps(kLogP1));
+    y = _mm256_add_ps(_mm256_mul_ps(y, x), _mm256_set1_ps(kLogP2));
+    y = _mm256_add_ps(_mm256_mul_ps(y, x), _mm256_set1_ps(kLogP3));
+    y = _mm256_add_ps(_mm256_mul_ps(y, x), _mm256_set1_ps(kLogP4));
+    y = _mm256_add_ps(_mm256_mul_ps(y, x), _mm256_set1_ps(kLogP5));
+    y = _mm256_add_ps(_mm256_mul_ps(y, x), _mm256_set1_ps(kLogP6));
+    y = _mm256_add_ps(_mm256_mul_ps(y, x), _mm256_set1_ps(kLogP7));
+    y = _mm256_add_ps(_mm256_mul_ps(y, x), _mm256_set1_ps(kLogP8));
+    y = _mm256_mul_ps(_mm256_mul_ps(y, x), z);
+    y = _mm256_add_ps(y, _mm256_mul_ps(e, _mm256_set1_ps(kLn2Low)));
+    y = _mm256_sub_ps(y, _mm256_mul_ps(z, _mm256_set1_ps(0.5f)));
+    const __m256 ln = _mm256_add_ps(_mm256_add_ps(x, y), _mm256_mul_ps(e, _mm256_set1_ps(kLn2High)));
+    return _mm256_mul_ps(ln, _mm256_set1_ps(kDecibelsPerNeper));
+}
+
+AUDIOPLOT_TARGET_AVX2
+static void powerToDecibelsAvx2(const float* pComplex, int count, float* pOut)
+{
+    const __m256i reverse = _mm256_setr_epi32(7, 6, 3, 2, 5, 4, 1, 0);
+    const int numBlocks = count / 8;
+    for (int block = 0; block < numBlocks; block++) {
+        const __m256 a = _mm256_loadu_ps(pComplex + 16 * block);
+        const __m256 b = _mm256_loadu_ps(pComplex + 16 * block + 8);
+        const __m256 re = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+        const __m256 im = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+        const __m256 decibels = toDecibelsAvx2(re, im);
+        _mm256_storeu_ps(pOut + count - 8 * (block + 1), _mm256_permutevar8x32_ps(decibels, reverse));
+    }
+    _mm256_zeroupper();  // avoid AVX to SSE transition stalls in the code that follows
+
+    powerToDecibelsSse2(pComplex + 16 * numBlocks, count - 8 * numBlocks, pOut);
+}
+
+static bool hasAvx2()
+{
+    static const bool bAvx2 = __builtin_cpu_supports("avx2");
+    return bAvx2;
+}
+
+#endif // AUDIOPLOT_DECIBEL_AVX2
+
+// Dispatch
+
+void powerToDecibels(const float* pComplex, int count, float* pOut)
+{
+#if defined(AUDIOPLOT_DECIBEL_AVX2)
+    if (hasAvx2()) {
+        powerToDecibelsAvx2(pComplex, count, pOut);
+        return;
+    }
+#endif
+#if defined(AUDIOPLOT_DECIBEL_SSE2)
+    powerToDecibelsSse2(pComplex, count, pOut);
+#else
+    powerToDecibelsScalar(pComplex, count, pOut);
+#endif
+}
@@ -0,0 +1,16 @@
+#ifndef AUDIOPLOT_DECIBEL_H
+#define AUDIOPLOT_DECIBEL_H
+
+// Conversion of FFT output to decibels, vectorized with SSE2 or AVX2 (chosen at runtime
+// on x86) and with a scalar fallback. All implementations give bit-identical results.
+
+// Write 10*log10 of the power of each of count complex values (interleaved real and
+// imaginary parts) to pOut, in reverse order so the highest frequency is first. The log
+// is a polynomial approximation, to within 1e-4 dB; power below the smallest normal
+// float (including zero) is given its level, about -379 dB.
+void powerToDecibels(const float* pComplex, int count, float* pOut);
+
+// Scalar reference implementation
+void powerToDecibelsScalar(const float* pComplex, int count, float* pOut);
+
+#endif // AUDIOPLOT_DECIBEL_H
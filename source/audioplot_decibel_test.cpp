@@ -0,0 +1,100 @@
+// Checks that the decibel conversion chosen at runtime gives bit-identical results to the
+// scalar reference implementation, and that both are within 1e-4 dB of 10*log10 of the
+// power, for frames of every length up to a few vector blocks and some FFT sizes.
+//
+//     audioplot_decibel_test
+
+#include "audioplot_decibel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+static const double kMaxError = 1e-4;               // dB
+static const double kMinPower = 1.17549435e-38;     // smallest normal float, below which power is clamped
+static const int kMaxShortCount = 100;              // covers several 4 and 8 value blocks plus every tail length
+static const int kFftSizes[] = {256, 1024, 2048, 4096, 16384};
+
+static int g_numFailures = 0;
+static double g_maxError = 0.0;
+
+static void checkFrame(const char* pKind, const std::vector<float>& complex, int count)
+{
+    std::vector<float> expected(count + 4, 123.0f);  // padding catches writes past the end
+    std::vector<float> actual(count + 4, 123.0f);
+    powerToDecibelsScalar(complex.data(), count, expected.data());
+    powerToDecibels(complex.data(), count, actual.data());
+    if (memcmp(expected.data(), actual.data(), expected.size() * sizeof(float)) != 0) {
+        if (g_numFailures < 20) {
+            fprintf(stderr, "FAIL %s: count %d, dispatched and scalar results differ\n", pKind, count);
+        }
+        g_numFailures++;
+    }
+
+    for (int i = 0; i < count; i++) {
+        const double re = complex[2 * i];
+        const double im = complex[2 * i + 1];
+        const double reference = 10.0 * log10(std::max(re * re + im * im, kMinPower));
+        const double error = fabs(expected[count - 1 - i] - reference);  // the highest frequency is first
+        g_maxError = std::max(g_maxError, error);
+        if (!(error <= kMaxError)) {
+            if (g_numFailures < 20) {
+                fprintf(stderr, "FAIL %s: count %d, value %d (%g, %g) off by %g dB\n", pKind, count, i, re, im, error);
+            }
+            g_numFailures++;
+        }
+    }
+}
+
+int main()
+{
+    std::mt19937 random(1);
+    std::uniform_real_distribution<float> mantissa(-1.0f, 1.0f);
+    std::uniform_int_distribution<int> exponent(-70, 60);  // powers from below the smallest normal float to 1e36
+    std::uniform_int_distribution<int> special(0, 15);
+
+    for (int run = 0; run < 20; run++) {
+        std::vector<float> complex(2 * kFftSizes[sizeof(kFftSizes) / sizeof(kFftSizes[0]) - 1]);
+        for (size_t i = 0; i < complex.size(); i++) {
+            switch (special(random)) {
+                case 0:
+                    complex[i] = 0.0f;
+                    break;
+                case 1:
+                    complex[i] = -0.0f;
+                    break;
+                case 2:
+                    complex[i] = 1e-30f;  // power below the smallest normal float
+                    break;
+                default:
+                    complex[i] = ldexpf(mantissa(random), exponent(random) / 2);
+                    break;
+            }
+        }
+
+        for (int count = 0; count <= kMaxShortCount; count++) {
+            checkFrame("short frame", complex, count);
+        }
+        for (int fftSize : kFftSizes) {
+            checkFrame("FFT frame", complex, fftSize / 2 + 1);
+        }
+    }
+
+    // Every mantissa of powers near 1, around the sqrt(0.5) split of the log's range
+    std::vector<float> sweep(2 * 65536);
+    for (int i = 0; i < 65536; i++) {
+        sweep[2 * i] = sqrtf(0.5f + (float)i / 65536.0f);
+        sweep[2 * i + 1] = 0.0f;
+    }
+    checkFrame("mantissa sweep", sweep, 65536);
+
+    if (g_numFailures != 0) {
+        fprintf(stderr, "%d failure(s)\n", g_numFailures);
+        return 1;
+    }
+    printf("decibel conversion matches the scalar implementation, within %.2g dB of 10*log10\n", g_maxError);
+    return 0;
+}
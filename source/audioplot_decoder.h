@@ -0,0 +1,36 @@
+#ifndef AUDIOPLOT_DECODER_H
+#define AUDIOPLOT_DECODER_H
+
+#include <cstdint>
+
+#include "audioplot_samples.h"
+
+// Chunked PCM decoder, implemented by each of the audio file format wrappers.
+// Frames are decoded on demand into a caller-provided interleaved buffer, so
+// the whole file never has to be resident in memory at once.
+class AudioDecoder
+{
+public:
+    virtual ~AudioDecoder() {}
+
+    virtual bool open(const char* filename) = 0;
+    virtual uint64_t readPcmFramesF32(uint64_t framesToRead, float* pFramesOut) = 0;
+    virtual uint64_t readPcmFramesS16(uint64_t framesToRead, int16_t* pFramesOut) = 0;
+    virtual bool seekToPcmFrame(uint64_t frameIndex) = 0;
+    virtual void close() = 0;
+
+    unsigned int getChannels() const { return m_channels; }
+    unsigned int getSampleRate() const { return m_sampleRate; }
+    uint64_t getTotalFrameCount() const { return m_totalFrameCount; }  // frame = 1 sample per channel
+
+    // Narrowest of S16 or F32 that holds the decoded samples without loss
+    SampleFormat getNativeFormat() const { return m_nativeFormat; }
+
+protected:
+    unsigned int m_channels = 0;
+    unsigned int m_sampleRate = 0;
+    uint64_t m_totalFrameCount = 0;
+    SampleFormat m_nativeFormat = SAMPLE_FORMAT_F32;
+};
+
+#endif // AUDIOPLOT_DECODER_H
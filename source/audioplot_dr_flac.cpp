@@ -3,12 +3,56 @@
 #define DR_FLAC_IMPLEMENTATION
 #include "dr_flac.h"
 
-float* openFlacFileAndReadPcmFramesF32(const char* filename, unsigned int* channels, unsigned int* sampleRate, uint64_t* totalFrameCount)
+class FlacDecoder : public AudioDecoder
 {
-    return drflac_open_file_and_read_pcm_frames_f32(filename, channels, sampleRate, totalFrameCount, NULL);
-}
+public:
+    ~FlacDecoder()
+    {
+        close();
+    }
+
+    bool open(const char* filename)
+    {
+        close();
+        m_pFlac = drflac_open_file(filename, NULL);
+        if (m_pFlac == NULL) {
+            return false;
+        }
+        m_channels = m_pFlac->channels;
+        m_sampleRate = m_pFlac->sampleRate;
+        m_totalFrameCount = m_pFlac->totalPCMFrameCount;
+        m_nativeFormat = (m_pFlac->bitsPerSample <= 16) ? SAMPLE_FORMAT_S16 : SAMPLE_FORMAT_F32;
+        return true;
+    }
+
+    uint64_t readPcmFramesF32(uint64_t framesToRead, float* pFramesOut)
+    {
+        return m_pFlac ? drflac_read_pcm_frames_f32(m_pFlac, framesToRead, pFramesOut) : 0;
+    }
+
+    uint64_t readPcmFramesS16(uint64_t framesToRead, int16_t* pFramesOut)
+    {
+        return m_pFlac ? drflac_read_pcm_frames_s16(m_pFlac, framesToRead, pFramesOut) : 0;
+    }
 
-void freeFlacSampleData(float* pSampleData)
+    bool seekToPcmFrame(uint64_t frameIndex)
+    {
+        return m_pFlac && drflac_seek_to_pcm_frame(m_pFlac, frameIndex);
+    }
+
+    void close()
+    {
+        if (m_pFlac) {
+            drflac_close(m_pFlac);
+            m_pFlac = NULL;
+        }
+    }
+
+private:
+    drflac* m_pFlac = NULL;
+};
+
+AudioDecoder* createFlacDecoder()
 {
-    drflac_free(pSampleData, NULL);
-}
\ No newline at end of file
+    return new FlacDecoder();
+}
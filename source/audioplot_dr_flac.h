@@ -1,9 +1,8 @@
 #ifndef AUDIOPLOT_DR_FLAC_H
 #define AUDIOPLOT_DR_FLAC_H
 
-#include <cstdint>
+#include "audioplot_decoder.h"
 
-float* openFlacFileAndReadPcmFramesF32(const char* filename, unsigned int* channels, unsigned int* sampleRate, uint64_t* totalFrameCount);
-void freeFlacSampleData(float* pSampleData);
+AudioDecoder* createFlacDecoder();
 
-#endif // AUDIOPLOT_DR_FLAC_H
\ No newline at end of file
+#endif // AUDIOPLOT_DR_FLAC_H
@@ -3,16 +3,57 @@
 #define DR_MP3_IMPLEMENTATION
 #include "dr_mp3.h"
 
-float* openMp3FileAndReadPcmFramesF32(const char* filename, unsigned int* channels, unsigned int* sampleRate, uint64_t* totalFrameCount)
+class Mp3Decoder : public AudioDecoder
 {
-    drmp3_config config;
-    float* pSamples = drmp3_open_file_and_read_pcm_frames_f32(filename, &config, totalFrameCount, NULL);
-    *channels = config.channels;
-    *sampleRate = config.sampleRate;
-    return pSamples;
-}
+public:
+    ~Mp3Decoder()
+    {
+        close();
+    }
+
+    bool open(const char* filename)
+    {
+        close();
+        if (!drmp3_init_file(&m_mp3, filename, NULL)) {
+            return false;
+        }
+        m_bOpen = true;
+        m_channels = m_mp3.channels;
+        m_sampleRate = m_mp3.sampleRate;
+        m_totalFrameCount = drmp3_get_pcm_frame_count(&m_mp3);  // scans the frame headers, then rewinds
+        m_nativeFormat = SAMPLE_FORMAT_S16;  // dr_mp3 synthesizes 16-bit samples
+        return true;
+    }
+
+    uint64_t readPcmFramesF32(uint64_t framesToRead, float* pFramesOut)
+    {
+        return m_bOpen ? drmp3_read_pcm_frames_f32(&m_mp3, framesToRead, pFramesOut) : 0;
+    }
+
+    uint64_t readPcmFramesS16(uint64_t framesToRead, int16_t* pFramesOut)
+    {
+        return m_bOpen ? drmp3_read_pcm_frames_s16(&m_mp3, framesToRead, pFramesOut) : 0;
+    }
 
-void freeMp3SampleData(float* pSampleData)
+    bool seekToPcmFrame(uint64_t frameIndex)
+    {
+        return m_bOpen && drmp3_seek_to_pcm_frame(&m_mp3, frameIndex);
+    }
+
+    void close()
+    {
+        if (m_bOpen) {
+            drmp3_uninit(&m_mp3);
+            m_bOpen = false;
+        }
+    }
+
+private:
+    drmp3 m_mp3;
+    bool m_bOpen = false;
+};
+
+AudioDecoder* createMp3Decoder()
 {
-    drmp3_free(pSampleData, NULL);
-}
\ No newline at end of file
+    return new Mp3Decoder();
+}
@@ -1,9 +1,8 @@
 #ifndef AUDIOPLOT_DR_MP3_H
 #define AUDIOPLOT_DR_MP3_H
 
-#include <cstdint>
+#include "audioplot_decoder.h"
 
-float* openMp3FileAndReadPcmFramesF32(const char* filename, unsigned int* channels, unsigned int* sampleRate, uint64_t* totalFrameCount);
-void freeMp3SampleData(float* pSampleData);
+AudioDecoder* createMp3Decoder();
 
-#endif // AUDIOPLOT_DR_MP3_H
\ No newline at end of file
+#endif // AUDIOPLOT_DR_MP3_H
@@ -3,12 +3,100 @@
 #define DR_WAV_IMPLEMENTATION
 #include "dr_wav.h"
 
-float* openWavFileAndReadPcmFramesF32(const char* filename, unsigned int* channels, unsigned int* sampleRate, uint64_t* totalFrameCount)
+class WavDecoder : public AudioDecoder
 {
-    return drwav_open_file_and_read_pcm_frames_f32(filename, channels, sampleRate, totalFrameCount, NULL);
+public:
+    ~WavDecoder()
+    {
+        close();
+    }
+
+    bool open(const char* filename)
+    {
+        close();
+        if (!drwav_init_file(&m_wav, filename, NULL)) {
+            return false;
+        }
+        m_bOpen = true;
+        m_channels = m_wav.channels;
+        m_sampleRate = m_wav.sampleRate;
+        m_totalFrameCount = m_wav.totalPCMFrameCount;
+        const bool bFloat = (m_wav.translatedFormatTag == DR_WAVE_FORMAT_IEEE_FLOAT);
+        m_nativeFormat = (!bFloat && m_wav.bitsPerSample <= 16) ? SAMPLE_FORMAT_S16 : SAMPLE_FORMAT_F32;
+        return true;
+    }
+
+    uint64_t readPcmFramesF32(uint64_t framesToRead, float* pFramesOut)
+    {
+        return m_bOpen ? drwav_read_pcm_frames_f32(&m_wav, framesToRead, pFramesOut) : 0;
+    }
+
+    uint64_t readPcmFramesS16(uint64_t framesToRead, int16_t* pFramesOut)
+    {
+        return m_bOpen ? drwav_read_pcm_frames_s16(&m_wav, framesToRead, pFramesOut) : 0;
+    }
+
+    bool seekToPcmFrame(uint64_t frameIndex)
+    {
+        return m_bOpen && drwav_seek_to_pcm_frame(&m_wav, frameIndex);
+    }
+
+    void close()
+    {
+        if (m_bOpen) {
+            drwav_uninit(&m_wav);
+            m_bOpen = false;
+        }
+    }
+
+private:
+    drwav m_wav;
+    bool m_bOpen = false;
+};
+
+AudioDecoder* createWavDecoder()
+{
+    return new WavDecoder();
 }
 
-void freeWavSampleData(float* pSampleData)
+bool getWavPcmDataLayout(const char* filename, WavPcmDataLayout* pLayout)
 {
-    drwav_free(pSampleData, NULL);
-}
\ No newline at end of file
+    drwav wav;
+    if (!drwav_init_file(&wav, filename, NULL)) {
+        return false;
+    }
+
+    bool bSupported = true;
+    if (wav.translatedFormatTag == DR_WAVE_FORMAT_PCM && wav.bitsPerSample == 16) {
+        pLayout->m_format = SAMPLE_FORMAT_S16;
+    }
+    else if (wav.translatedFormatTag == DR_WAVE_FORMAT_PCM && wav.bitsPerSample == 24) {
+        pLayout->m_format = SAMPLE_FORMAT_S24;
+    }
+    else if (wav.translatedFormatTag == DR_WAVE_FORMAT_PCM && wav.bitsPerSample == 32) {
+        pLayout->m_format = SAMPLE_FORMAT_S32;
+    }
+    else if (wav.translatedFormatTag == DR_WAVE_FORMAT_IEEE_FLOAT && wav.bitsPerSample == 32) {
+        pLayout->m_format = SAMPLE_FORMAT_F32;
+    }
+    else if (wav.translatedFormatTag == DR_WAVE_FORMAT_IEEE_FLOAT && wav.bitsPerSample == 64) {
+        pLayout->m_format = SAMPLE_FORMAT_F64;
+    }
+    else {
+        bSupported = false;
+    }
+
+    if (wav.channels == 0 || wav.fmt.blockAlign < wav.channels * sampleFormatSize(pLayout->m_format)) {
+        bSupported = false;
+    }
+
+    pLayout->m_channels = wav.channels;
+    pLayout->m_sampleRate = wav.sampleRate;
+    pLayout->m_totalFrameCount = wav.totalPCMFrameCount;
+    pLayout->m_dataOffset = wav.dataChunkDataPos;
+    pLayout->m_dataSize = wav.dataChunkDataSize;
+    pLayout->m_bytesPerFrame = wav.fmt.blockAlign;
+
+    drwav_uninit(&wav);
+    return bSupported;
+}
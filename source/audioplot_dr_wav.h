@@ -1,9 +1,25 @@
 #ifndef AUDIOPLOT_DR_WAV_H
 #define AUDIOPLOT_DR_WAV_H
 
-#include <cstdint>
+#include "audioplot_decoder.h"
+#include "audioplot_samples.h"
 
-float* openWavFileAndReadPcmFramesF32(const char* filename, unsigned int* channels, unsigned int* sampleRate, uint64_t* totalFrameCount);
-void freeWavSampleData(float* pSampleData);
+AudioDecoder* createWavDecoder();
 
-#endif // AUDIOPLOT_DR_WAV_H
\ No newline at end of file
+// Location and format of the sample data of an uncompressed WAV file
+struct WavPcmDataLayout
+{
+    unsigned int m_channels = 0;
+    unsigned int m_sampleRate = 0;
+    uint64_t m_totalFrameCount = 0;
+    uint64_t m_dataOffset = 0;     // file offset of the first frame
+    uint64_t m_dataSize = 0;       // bytes of frame data
+    uint32_t m_bytesPerFrame = 0;  // interleaved frame stride
+    SampleFormat m_format = SAMPLE_FORMAT_S16;
+};
+
+// Parse the header of a 16/24/32-bit PCM or 32/64-bit float WAV file, so its
+// samples can be read in place. Returns false for any other encoding.
+bool getWavPcmDataLayout(const char* filename, WavPcmDataLayout* pLayout);
+
+#endif // AUDIOPLOT_DR_WAV_H
@@ -0,0 +1,173 @@
+#include "audioplot_fft.h"
+
+#include <kiss_fftr.h>
+#include <algorithm>
+#include <vector>
+
+#ifdef USE_SIMD
+
+// kissfft built with SSE has vectors for its scalars, so each transform is of four frames,
+// with the frames' samples interleaved into the lanes and the results taken out again
+class RealFft::RealFftImpl
+{
+public:
+    explicit RealFftImpl(int size)
+    : m_size(size)
+    , m_fft(kiss_fftr_alloc(size, 0, nullptr, nullptr))
+    , m_pInput((kiss_fft_scalar*)_mm_malloc(sizeof(kiss_fft_scalar) * size, 16))
+    , m_pOutput((kiss_fft_cpx*)_mm_malloc(sizeof(kiss_fft_cpx) * (size / 2 + 1), 16))
+    , m_zeros(size, 0.0f)
+    {
+    }
+
+    ~RealFftImpl()
+    {
+        kiss_fftr_free(m_fft);
+        _mm_free(m_pInput);
+        _mm_free(m_pOutput);
+    }
+
+    void transform(const float* pInput, int numFrames, std::complex<float>* pOutput)
+    {
+        const int numFrequencies = m_size / 2 + 1;
+        for (int frame = 0; frame < numFrames; frame += 4) {
+            // Missing frames of a partial batch are transformed from zeros, and not written
+            const int numLanes = std::min(numFrames - frame, 4);
+            const float* in[4];
+            float* out[4];
+            for (int lane = 0; lane < 4; lane++) {
+                const bool bPresent = (lane < numLanes);
+                in[lane] = (bPresent ? pInput + (size_t)(frame + lane) * m_size : m_zeros.data());
+                out[lane] = (bPresent ? reinterpret_cast<float*>(pOutput + (size_t)(frame + lane) * numFrequencies) : nullptr);
+            }
+
+            // The FFT size is a multiple of four, so samples are transposed in 4x4 blocks
+            for (int i = 0; i < m_size; i += 4) {
+                __m128 a = _mm_loadu_ps(in[0] + i);
+                __m128 b = _mm_loadu_ps(in[1] + i);
+                __m128 c = _mm_loadu_ps(in[2] + i);
+                __m128 d = _mm_loadu_ps(in[3] + i);
+                _MM_TRANSPOSE4_PS(a, b, c, d);
+                m_pInput[i] = a;
+                m_pInput[i + 1] = b;
+                m_pInput[i + 2] = c;
+                m_pInput[i + 3] = d;
+            }
+
+            kiss_fftr(m_fft, m_pInput, m_pOutput);
+
+            int k = 0;
+            for (; k + 4 <= numFrequencies; k += 4) {
+                __m128 re[4] = {m_pOutput[k].r, m_pOutput[k + 1].r, m_pOutput[k + 2].r, m_pOutput[k + 3].r};
+                __m128 im[4] = {m_pOutput[k].i, m_pOutput[k + 1].i, m_pOutput[k + 2].i, m_pOutput[k + 3].i};
+                _MM_TRANSPOSE4_PS(re[0], re[1], re[2], re[3]);
+                _MM_TRANSPOSE4_PS(im[0], im[1], im[2], im[3]);
+                for (int lane = 0; lane < numLanes; lane++) {
+                    _mm_storeu_ps(out[lane] + 2 * k, _mm_unpacklo_ps(re[lane], im[lane]));
+                    _mm_storeu_ps(out[lane] + 2 * k + 4, _mm_unpackhi_ps(re[lane], im[lane]));
+                }
+            }
+            for (; k < numFrequencies; k++) {
+                float re[4];
+                float im[4];
+                _mm_storeu_ps(re, m_pOutput[k].r);
+                _mm_storeu_ps(im, m_pOutput[k].i);
+                for (int lane = 0; lane < numLanes; lane++) {
+                    out[lane][2 * k] = re[lane];
+                    out[lane][2 * k + 1] = im[lane];
+                }
+            }
+        }
+    }
+
+    static int getBatchSize()
+    {
+        return 4;
+    }
+
+    static const char* getBackendName()
+    {
+        return "kissfft (SSE)";
+    }
+
+    int m_size;
+
+private:
+    kiss_fftr_cfg m_fft;
+    kiss_fft_scalar* m_pInput;  // one sample of each frame in each vector
+    kiss_fft_cpx* m_pOutput;
+    std::vector<float> m_zeros;
+};
+
+#else
+
+class RealFft::RealFftImpl
+{
+public:
+    explicit RealFftImpl(int size)
+    : m_size(size)
+    , m_fft(kiss_fftr_alloc(size, 0, nullptr, nullptr))
+    {
+    }
+
+    ~RealFftImpl()
+    {
+        kiss_fftr_free(m_fft);
+    }
+
+    void transform(const float* pInput, int numFrames, std::complex<float>* pOutput)
+    {
+        const int numFrequencies = m_size / 2 + 1;
+        for (int frame = 0; frame < numFrames; frame++) {
+            kiss_fftr(m_fft, pInput + (size_t)frame * m_size,
+                      reinterpret_cast<kiss_fft_cpx*>(pOutput + (size_t)frame * numFrequencies));
+        }
+    }
+
+    static int getBatchSize()
+    {
+        return 1;
+    }
+
+    static const char* getBackendName()
+    {
+        return "kissfft";
+    }
+
+    int m_size;
+
+private:
+    kiss_fftr_cfg m_fft;
+};
+
+#endif
+
+RealFft::RealFft(int size)
+: m_pImpl(new RealFftImpl(size))
+{
+}
+
+RealFft::~RealFft()
+{
+    delete m_pImpl;
+}
+
+int RealFft::size() const
+{
+    return m_pImpl->m_size;
+}
+
+void RealFft::transform(const float* pInput, int numFrames, std::complex<float>* pOutput)
+{
+    m_pImpl->transform(pInput, numFrames, pOutput);
+}
+
+int RealFft::getBatchSize()
+{
+    return RealFftImpl::getBatchSize();
+}
+
+const char* RealFft::getBackendName()
+{
+    return RealFftImpl::getBackendName();
+}
@@ -0,0 +1,34 @@
+#ifndef AUDIOPLOT_FFT_H
+#define AUDIOPLOT_FFT_H
+
+#include <complex>
+
+// Real FFT of one size, by the backend chosen when building: kissfft by default, or with
+// USE_SIMD (AUDIOPLOT_FFT_SIMD in CMake, FFT_SIMD=1 for make) kissfft built with SSE,
+// which transforms four frames at once, one in each lane of its vectors. A plan keeps
+// scratch space, so each thread needs its own.
+class RealFft
+{
+public:
+    explicit RealFft(int size);
+    ~RealFft();
+
+    int size() const;
+
+    // Transform numFrames frames of size() samples, one after another, writing the
+    // size() / 2 + 1 values from 0 Hz of each, one frame after another
+    void transform(const float* pInput, int numFrames, std::complex<float>* pOutput);
+
+    // Frames the backend transforms at once, so transforming fewer wastes some of the work
+    static int getBatchSize();
+    static const char* getBackendName();
+
+private:
+    RealFft(const RealFft&);
+    RealFft& operator=(const RealFft&);
+
+    class RealFftImpl;
+    RealFftImpl* m_pImpl;
+};
+
+#endif // AUDIOPLOT_FFT_H
@@ -0,0 +1,141 @@
+// Times the spectrogram's FFT frames at several FFT sizes with the FFT backend this is
+// built with, so backends are compared by building with each and running both, then
+// times the conversion of frames to decibels:
+//
+//     audioplot_fft_benchmark [seconds of audio] [threads]
+
+#include "audioplot_decibel.h"
+#include "audioplot_fft.h"
+#include "audioplot_kiss_fft.h"
+#include "audioplot_thread_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <random>
+#include <vector>
+
+static const float kSampleRate = 48000.0f;
+static const int kNumChannels = 2;
+static const int kNumRuns = 3;  // the fastest is reported
+
+static double getSeconds(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char** argv)
+{
+    const double duration = (argc > 1 ? atof(argv[1]) : 60.0);
+    const uint32_t numThreads = (argc > 2 ? (uint32_t)atoi(argv[2]) : 1);
+    if (duration <= 0.0) {
+        fprintf(stderr, "usage: %s [seconds of audio] [threads]\n", argv[0]);
+        return 1;
+    }
+
+    // A sweep in noise, interleaved as in a mapped file
+    const uint64_t numSamples = (uint64_t)(duration * kSampleRate);
+    std::vector<float> samples(numSamples * kNumChannels);
+    std::mt19937 random(1);
+    std::normal_distribution<float> noise(0.0f, 0.01f);
+    double phase = 0.0;
+    for (uint64_t i = 0; i < numSamples; i++) {
+        phase += 2.0 * 3.14159265358979323846 * (20.0 + 20000.0 * i / numSamples) / kSampleRate;
+        for (int ch = 0; ch < kNumChannels; ch++) {
+            samples[i * kNumChannels + ch] = 0.5f * (float)sin(phase) + noise(random);
+        }
+    }
+    std::vector<SampleView> views;
+    for (int ch = 0; ch < kNumChannels; ch++) {
+        views.push_back(SampleView(&samples[ch], numSamples, kNumChannels * sizeof(float), SAMPLE_FORMAT_F32));
+    }
+
+    ThreadPool threadPool(numThreads);
+    std::mutex mutex;
+    std::atomic<bool> bCancel(false);
+    printf("FFT backend %s, %u thread(s), %.0f s of %d channels at %.0f Hz, Hann window, 50%% overlap\n",
+           RealFft::getBackendName(), threadPool.getNumThreads(), duration, kNumChannels, kSampleRate);
+    printf("%8s %10s %14s %14s %14s\n", "FFT size", "frames", "spectrogram", "per frame", "FFT only");
+
+    static const int fftSizes[] = {256, 1024, 4096, 16384};
+    for (int fftSize : fftSizes) {
+        SpectrogramSettings settings;
+        settings.m_fftSize = fftSize;
+        settings.m_hop = fftSize / 2;
+        settings.m_window = SPECTROGRAM_WINDOW_HANN;
+
+        // Frames as they're computed while loading, windowed, transformed and converted to dB
+        double spectrogramTime = 1e30;
+        int numFrames = 0;
+        for (int run = 0; run < kNumRuns; run++) {
+            Spectrogram spectrogram;
+            spectrogram.initialize(kNumChannels, kSampleRate, numSamples, settings);
+            const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            spectrogram.update(views, threadPool, mutex, bCancel);
+            spectrogramTime = std::min(spectrogramTime, getSeconds(start));
+            numFrames = spectrogram.n_bin() * kNumChannels;
+        }
+
+        // The transforms alone, on one thread
+        RealFft fft(fftSize);
+        const int batchSize = RealFft::getBatchSize();
+        std::vector<float> input((size_t)batchSize * fftSize);
+        std::vector<std::complex<float>> output((size_t)batchSize * (fftSize / 2 + 1));
+        for (size_t i = 0; i < input.size(); i++) {
+            input[i] = samples[i % samples.size()];
+        }
+        const int numTransforms = std::max(numFrames / batchSize, 1);
+        double fftTime = 1e30;
+        for (int run = 0; run < kNumRuns; run++) {
+            const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            for (int i = 0; i < numTransforms; i++) {
+                fft.transform(input.data(), batchSize, output.data());
+            }
+            fftTime = std::min(fftTime, getSeconds(start));
+        }
+
+        printf("%8d %10d %11.1f ms %11.2f us %11.2f us\n", fftSize, numFrames, spectrogramTime * 1e3,
+               spectrogramTime * 1e6 / std::max(numFrames, 1), fftTime * 1e6 / ((double)numTransforms * batchSize));
+    }
+
+    // Conversion of one frame of FFT output to dB: as it was done per value, and with the scalar
+    // and runtime dispatched kernels of powerToDecibels()
+    printf("\n%8s %14s %14s %14s\n", "FFT size", "20log10(|x|)", "dB scalar", "dB SIMD");
+    for (int fftSize : fftSizes) {
+        const int numFrequencies = fftSize / 2 + 1;
+        const int numFrames = std::max((int)(numSamples / fftSize), 1);
+        std::vector<std::complex<float>> spectrum(numFrequencies);
+        for (int i = 0; i < numFrequencies; i++) {
+            spectrum[i] = std::complex<float>(samples[(2 * i) % samples.size()], samples[(2 * i + 1) % samples.size()]);
+        }
+        std::vector<float> decibels(numFrequencies);
+        double times[3] = {1e30, 1e30, 1e30};
+        for (int run = 0; run < kNumRuns; run++) {
+            for (int method = 0; method < 3; method++) {
+                const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+                for (int frame = 0; frame < numFrames; frame++) {
+                    if (method == 0) {
+                        for (int i = 0; i < numFrequencies; i++) {
+                            decibels[numFrequencies - 1 - i] = 20.0f * log10f(std::abs(spectrum[i]));
+                        }
+                    }
+                    else if (method == 1) {
+                        powerToDecibelsScalar(reinterpret_cast<const float*>(spectrum.data()), numFrequencies, decibels.data());
+                    }
+                    else {
+                        powerToDecibels(reinterpret_cast<const float*>(spectrum.data()), numFrequencies, decibels.data());
+                    }
+                    spectrum[frame % numFrequencies] += decibels[0] * 1e-30f;  // keeps the frames from being optimized away
+                }
+                times[method] = std::min(times[method], getSeconds(start));
+            }
+        }
+        printf("%8d %11.2f us %11.2f us %11.2f us\n", fftSize, times[0] * 1e6 / numFrames, times[1] * 1e6 / numFrames,
+               times[2] * 1e6 / numFrames);
+    }
+    return 0;
+}
@@ -0,0 +1,225 @@
+#include "audioplot_filterbank.h"
+
+#include <algorithm>
+#include <cmath>
+
+static const double kMinLogFrequency = 20.0;         // at the bottom of the log scale
+static const double kMinConstantQFrequency = 32.70;  // C1, at the bottom of the constant-Q scale
+static const int kConstantQBandsPerOctave = 24;
+static const float kNepersPerDecibel = 0.230258509f;  // ln(10) / 10
+static const float kDecibelsPerNeper = 4.34294482f;
+static const float kMinPower = 1.17549435e-38f;       // of a band, so silence stays finite
+
+// The scales are linear in these functions of frequency, above their lowest frequency
+static double getWarpedFrequency(SpectrogramScale scale, double frequency)
+{
+    switch (scale) {
+        case SPECTROGRAM_SCALE_MEL:
+            return 2595.0 * log10(1.0 + frequency / 700.0);
+        case SPECTROGRAM_SCALE_LOG:
+        case SPECTROGRAM_SCALE_CONSTANT_Q:
+            return log2(std::max(frequency, 1e-3));
+        default:
+            return frequency;
+    }
+}
+
+static double getUnwarpedFrequency(SpectrogramScale scale, double warped)
+{
+    switch (scale) {
+        case SPECTROGRAM_SCALE_MEL:
+            return 700.0 * (pow(10.0, warped / 2595.0) - 1.0);
+        case SPECTROGRAM_SCALE_LOG:
+        case SPECTROGRAM_SCALE_CONSTANT_Q:
+            return exp2(warped);
+        default:
+            return warped;
+    }
+}
+
+static double getMinFrequency(SpectrogramScale scale)
+{
+    switch (scale) {
+        case SPECTROGRAM_SCALE_LOG:
+            return kMinLogFrequency;
+        case SPECTROGRAM_SCALE_CONSTANT_Q:
+            return kMinConstantQFrequency;
+        default:
+            return 0.0;
+    }
+}
+
+static int getNumBands(SpectrogramScale scale, int numFrequencies, double maxFrequency)
+{
+    switch (scale) {
+        case SPECTROGRAM_SCALE_MEL:
+            return std::min(std::max(numFrequencies / 4, 64), 512);
+        case SPECTROGRAM_SCALE_LOG:
+            return std::min(std::max(numFrequencies / 2, 128), 2048);
+        case SPECTROGRAM_SCALE_CONSTANT_Q:
+            return std::max((int)std::ceil(kConstantQBandsPerOctave * log2(maxFrequency / kMinConstantQFrequency)), 1);
+        default:
+            return numFrequencies;
+    }
+}
+
+double getScalePosition(SpectrogramScale scale, double frequency, double maxFrequency)
+{
+    const double minWarped = getWarpedFrequency(scale, getMinFrequency(scale));
+    const double maxWarped = getWarpedFrequency(scale, maxFrequency);
+    return maxFrequency * (getWarpedFrequency(scale, frequency) - minWarped) / (maxWarped - minWarped);
+}
+
+double getScaleFrequency(SpectrogramScale scale, double position, double maxFrequency)
+{
+    const double minWarped = getWarpedFrequency(scale, getMinFrequency(scale));
+    const double maxWarped = getWarpedFrequency(scale, maxFrequency);
+    return getUnwarpedFrequency(scale, minWarped + (position / maxFrequency) * (maxWarped - minWarped));
+}
+
+Filterbank::Filterbank(SpectrogramScale scale, int numFrequencies, double maxFrequency)
+: m_numFrequencies(numFrequencies)
+, m_power(numFrequencies)
+{
+    const int numBands = getNumBands(scale, numFrequencies, maxFrequency);
+    const double spacing = maxFrequency / std::max(numFrequencies - 1, 1);
+    const int lastFrequency = numFrequencies - 1;
+
+    // Bands are stored highest first, as frequencies are in frames
+    for (int row = 0; row < numBands; row++) {
+        const int band = numBands - 1 - row;
+        const double lower = getScaleFrequency(scale, (band - 0.5) * maxFrequency / numBands, maxFrequency);
+        const double centre = getScaleFrequency(scale, (band + 0.5) * maxFrequency / numBands, maxFrequency);
+        const double upper = getScaleFrequency(scale, (band + 1.5) * maxFrequency / numBands, maxFrequency);
+        const size_t first = m_weights.size();
+        m_bandStarts.push_back((int)first);
+
+        if (upper - lower >= 2.0 * spacing) {
+            const int start = std::max((int)std::ceil(lower / spacing), 0);
+            const int end = std::min((int)std::floor(upper / spacing), lastFrequency);
+            for (int k = start; k <= end; k++) {
+                const double frequency = k * spacing;
+                const double weight = (frequency < centre ? (frequency - lower) / (centre - lower)
+                                                          : (upper - frequency) / (upper - centre));
+                if (weight > 0.0) {
+                    const Weight w = {lastFrequency - k, (float)weight};
+                    m_weights.push_back(w);
+                }
+            }
+        }
+        if (m_weights.size() == first) {
+            const double position = std::min(std::max(centre / spacing, 0.0), (double)lastFrequency);
+            const int k = std::min((int)position, lastFrequency);
+            const double t = position - k;
+            const Weight w0 = {lastFrequency - k, (float)(1.0 - t)};
+            m_weights.push_back(w0);
+            if (t > 0.0 && k < lastFrequency) {
+                const Weight w1 = {lastFrequency - k - 1, (float)t};
+                m_weights.push_back(w1);
+            }
+        }
+
+        // Each band is an average, so its level is comparable with that of the frequencies
+        float sum = 0.0f;
+        for (size_t i = first; i < m_weights.size(); i++) {
+            sum += m_weights[i].m_weight;
+        }
+        for (size_t i = first; i < m_weights.size(); i++) {
+            m_weights[i].m_weight /= sum;
+        }
+    }
+    m_bandStarts.push_back((int)m_weights.size());
+}
+
+int Filterbank::numBands() const
+{
+    return (int)m_bandStarts.size() - 1;
+}
+
+void Filterbank::apply(const uint8_t* pFrames, SpectrogramFormat format, int numFrames, uint8_t* pBands)
+{
+    const int numBands = this->numBands();
+    const size_t valueSize = getSpectrogramFormatSize(format);
+    m_bands.resize(numBands);
+    for (int b = 0; b < numFrames; b++) {
+        dequantizeSpectrogramValues(pFrames + (size_t)b * m_numFrequencies * valueSize, m_numFrequencies, format, m_power.data());
+        for (int f = 0; f < m_numFrequencies; f++) {
+            m_power[f] = std::exp(m_power[f] * kNepersPerDecibel);
+        }
+        for (int band = 0; band < numBands; band++) {
+            float power = 0.0f;
+            for (int i = m_bandStarts[band]; i < m_bandStarts[band + 1]; i++) {
+                power += m_weights[i].m_weight * m_power[m_weights[i].m_frequency];
+            }
+            m_bands[band] = std::log(std::max(power, kMinPower)) * kDecibelsPerNeper;
+        }
+        quantizeSpectrogramValues(m_bands.data(), numBands, format, pBands + (size_t)b * numBands * valueSize);
+    }
+}
+
+SpectrogramBands::SpectrogramBands(uint64_t maxBytes)
+: m_maxBytes(maxBytes)
+{
+}
+
+const uint8_t* SpectrogramBands::getBands(const SpectrogramBlockKey& key, uint64_t generation, const uint8_t* pFrames,
+                                          SpectrogramFormat format, int numFrequencies, int numBins, double maxFrequency,
+                                          int* pNumBands)
+{
+    Filterbank& filterbank = getFilterbank(key.m_scale, numFrequencies, maxFrequency);
+    const int numBands = filterbank.numBands();
+    const size_t valueSize = getSpectrogramFormatSize(format);
+
+    std::map<SpectrogramBlockKey, std::list<Block>::iterator>::iterator it = m_blockIndex.find(key);
+    if (it == m_blockIndex.end()) {
+        m_blocks.emplace_front();
+        m_blocks.front().m_key = key;
+        it = m_blockIndex.insert(std::make_pair(key, m_blocks.begin())).first;
+    }
+    else {
+        m_blocks.splice(m_blocks.begin(), m_blocks, it->second);
+    }
+
+    // Blocks computed with other settings are computed again from the start
+    Block& block = *it->second;
+    if (block.m_generation != generation || block.m_numFrequencies != numFrequencies || block.m_numBins > numBins) {
+        block.m_generation = generation;
+        block.m_numFrequencies = numFrequencies;
+        block.m_numBins = 0;
+    }
+    if (block.m_numBins < numBins) {
+        m_bytes -= block.m_bands.size();
+        block.m_bands.resize((size_t)numBands * numBins * valueSize);
+        m_bytes += block.m_bands.size();
+        filterbank.apply(pFrames + (size_t)block.m_numBins * numFrequencies * valueSize, format, numBins - block.m_numBins,
+                         &block.m_bands[(size_t)block.m_numBins * numBands * valueSize]);
+        block.m_numBins = numBins;
+    }
+    block.m_lastFrame = m_frame;
+
+    *pNumBands = numBands;
+    return block.m_bands.data();
+}
+
+void SpectrogramBands::endFrame()
+{
+    while (m_bytes > m_maxBytes && !m_blocks.empty() && m_blocks.back().m_lastFrame != m_frame) {
+        m_bytes -= m_blocks.back().m_bands.size();
+        m_blockIndex.erase(m_blocks.back().m_key);
+        m_blocks.pop_back();
+    }
+    m_frame++;
+}
+
+Filterbank& SpectrogramBands::getFilterbank(SpectrogramScale scale, int numFrequencies, double maxFrequency)
+{
+    if (maxFrequency != m_maxFrequency) {
+        m_filterbanks.clear();
+        m_maxFrequency = maxFrequency;
+    }
+    std::shared_ptr<Filterbank>& pFilterbank = m_filterbanks[std::make_pair((int)scale, numFrequencies)];
+    if (!pFilterbank) {
+        pFilterbank = std::make_shared<Filterbank>(scale, numFrequencies, maxFrequency);
+    }
+    return *pFilterbank;
+}
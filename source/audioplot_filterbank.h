@@ -0,0 +1,96 @@
+#ifndef AUDIOPLOT_FILTERBANK_H
+#define AUDIOPLOT_FILTERBANK_H
+
+#include <cstdint>
+#include <list>
+#include <map>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "audioplot_kiss_fft.h"
+
+// Position on a spectrogram's frequency axis of a frequency shown in a scale, and the
+// frequency at a position. The axis runs from 0 to maxFrequency whatever the scale, with
+// the bands of the scale evenly spaced along it.
+double getScalePosition(SpectrogramScale scale, double frequency, double maxFrequency);
+double getScaleFrequency(SpectrogramScale scale, double position, double maxFrequency);
+
+// Sparse matrix of weights averaging the power of the frequencies of an FFT frame into
+// bands evenly spaced in a scale, triangular over the frequencies between the centres
+// of the neighbouring bands, or interpolated between the two nearest frequencies for
+// bands narrower than the spacing of the frequencies
+class Filterbank
+{
+public:
+    Filterbank(SpectrogramScale scale, int numFrequencies, double maxFrequency);
+
+    int numBands() const;
+
+    // Write the level of each band of numFrames frames, highest frequency or band first,
+    // with frames and bands in format
+    void apply(const uint8_t* pFrames, SpectrogramFormat format, int numFrames, uint8_t* pBands);
+
+private:
+    Filterbank(const Filterbank&);
+    Filterbank& operator=(const Filterbank&);
+
+    struct Weight
+    {
+        int m_frequency;  // index into a frame
+        float m_weight;
+    };
+
+    int m_numFrequencies;
+    std::vector<int> m_bandStarts;  // into m_weights, for each band then the end
+    std::vector<Weight> m_weights;
+    std::vector<float> m_power;  // of a frame
+    std::vector<float> m_bands;  // dB levels of a frame
+};
+
+// Blocks of spectrogram frames in the bands of a scale, each computed when first drawn
+// and as frames are added to it, and kept until they take up more than maxBytes, so
+// switching back to a scale costs nothing once its blocks have been computed
+class SpectrogramBands
+{
+public:
+    explicit SpectrogramBands(uint64_t maxBytes);
+
+    // The frames of a block, numBins frames of numFrequencies values in format, in the
+    // bands of key.m_scale in the same format, with the number of bands each. Bands are
+    // computed only for frames added since the block was last drawn with this generation
+    // of settings.
+    const uint8_t* getBands(const SpectrogramBlockKey& key, uint64_t generation, const uint8_t* pFrames,
+                            SpectrogramFormat format, int numFrequencies, int numBins, double maxFrequency,
+                            int* pNumBands);
+
+    // Call once a frame, after drawing, to drop the blocks least recently drawn before
+    // this frame while they take up more than maxBytes
+    void endFrame();
+
+private:
+    SpectrogramBands(const SpectrogramBands&);
+    SpectrogramBands& operator=(const SpectrogramBands&);
+
+    struct Block
+    {
+        SpectrogramBlockKey m_key;
+        uint64_t m_generation = 0;
+        int m_numFrequencies = 0;
+        int m_numBins = 0;  // computed so far
+        uint64_t m_lastFrame = 0;
+        std::vector<uint8_t> m_bands;
+    };
+
+    Filterbank& getFilterbank(SpectrogramScale scale, int numFrequencies, double maxFrequency);
+
+    std::list<Block> m_blocks;  // most recently drawn first
+    std::map<SpectrogramBlockKey, std::list<Block>::iterator> m_blockIndex;
+    std::map<std::pair<int, int>, std::shared_ptr<Filterbank>> m_filterbanks;  // by scale and number of frequencies
+    double m_maxFrequency = 0.0;  // of the filterbanks
+    uint64_t m_maxBytes;
+    uint64_t m_bytes = 0;
+    uint64_t m_frame = 0;
+};
+
+#endif // AUDIOPLOT_FILTERBANK_H
@@ -0,0 +1,899 @@
+#include "audioplot_gl.h"
+
+#include "implot_internal.h"
+
+#include <GLFW/glfw3.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <string>
+
+#ifndef GL_ARRAY_BUFFER
+#define GL_ARRAY_BUFFER 0x8892
+#endif
+#ifndef GL_ELEMENT_ARRAY_BUFFER
+#define GL_ELEMENT_ARRAY_BUFFER 0x8893
+#endif
+#ifndef GL_STATIC_DRAW
+#define GL_STATIC_DRAW 0x88E4
+#endif
+#ifndef GL_CLAMP_TO_EDGE
+#define GL_CLAMP_TO_EDGE 0x812F
+#endif
+#ifndef GL_TEXTURE0
+#define GL_TEXTURE0 0x84C0
+#endif
+#ifndef GL_TEXTURE1
+#define GL_TEXTURE1 0x84C1
+#endif
+#ifndef GL_R8
+#define GL_R8 0x8229
+#endif
+#ifndef GL_R16
+#define GL_R16 0x822A
+#endif
+#ifndef GL_R32F
+#define GL_R32F 0x822E
+#endif
+#ifndef GL_FRAGMENT_SHADER
+#define GL_FRAGMENT_SHADER 0x8B30
+#endif
+#ifndef GL_VERTEX_SHADER
+#define GL_VERTEX_SHADER 0x8B31
+#endif
+#ifndef GL_COMPILE_STATUS
+#define GL_COMPILE_STATUS 0x8B81
+#endif
+#ifndef GL_LINK_STATUS
+#define GL_LINK_STATUS 0x8B82
+#endif
+#ifndef GL_CURRENT_PROGRAM
+#define GL_CURRENT_PROGRAM 0x8B8D
+#endif
+#ifndef GL_VERTEX_ARRAY_BINDING
+#define GL_VERTEX_ARRAY_BINDING 0x85B5
+#endif
+
+// Functions from after OpenGL 1.1, which have to be looked up at runtime as not every
+// platform exports them
+struct GlFunctions
+{
+    void (APIENTRY* ActiveTexture)(GLenum texture);
+    void (APIENTRY* AttachShader)(GLuint program, GLuint shader);
+    void (APIENTRY* BindAttribLocation)(GLuint program, GLuint index, const char* name);
+    void (APIENTRY* BindBuffer)(GLenum target, GLuint buffer);
+    void (APIENTRY* BindVertexArray)(GLuint array);
+    void (APIENTRY* BufferData)(GLenum target, ptrdiff_t size, const void* pData, GLenum usage);
+    void (APIENTRY* BufferSubData)(GLenum target, ptrdiff_t offset, ptrdiff_t size, const void* pData);
+    void (APIENTRY* CompileShader)(GLuint shader);
+    GLuint (APIENTRY* CreateProgram)();
+    GLuint (APIENTRY* CreateShader)(GLenum type);
+    void (APIENTRY* DeleteBuffers)(GLsizei count, const GLuint* pBuffers);
+    void (APIENTRY* DeleteProgram)(GLuint program);
+    void (APIENTRY* DeleteShader)(GLuint shader);
+    void (APIENTRY* DeleteVertexArrays)(GLsizei count, const GLuint* pArrays);
+    void (APIENTRY* EnableVertexAttribArray)(GLuint index);
+    void (APIENTRY* GenBuffers)(GLsizei count, GLuint* pBuffers);
+    void (APIENTRY* GenVertexArrays)(GLsizei count, GLuint* pArrays);
+    void (APIENTRY* GetProgramiv)(GLuint program, GLenum name, GLint* pParams);
+    void (APIENTRY* GetShaderiv)(GLuint shader, GLenum name, GLint* pParams);
+    GLint (APIENTRY* GetUniformLocation)(GLuint program, const char* name);
+    void (APIENTRY* GetUniformfv)(GLuint program, GLint location, GLfloat* pParams);
+    void (APIENTRY* LinkProgram)(GLuint program);
+    void (APIENTRY* ShaderSource)(GLuint shader, GLsizei count, const char* const* pStrings, const GLint* pLengths);
+    void (APIENTRY* Uniform1i)(GLint location, GLint value);
+    void (APIENTRY* Uniform2f)(GLint location, GLfloat value0, GLfloat value1);
+    void (APIENTRY* Uniform4f)(GLint location, GLfloat value0, GLfloat value1, GLfloat value2, GLfloat value3);
+    void (APIENTRY* UniformMatrix4fv)(GLint location, GLsizei count, GLboolean transpose, const GLfloat* pValues);
+    void (APIENTRY* UseProgram)(GLuint program);
+    void (APIENTRY* VertexAttribPointer)(GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const void* pOffset);
+};
+
+static GlFunctions g_gl;
+
+// The vertex attributes of ImDrawVert used by the shader, at fixed locations
+static const GLuint kPositionLocation = 0;
+static const GLuint kUvLocation = 1;
+
+static const char* kVertexShader =
+    "uniform mat4 ProjMtx;\n"
+    "in vec2 Position;\n"
+    "in vec2 UV;\n"
+    "out vec2 Frag_UV;\n"
+    "void main()\n"
+    "{\n"
+    "    Frag_UV = UV;\n"
+    "    gl_Position = ProjMtx * vec4(Position.xy, 0, 1);\n"
+    "}\n";
+
+// Each row of a texture is a frame, highest frequency first, so is drawn as a column. The
+// colormap is looked up as by ImPlot for a continuous colormap.
+static const char* kFragmentShader =
+    "uniform sampler2D Frames;\n"
+    "uniform sampler2D Colormap;\n"
+    "uniform vec2 Range;\n"  // scale and offset from a texel to 0 to 1 over the dB range
+    "in vec2 Frag_UV;\n"
+    "out vec4 Out_Color;\n"
+    "void main()\n"
+    "{\n"
+    "    float t = clamp(texture(Frames, Frag_UV.yx).r * Range.x + Range.y, 0.0, 1.0);\n"
+    "    int size = textureSize(Colormap, 0).x;\n"
+    "    Out_Color = texelFetch(Colormap, ivec2(int(float(size - 1) * t + 0.5), 0), 0);\n"
+    "}\n";
+
+// Each point of a waveform block is a value, placed at its index along the line
+static const GLuint kValueLocation = 0;
+
+static const char* kLineVertexShader =
+    "uniform mat4 ProjMtx;\n"
+    "uniform int First;\n"
+    "uniform vec4 Transform;\n"  // pixels a point, pixel of the first point, and pixels a value and at 0
+    "in float Value;\n"
+    "void main()\n"
+    "{\n"
+    "    vec2 position = vec2(float(gl_VertexID - First) * Transform.x + Transform.y, Value * Transform.z + Transform.w);\n"
+    "    gl_Position = ProjMtx * vec4(position, 0, 1);\n"
+    "}\n";
+
+static const char* kLineFragmentShader =
+    "uniform vec4 Color;\n"
+    "out vec4 Out_Color;\n"
+    "void main()\n"
+    "{\n"
+    "    Out_Color = Color;\n"
+    "}\n";
+
+// ImGui's own shader, for vertices kept from its draw lists
+static const GLuint kColorLocation = 2;
+
+static const char* kItemVertexShader =
+    "uniform mat4 ProjMtx;\n"
+    "in vec2 Position;\n"
+    "in vec2 UV;\n"
+    "in vec4 Color;\n"
+    "out vec2 Frag_UV;\n"
+    "out vec4 Frag_Color;\n"
+    "void main()\n"
+    "{\n"
+    "    Frag_UV = UV;\n"
+    "    Frag_Color = Color;\n"
+    "    gl_Position = ProjMtx * vec4(Position.xy, 0, 1);\n"
+    "}\n";
+
+static const char* kItemFragmentShader =
+    "uniform sampler2D Texture;\n"
+    "in vec2 Frag_UV;\n"
+    "in vec4 Frag_Color;\n"
+    "out vec4 Out_Color;\n"
+    "void main()\n"
+    "{\n"
+    "    Out_Color = Frag_Color * texture(Texture, Frag_UV.st);\n"
+    "}\n";
+
+template<typename T>
+static bool loadFunction(T* pFunction, const char* name)
+{
+    *pFunction = reinterpret_cast<T>(glfwGetProcAddress(name));
+    return (*pFunction != nullptr);
+}
+
+static bool loadGlFunctions()
+{
+    return loadFunction(&g_gl.ActiveTexture, "glActiveTexture") &&
+           loadFunction(&g_gl.AttachShader, "glAttachShader") &&
+           loadFunction(&g_gl.BindAttribLocation, "glBindAttribLocation") &&
+           loadFunction(&g_gl.BindBuffer, "glBindBuffer") &&
+           loadFunction(&g_gl.BindVertexArray, "glBindVertexArray") &&
+           loadFunction(&g_gl.BufferData, "glBufferData") &&
+           loadFunction(&g_gl.BufferSubData, "glBufferSubData") &&
+           loadFunction(&g_gl.CompileShader, "glCompileShader") &&
+           loadFunction(&g_gl.CreateProgram, "glCreateProgram") &&
+           loadFunction(&g_gl.CreateShader, "glCreateShader") &&
+           loadFunction(&g_gl.DeleteBuffers, "glDeleteBuffers") &&
+           loadFunction(&g_gl.DeleteProgram, "glDeleteProgram") &&
+           loadFunction(&g_gl.DeleteShader, "glDeleteShader") &&
+           loadFunction(&g_gl.DeleteVertexArrays, "glDeleteVertexArrays") &&
+           loadFunction(&g_gl.EnableVertexAttribArray, "glEnableVertexAttribArray") &&
+           loadFunction(&g_gl.GenBuffers, "glGenBuffers") &&
+           loadFunction(&g_gl.GenVertexArrays, "glGenVertexArrays") &&
+           loadFunction(&g_gl.GetProgramiv, "glGetProgramiv") &&
+           loadFunction(&g_gl.GetShaderiv, "glGetShaderiv") &&
+           loadFunction(&g_gl.GetUniformLocation, "glGetUniformLocation") &&
+           loadFunction(&g_gl.GetUniformfv, "glGetUniformfv") &&
+           loadFunction(&g_gl.LinkProgram, "glLinkProgram") &&
+           loadFunction(&g_gl.ShaderSource, "glShaderSource") &&
+           loadFunction(&g_gl.Uniform1i, "glUniform1i") &&
+           loadFunction(&g_gl.Uniform2f, "glUniform2f") &&
+           loadFunction(&g_gl.Uniform4f, "glUniform4f") &&
+           loadFunction(&g_gl.UniformMatrix4fv, "glUniformMatrix4fv") &&
+           loadFunction(&g_gl.UseProgram, "glUseProgram") &&
+           loadFunction(&g_gl.VertexAttribPointer, "glVertexAttribPointer");
+}
+
+static GLuint compileShader(GLenum type, const char* glslVersion, const char* source)
+{
+    const char* strings[3] = {glslVersion, "\n", source};
+    const GLuint shader = g_gl.CreateShader(type);
+    g_gl.ShaderSource(shader, 3, strings, NULL);
+    g_gl.CompileShader(shader);
+
+    GLint status = 0;
+    g_gl.GetShaderiv(shader, GL_COMPILE_STATUS, &status);
+    if (status == GL_FALSE) {
+        // std::cout << "Shader failed to compile\n";
+        g_gl.DeleteShader(shader);
+        return 0;
+    }
+    return shader;
+}
+
+// Link a program of two shaders, with vertex attribute i named attributes[i], or return 0
+static GLuint linkProgram(const char* glslVersion, const char* vertexSource, const char* fragmentSource,
+                          const char* const* attributes, int numAttributes)
+{
+    const GLuint vertexShader = compileShader(GL_VERTEX_SHADER, glslVersion, vertexSource);
+    const GLuint fragmentShader = compileShader(GL_FRAGMENT_SHADER, glslVersion, fragmentSource);
+    GLuint program = 0;
+    GLint status = GL_FALSE;
+    if (vertexShader != 0 && fragmentShader != 0) {
+        program = g_gl.CreateProgram();
+        g_gl.AttachShader(program, vertexShader);
+        g_gl.AttachShader(program, fragmentShader);
+        for (int i = 0; i < numAttributes; i++) {
+            g_gl.BindAttribLocation(program, (GLuint)i, attributes[i]);
+        }
+        g_gl.LinkProgram(program);
+        g_gl.GetProgramiv(program, GL_LINK_STATUS, &status);
+    }
+    if (vertexShader != 0) {
+        g_gl.DeleteShader(vertexShader);
+    }
+    if (fragmentShader != 0) {
+        g_gl.DeleteShader(fragmentShader);
+    }
+    if (status == GL_FALSE && program != 0) {
+        g_gl.DeleteProgram(program);
+        program = 0;
+    }
+    return program;
+}
+
+// The projection differs between viewports, so is taken from ImGui's shader
+static void getImGuiProjection(GLfloat* pProjection)
+{
+    GLint program = 0;
+    glGetIntegerv(GL_CURRENT_PROGRAM, &program);
+    g_gl.GetUniformfv((GLuint)program, g_gl.GetUniformLocation((GLuint)program, "ProjMtx"), pProjection);
+}
+
+// ImGui sets the scissor rectangle for its own commands only, so a callback drawing in place
+// of one sets it from the command's clip rectangle, by way of ImGui's projection and the
+// framebuffer it renders to. Returns false if none of the rectangle is visible.
+static bool setScissor(const ImDrawCmd* pCmd, const GLfloat* pProjection)
+{
+    GLint viewport[4] = {};
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    const float displayX = (-1.0f - pProjection[12]) / pProjection[0];
+    const float displayY = (1.0f - pProjection[13]) / pProjection[5];
+    const float scaleX = viewport[2] * pProjection[0] / 2.0f;
+    const float scaleY = viewport[3] * -pProjection[5] / 2.0f;
+    const ImVec4& clip = pCmd->ClipRect;
+    const GLint clipMinX = (GLint)((clip.x - displayX) * scaleX);
+    const GLint clipMaxX = (GLint)((clip.z - displayX) * scaleX);
+    const GLint clipMinY = (GLint)((clip.y - displayY) * scaleY);
+    const GLint clipMaxY = (GLint)((clip.w - displayY) * scaleY);
+    if (clipMaxX <= clipMinX || clipMaxY <= clipMinY) {
+        return false;
+    }
+    glScissor(clipMinX, viewport[3] - clipMaxY, clipMaxX - clipMinX, clipMaxY - clipMinY);
+    return true;
+}
+
+SpectrogramTextures::SpectrogramTextures()
+{
+}
+
+bool SpectrogramTextures::initialize(const char* glslVersion, uint64_t maxBytes)
+{
+    shutdown();
+    if (!loadGlFunctions()) {
+        return false;
+    }
+
+    const char* const attributes[] = {"Position", "UV"};  // at kPositionLocation and kUvLocation
+    m_program = linkProgram(glslVersion, kVertexShader, kFragmentShader, attributes, 2);
+    if (m_program == 0) {
+        return false;
+    }
+
+    m_projectionLocation = g_gl.GetUniformLocation(m_program, "ProjMtx");
+    m_rangeLocation = g_gl.GetUniformLocation(m_program, "Range");
+    GLint lastProgram = 0;
+    glGetIntegerv(GL_CURRENT_PROGRAM, &lastProgram);
+    g_gl.UseProgram(m_program);
+    g_gl.Uniform1i(g_gl.GetUniformLocation(m_program, "Frames"), 0);
+    g_gl.Uniform1i(g_gl.GetUniformLocation(m_program, "Colormap"), 1);
+    g_gl.UseProgram((GLuint)lastProgram);
+
+    GLint maxTextureSize = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize);
+    m_maxTextureSize = maxTextureSize;
+    m_maxBytes = maxBytes;
+    m_bInitialized = true;
+    return true;
+}
+
+void SpectrogramTextures::shutdown()
+{
+    for (std::map<SpectrogramBlockKey, Texture>::iterator it = m_textures.begin(); it != m_textures.end(); ++it) {
+        deleteTexture(it->second);
+    }
+    m_textures.clear();
+    if (m_colormapTexture != 0) {
+        glDeleteTextures(1, &m_colormapTexture);
+        m_colormapTexture = 0;
+        m_colormap = -1;
+    }
+    if (m_program != 0) {
+        g_gl.DeleteProgram(m_program);
+        m_program = 0;
+    }
+    m_bInitialized = false;
+}
+
+// Quantized values are uploaded as they are, to normalized integer textures
+static void getTextureFormat(SpectrogramFormat format, GLint* pInternalFormat, GLenum* pType)
+{
+    switch (format) {
+        case SPECTROGRAM_FORMAT_U16:
+            *pInternalFormat = GL_R16;
+            *pType = GL_UNSIGNED_SHORT;
+            break;
+        case SPECTROGRAM_FORMAT_U8:
+            *pInternalFormat = GL_R8;
+            *pType = GL_UNSIGNED_BYTE;
+            break;
+        default:
+            *pInternalFormat = GL_R32F;
+            *pType = GL_FLOAT;
+            break;
+    }
+}
+
+bool SpectrogramTextures::draw(const SpectrogramBlockKey& key, uint64_t generation, const uint8_t* pFrames,
+                               SpectrogramFormat format, int numFrequencies, int numBins, int blockBins,
+                               const ImPlotPoint& boundsMin, const ImPlotPoint& boundsMax, double minDb, double maxDb)
+{
+    if (!m_bInitialized || numFrequencies > m_maxTextureSize || blockBins > m_maxTextureSize ||
+        numBins <= 0 || numBins > blockBins) {
+        return false;
+    }
+    updateColormap();
+
+    // A texture is made again when the settings change, and otherwise only added to
+    Texture& texture = m_textures[key];
+    GLint internalFormat = GL_R32F;
+    GLenum type = GL_FLOAT;
+    getTextureFormat(format, &internalFormat, &type);
+    const int valueSize = (int)getSpectrogramFormatSize(format);
+    if (texture.m_texture == 0 || texture.m_generation != generation || texture.m_numFrequencies != numFrequencies ||
+        texture.m_blockBins != blockBins || texture.m_numBins > numBins || texture.m_format != format) {
+        deleteTexture(texture);
+        glGenTextures(1, &texture.m_texture);
+        glBindTexture(GL_TEXTURE_2D, texture.m_texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, numFrequencies, blockBins, 0, GL_RED, type, NULL);
+        texture.m_pTextures = this;
+        texture.m_generation = generation;
+        texture.m_format = format;
+        texture.m_numFrequencies = numFrequencies;
+        texture.m_blockBins = blockBins;
+        texture.m_numBins = 0;
+        m_bytes += getTextureBytes(texture);
+    }
+    if (texture.m_numBins < numBins) {
+        // Rows of quantized values needn't be a multiple of 4 bytes long
+        glBindTexture(GL_TEXTURE_2D, texture.m_texture);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, valueSize);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, texture.m_numBins, numFrequencies, numBins - texture.m_numBins,
+                        GL_RED, type, pFrames + ((size_t)texture.m_numBins * numFrequencies * valueSize));
+        texture.m_numBins = numBins;
+    }
+    texture.m_lastFrame = m_frame;
+
+    // The shader is used for the image alone, then ImGui's is restored
+    m_minDb = (float)minDb;
+    m_maxDb = (float)maxDb;
+    ImDrawList* pDrawList = ImPlot::GetPlotDrawList();
+    pDrawList->AddCallback(&SpectrogramTextures::setupRenderState, &texture);
+    ImPlot::PlotImage("", (ImTextureID)(intptr_t)texture.m_texture, boundsMin, boundsMax,
+                      ImVec2(0.0f, 0.0f), ImVec2((float)numBins / (float)blockBins, 1.0f));
+    pDrawList->AddCallback(ImDrawCallback_ResetRenderState, NULL);
+    return true;
+}
+
+void SpectrogramTextures::endFrame()
+{
+    while (m_bytes > m_maxBytes) {
+        std::map<SpectrogramBlockKey, Texture>::iterator oldest = m_textures.end();
+        for (std::map<SpectrogramBlockKey, Texture>::iterator it = m_textures.begin(); it != m_textures.end(); ++it) {
+            if (it->second.m_lastFrame < m_frame &&
+                (oldest == m_textures.end() || it->second.m_lastFrame < oldest->second.m_lastFrame)) {
+                oldest = it;
+            }
+        }
+        if (oldest == m_textures.end()) {
+            break;
+        }
+        deleteTexture(oldest->second);
+        m_textures.erase(oldest);
+    }
+    m_frame++;
+}
+
+// Called by the renderer just before the image of a texture is drawn, with ImGui's shader
+// current. Textures drawn in a frame are kept until it has been rendered.
+void SpectrogramTextures::setupRenderState(const ImDrawList* pDrawList, const ImDrawCmd* pCmd)
+{
+    (void)pDrawList;
+    const Texture* pTexture = (const Texture*)pCmd->UserCallbackData;
+    const SpectrogramTextures* pTextures = pTexture->m_pTextures;
+
+    // Normalized textures hold value / maximum value, and float textures dB
+    const float offset = getSpectrogramFormatOffset(pTexture->m_format);
+    const uint32_t valueSize = getSpectrogramFormatSize(pTexture->m_format);
+    const float texelScale = (pTexture->m_format == SPECTROGRAM_FORMAT_F32 ? 1.0f :
+                              getSpectrogramFormatStep(pTexture->m_format) * (float)((1u << (8 * valueSize)) - 1));
+    const float rangeScale = 1.0f / (pTextures->m_maxDb - pTextures->m_minDb);
+
+    GLfloat projection[16] = {};
+    getImGuiProjection(projection);
+
+    g_gl.UseProgram(pTextures->m_program);
+    g_gl.UniformMatrix4fv(pTextures->m_projectionLocation, 1, GL_FALSE, projection);
+    g_gl.Uniform2f(pTextures->m_rangeLocation, texelScale * rangeScale, (offset - pTextures->m_minDb) * rangeScale);
+    g_gl.EnableVertexAttribArray(kPositionLocation);
+    g_gl.EnableVertexAttribArray(kUvLocation);
+    g_gl.VertexAttribPointer(kPositionLocation, 2, GL_FLOAT, GL_FALSE, sizeof(ImDrawVert), (const void*)offsetof(ImDrawVert, pos));
+    g_gl.VertexAttribPointer(kUvLocation, 2, GL_FLOAT, GL_FALSE, sizeof(ImDrawVert), (const void*)offsetof(ImDrawVert, uv));
+    g_gl.ActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, pTextures->m_colormapTexture);
+    g_gl.ActiveTexture(GL_TEXTURE0);
+}
+
+// Keep a copy of the table of the current colormap, which ImPlot samples for heatmaps
+void SpectrogramTextures::updateColormap()
+{
+    const ImPlotColormap colormap = ImPlot::GetStyle().Colormap;
+    if (colormap == m_colormap) {
+        return;
+    }
+    if (m_colormapTexture == 0) {
+        glGenTextures(1, &m_colormapTexture);
+    }
+    const ImPlotColormapData& colormapData = ImPlot::GetCurrentContext()->ColormapData;
+    glBindTexture(GL_TEXTURE_2D, m_colormapTexture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, colormapData.GetTableSize(colormap), 1, 0, GL_RGBA, GL_UNSIGNED_BYTE,
+                 colormapData.GetTable(colormap));
+    m_colormap = colormap;
+}
+
+void SpectrogramTextures::deleteTexture(Texture& texture)
+{
+    if (texture.m_texture != 0) {
+        glDeleteTextures(1, &texture.m_texture);
+        texture.m_texture = 0;
+        m_bytes -= getTextureBytes(texture);
+    }
+}
+
+uint64_t SpectrogramTextures::getTextureBytes(const Texture& texture)
+{
+    return (uint64_t)texture.m_numFrequencies * texture.m_blockBins * getSpectrogramFormatSize(texture.m_format);
+}
+
+WaveformBuffers::WaveformBuffers()
+{
+}
+
+bool WaveformBuffers::initialize(const char* glslVersion, uint64_t maxBytes)
+{
+    shutdown();
+    if (!loadGlFunctions()) {
+        return false;
+    }
+
+    const char* const attributes[] = {"Value"};  // at kValueLocation
+    m_program = linkProgram(glslVersion, kLineVertexShader, kLineFragmentShader, attributes, 1);
+    if (m_program == 0) {
+        return false;
+    }
+
+    m_projectionLocation = g_gl.GetUniformLocation(m_program, "ProjMtx");
+    m_firstLocation = g_gl.GetUniformLocation(m_program, "First");
+    m_transformLocation = g_gl.GetUniformLocation(m_program, "Transform");
+    m_colorLocation = g_gl.GetUniformLocation(m_program, "Color");
+    g_gl.GenVertexArrays(1, &m_vertexArray);
+    m_maxBytes = maxBytes;
+    m_bInitialized = true;
+    return true;
+}
+
+void WaveformBuffers::shutdown()
+{
+    for (std::map<WaveformBlockKey, Block>::iterator it = m_blocks.begin(); it != m_blocks.end(); ++it) {
+        deleteBlock(it->second);
+    }
+    m_blocks.clear();
+    m_lines.clear();
+    if (m_vertexArray != 0) {
+        g_gl.DeleteVertexArrays(1, &m_vertexArray);
+        m_vertexArray = 0;
+    }
+    if (m_program != 0) {
+        g_gl.DeleteProgram(m_program);
+        m_program = 0;
+    }
+    m_bInitialized = false;
+}
+
+bool WaveformBuffers::draw(const char* label, int32_t trace, int32_t level, const SampleView& points, uint64_t numPoints,
+                           uint64_t startIdx, uint64_t endIdx, double pointTime, double yScale, double yOffset)
+{
+    if (!m_bInitialized) {
+        return false;
+    }
+    if (m_linesFrame != m_frame) {
+        m_lines.clear();
+        m_linesFrame = m_frame;
+    }
+
+    // An item hidden from the legend is drawn as nothing
+    if (!ImPlot::BeginItem(label, 0, ImPlotCol_Line)) {
+        return true;
+    }
+    endIdx = std::min(endIdx, numPoints);
+    if (ImPlot::FitThisFrame() && endIdx > startIdx) {
+        ImPlot::FitPointX(startIdx * pointTime);
+        ImPlot::FitPointX((endIdx - 1) * pointTime);
+    }
+
+    const ImPlotRect limits = ImPlot::GetPlotLimits();
+    const ImVec2 plotPos = ImPlot::GetPlotPos();
+    const ImVec2 plotSize = ImPlot::GetPlotSize();
+    const double xPixels = plotSize.x / limits.X.Size();
+    const double yPixels = plotSize.y / limits.Y.Size();
+    const ImVec4 color = ImPlot::GetItemData().Colors[ImPlotCol_Line];
+    ImDrawList* pDrawList = ImPlot::GetPlotDrawList();
+    for (uint64_t index = startIdx / kWaveformBlockPoints; index * kWaveformBlockPoints + 1 < endIdx; index++) {
+        const uint64_t blockStart = index * kWaveformBlockPoints;
+        const uint64_t blockPoints = std::min(numPoints - blockStart, kWaveformBlockPoints + 1);
+        const WaveformBlockKey key = {trace, level, index};
+        Block& block = m_blocks[key];
+        if (block.m_buffer == 0) {
+            g_gl.GenBuffers(1, &block.m_buffer);
+            g_gl.BindBuffer(GL_ARRAY_BUFFER, block.m_buffer);
+            g_gl.BufferData(GL_ARRAY_BUFFER, (kWaveformBlockPoints + 1) * sizeof(float), NULL, GL_STATIC_DRAW);
+            m_bytes += (kWaveformBlockPoints + 1) * sizeof(float);
+        }
+
+        // Points are only added to a level once they're published, so only new ones are uploaded
+        if (block.m_numPoints < blockPoints) {
+            m_points.resize(blockPoints - block.m_numPoints);
+            points.read(blockStart + block.m_numPoints, m_points.size(), m_points.data());
+            g_gl.BindBuffer(GL_ARRAY_BUFFER, block.m_buffer);
+            g_gl.BufferSubData(GL_ARRAY_BUFFER, block.m_numPoints * sizeof(float), m_points.size() * sizeof(float), m_points.data());
+            block.m_numPoints = blockPoints;
+        }
+        block.m_lastFrame = m_frame;
+
+        const uint64_t first = std::max(startIdx, blockStart) - blockStart;
+        const uint64_t end = std::min(endIdx, blockStart + blockPoints) - blockStart;
+        if (end < first + 2) {
+            continue;
+        }
+
+        // Positions are relative to the first point drawn, so stay exact however far into the file it is
+        Line line;
+        line.m_pBuffers = this;
+        line.m_buffer = block.m_buffer;
+        line.m_first = (int32_t)first;
+        line.m_count = (int32_t)(end - first);
+        line.m_transform[0] = (float)(pointTime * xPixels);
+        line.m_transform[1] = (float)(plotPos.x + (((blockStart + first) * pointTime) - limits.X.Min) * xPixels);
+        line.m_transform[2] = (float)(-yScale * yPixels);
+        line.m_transform[3] = (float)(plotPos.y + (limits.Y.Max - yOffset) * yPixels);
+        line.m_color[0] = color.x;
+        line.m_color[1] = color.y;
+        line.m_color[2] = color.z;
+        line.m_color[3] = color.w;
+        m_lines.push_back(line);
+        pDrawList->AddCallback(&WaveformBuffers::drawLine, &m_lines.back());
+    }
+    pDrawList->AddCallback(ImDrawCallback_ResetRenderState, NULL);
+    ImPlot::EndItem();
+    return true;
+}
+
+void WaveformBuffers::endFrame()
+{
+    while (m_bytes > m_maxBytes) {
+        std::map<WaveformBlockKey, Block>::iterator oldest = m_blocks.end();
+        for (std::map<WaveformBlockKey, Block>::iterator it = m_blocks.begin(); it != m_blocks.end(); ++it) {
+            if (it->second.m_lastFrame < m_frame &&
+                (oldest == m_blocks.end() || it->second.m_lastFrame < oldest->second.m_lastFrame)) {
+                oldest = it;
+            }
+        }
+        if (oldest == m_blocks.end()) {
+            break;
+        }
+        deleteBlock(oldest->second);
+        m_blocks.erase(oldest);
+    }
+    m_frame++;
+}
+
+// Called by the renderer in place of a draw command, with ImGui's shader current
+void WaveformBuffers::drawLine(const ImDrawList* pDrawList, const ImDrawCmd* pCmd)
+{
+    (void)pDrawList;
+    const Line* pLine = (const Line*)pCmd->UserCallbackData;
+    const WaveformBuffers* pBuffers = pLine->m_pBuffers;
+
+    GLfloat projection[16] = {};
+    getImGuiProjection(projection);
+    if (!setScissor(pCmd, projection)) {
+        return;
+    }
+
+    g_gl.UseProgram(pBuffers->m_program);
+    g_gl.UniformMatrix4fv(pBuffers->m_projectionLocation, 1, GL_FALSE, projection);
+    g_gl.Uniform1i(pBuffers->m_firstLocation, pLine->m_first);
+    g_gl.Uniform4f(pBuffers->m_transformLocation, pLine->m_transform[0], pLine->m_transform[1],
+                   pLine->m_transform[2], pLine->m_transform[3]);
+    g_gl.Uniform4f(pBuffers->m_colorLocation, pLine->m_color[0], pLine->m_color[1], pLine->m_color[2], pLine->m_color[3]);
+    g_gl.BindVertexArray(pBuffers->m_vertexArray);
+    g_gl.BindBuffer(GL_ARRAY_BUFFER, pLine->m_buffer);
+    g_gl.EnableVertexAttribArray(kValueLocation);
+    g_gl.VertexAttribPointer(kValueLocation, 1, GL_FLOAT, GL_FALSE, sizeof(float), (const void*)0);
+    glDrawArrays(GL_LINE_STRIP, pLine->m_first, pLine->m_count);
+}
+
+void WaveformBuffers::deleteBlock(Block& block)
+{
+    if (block.m_buffer != 0) {
+        g_gl.DeleteBuffers(1, &block.m_buffer);
+        block.m_buffer = 0;
+        m_bytes -= (kWaveformBlockPoints + 1) * sizeof(float);
+    }
+}
+
+PlotItemBuffers::PlotItemBuffers()
+{
+}
+
+bool PlotItemBuffers::initialize(const char* glslVersion)
+{
+    shutdown();
+    if (!loadGlFunctions()) {
+        return false;
+    }
+
+    const char* const attributes[] = {"Position", "UV", "Color"};  // at kPositionLocation, kUvLocation and kColorLocation
+    m_program = linkProgram(glslVersion, kItemVertexShader, kItemFragmentShader, attributes, 3);
+    if (m_program == 0) {
+        return false;
+    }
+
+    m_projectionLocation = g_gl.GetUniformLocation(m_program, "ProjMtx");
+    GLint lastProgram = 0;
+    glGetIntegerv(GL_CURRENT_PROGRAM, &lastProgram);
+    g_gl.UseProgram(m_program);
+    g_gl.Uniform1i(g_gl.GetUniformLocation(m_program, "Texture"), 0);
+    g_gl.UseProgram((GLuint)lastProgram);
+    m_bInitialized = true;
+    return true;
+}
+
+void PlotItemBuffers::shutdown()
+{
+    for (std::map<int32_t, Item>::iterator it = m_items.begin(); it != m_items.end(); ++it) {
+        deleteItem(it->second);
+    }
+    m_items.clear();
+    if (m_program != 0) {
+        g_gl.DeleteProgram(m_program);
+        m_program = 0;
+    }
+    m_bInitialized = false;
+}
+
+bool PlotItemBuffers::PlotState::operator==(const PlotState& other) const
+{
+    return (m_pos.x == other.m_pos.x) && (m_pos.y == other.m_pos.y) &&
+           (m_size.x == other.m_size.x) && (m_size.y == other.m_size.y) &&
+           (m_limits.X.Min == other.m_limits.X.Min) && (m_limits.X.Max == other.m_limits.X.Max) &&
+           (m_limits.Y.Min == other.m_limits.Y.Min) && (m_limits.Y.Max == other.m_limits.Y.Max) &&
+           (m_color.x == other.m_color.x) && (m_color.y == other.m_color.y) &&
+           (m_color.z == other.m_color.z) && (m_color.w == other.m_color.w) &&
+           (m_lineWeight == other.m_lineWeight) && (m_marker == other.m_marker) &&
+           (m_markerSize == other.m_markerSize) && (m_markerWeight == other.m_markerWeight) &&
+           (m_bHovered == other.m_bHovered) && (m_bHidden == other.m_bHidden);
+}
+
+PlotItemBuffers::PlotState PlotItemBuffers::getPlotState(const char* label)
+{
+    const ImPlotStyle& style = ImPlot::GetStyle();
+    const ImPlotItem* pItem = ImPlot::GetItem(label);
+    PlotState state;
+    state.m_pos = ImPlot::GetPlotPos();
+    state.m_size = ImPlot::GetPlotSize();
+    state.m_limits = ImPlot::GetPlotLimits();
+    state.m_color = style.Colors[ImPlotCol_Line];
+    state.m_lineWeight = style.LineWeight;
+    state.m_marker = style.Marker;
+    state.m_markerSize = style.MarkerSize;
+    state.m_markerWeight = style.MarkerWeight;
+    state.m_bHovered = (pItem != nullptr) && pItem->LegendHovered;
+    state.m_bHidden = (pItem != nullptr) && !pItem->Show;
+    return state;
+}
+
+bool PlotItemBuffers::draw(int32_t id, const char* label, const PlotItemKey& key)
+{
+    // Fitting the plot to its items needs their points
+    if (!m_bInitialized || ImPlot::FitThisFrame()) {
+        return false;
+    }
+
+    std::map<int32_t, Item>::iterator it = m_items.find(id);
+    if (it == m_items.end() || !it->second.m_bKept) {
+        return false;
+    }
+    Item& item = it->second;
+    if (!(item.m_key == key) || !(item.m_state == getPlotState(label))) {
+        return false;
+    }
+    item.m_lastFrame = m_frame;
+    m_numDrawnFrame++;
+
+    // Still adds the item to the legend, and clips it to the plot
+    if (!ImPlot::BeginItem(label, 0, ImPlotCol_Line)) {
+        return true;
+    }
+    if (item.m_numIndices > 0) {
+        ImDrawList* pDrawList = ImPlot::GetPlotDrawList();
+        pDrawList->AddCallback(&PlotItemBuffers::drawItem, &item);
+        pDrawList->AddCallback(ImDrawCallback_ResetRenderState, NULL);
+    }
+    ImPlot::EndItem();
+    return true;
+}
+
+void PlotItemBuffers::beginCapture(const char* label)
+{
+    m_captureState = getPlotState(label);
+    m_pCaptureDrawList = ImPlot::GetPlotDrawList();
+    m_captureVtxStart = m_pCaptureDrawList->VtxBuffer.Size;
+    m_captureIdxStart = m_pCaptureDrawList->IdxBuffer.Size;
+    m_captureVtxIdx = m_pCaptureDrawList->_VtxCurrentIdx;
+    m_captureVtxOffset = m_pCaptureDrawList->_CmdHeader.VtxOffset;
+}
+
+void PlotItemBuffers::endCapture(int32_t id, const PlotItemKey& key)
+{
+    // Items that change every frame, e.g. while panning, are never uploaded
+    std::pair<std::map<int32_t, Item>::iterator, bool> inserted = m_items.insert(std::make_pair(id, Item()));
+    Item& item = inserted.first->second;
+    const bool bSame = !inserted.second && (item.m_lastFrame + 1 == m_frame) &&
+                       (item.m_key == key) && (item.m_state == m_captureState);
+    deleteItem(item);
+    item.m_pBuffers = this;
+    item.m_key = key;
+    item.m_state = m_captureState;
+    item.m_lastFrame = m_frame;
+
+    // With 16-bit indices, the draw list may have moved on to a new vertex offset part way
+    const ImDrawList& drawList = *m_pCaptureDrawList;
+    if (!bSame || !m_bInitialized || (drawList._CmdHeader.VtxOffset != m_captureVtxOffset)) {
+        return;
+    }
+
+    const int numVertices = drawList.VtxBuffer.Size - m_captureVtxStart;
+    const int numIndices = drawList.IdxBuffer.Size - m_captureIdxStart;
+    if (numIndices > 0) {
+        m_indices.resize(numIndices);
+        for (int i = 0; i < numIndices; i++) {
+            m_indices[i] = drawList.IdxBuffer[m_captureIdxStart + i] - m_captureVtxIdx;
+        }
+
+        GLint lastVertexArray = 0;
+        glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &lastVertexArray);
+        g_gl.GenVertexArrays(1, &item.m_vertexArray);
+        g_gl.BindVertexArray(item.m_vertexArray);
+        g_gl.GenBuffers(1, &item.m_vertexBuffer);
+        g_gl.BindBuffer(GL_ARRAY_BUFFER, item.m_vertexBuffer);
+        g_gl.BufferData(GL_ARRAY_BUFFER, numVertices * sizeof(ImDrawVert), &drawList.VtxBuffer[m_captureVtxStart], GL_STATIC_DRAW);
+        g_gl.EnableVertexAttribArray(kPositionLocation);
+        g_gl.EnableVertexAttribArray(kUvLocation);
+        g_gl.EnableVertexAttribArray(kColorLocation);
+        g_gl.VertexAttribPointer(kPositionLocation, 2, GL_FLOAT, GL_FALSE, sizeof(ImDrawVert), (const void*)offsetof(ImDrawVert, pos));
+        g_gl.VertexAttribPointer(kUvLocation, 2, GL_FLOAT, GL_FALSE, sizeof(ImDrawVert), (const void*)offsetof(ImDrawVert, uv));
+        g_gl.VertexAttribPointer(kColorLocation, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(ImDrawVert), (const void*)offsetof(ImDrawVert, col));
+        g_gl.GenBuffers(1, &item.m_indexBuffer);
+        g_gl.BindBuffer(GL_ELEMENT_ARRAY_BUFFER, item.m_indexBuffer);
+        g_gl.BufferData(GL_ELEMENT_ARRAY_BUFFER, numIndices * sizeof(uint32_t), m_indices.data(), GL_STATIC_DRAW);
+        g_gl.BindVertexArray((GLuint)lastVertexArray);
+
+        item.m_numIndices = numIndices;
+        item.m_texture = drawList._CmdHeader.TextureId;
+        item.m_bytes = (numVertices * sizeof(ImDrawVert)) + (numIndices * sizeof(uint32_t));
+        m_bytes += item.m_bytes;
+    }
+    item.m_bKept = true;
+}
+
+void PlotItemBuffers::endFrame()
+{
+    for (std::map<int32_t, Item>::iterator it = m_items.begin(); it != m_items.end();) {
+        if (it->second.m_lastFrame != m_frame) {
+            deleteItem(it->second);
+            it = m_items.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+    m_numDrawn = m_numDrawnFrame;
+    m_numDrawnFrame = 0;
+    m_frame++;
+}
+
+// Called by the renderer in place of a draw command, with its blending already set up
+void PlotItemBuffers::drawItem(const ImDrawList* pDrawList, const ImDrawCmd* pCmd)
+{
+    (void)pDrawList;
+    const Item* pItem = (const Item*)pCmd->UserCallbackData;
+
+    GLfloat projection[16] = {};
+    getImGuiProjection(projection);
+    if (!setScissor(pCmd, projection)) {
+        return;
+    }
+
+    g_gl.UseProgram(pItem->m_pBuffers->m_program);
+    g_gl.UniformMatrix4fv(pItem->m_pBuffers->m_projectionLocation, 1, GL_FALSE, projection);
+    g_gl.ActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, (GLuint)(intptr_t)pItem->m_texture);
+    g_gl.BindVertexArray(pItem->m_vertexArray);
+    glDrawElements(GL_TRIANGLES, pItem->m_numIndices, GL_UNSIGNED_INT, (const void*)0);
+}
+
+void PlotItemBuffers::deleteItem(Item& item)
+{
+    if (item.m_vertexArray != 0) {
+        g_gl.DeleteVertexArrays(1, &item.m_vertexArray);
+        item.m_vertexArray = 0;
+    }
+    if (item.m_vertexBuffer != 0) {
+        g_gl.DeleteBuffers(1, &item.m_vertexBuffer);
+        item.m_vertexBuffer = 0;
+    }
+    if (item.m_indexBuffer != 0) {
+        g_gl.DeleteBuffers(1, &item.m_indexBuffer);
+        item.m_indexBuffer = 0;
+    }
+    m_bytes -= item.m_bytes;
+    item.m_bytes = 0;
+    item.m_numIndices = 0;
+    item.m_bKept = false;
+}
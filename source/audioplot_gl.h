@@ -0,0 +1,267 @@
+#ifndef AUDIOPLOT_GL_H
+#define AUDIOPLOT_GL_H
+
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <vector>
+
+#include "imgui.h"
+#include "implot.h"
+
+#include "audioplot_kiss_fft.h"
+#include "audioplot_samples.h"
+
+// Blocks of spectrogram frames kept in OpenGL float textures, each drawn as one quad with
+// a shader that looks up the colormap, where PlotHeatmap draws a rectangle per value.
+// Frames are uploaded once, so only frames added to a block or a change of settings
+// cause an upload, and changing the dB range needs none.
+class SpectrogramTextures
+{
+public:
+    SpectrogramTextures();
+
+    // Build the shader, with the OpenGL context current and ImGui's GLSL version, keeping
+    // up to maxBytes of textures. Returns false if it can't be, and then draw() always fails.
+    bool initialize(const char* glslVersion, uint64_t maxBytes);
+    void shutdown();
+
+    // Draw numBins frames of numFrequencies values in format each, the first frames of a
+    // block of blockBins, between boundsMin and boundsMax of the current plot. Frames are
+    // uploaded as they are stored, only if the block hasn't been uploaded with this
+    // generation of settings, or has fewer frames. Returns false if they can't be drawn this
+    // way, e.g. if there are more frequencies than fit in a texture.
+    bool draw(const SpectrogramBlockKey& key, uint64_t generation, const uint8_t* pFrames, SpectrogramFormat format,
+              int numFrequencies, int numBins, int blockBins, const ImPlotPoint& boundsMin,
+              const ImPlotPoint& boundsMax, double minDb, double maxDb);
+
+    // Call once a frame, after drawing, to delete the textures least recently drawn before
+    // this frame while they take up more than maxBytes
+    void endFrame();
+
+private:
+    SpectrogramTextures(const SpectrogramTextures&);
+    SpectrogramTextures& operator=(const SpectrogramTextures&);
+
+    struct Texture
+    {
+        const SpectrogramTextures* m_pTextures = nullptr;  // for drawing it
+        uint32_t m_texture = 0;
+        uint64_t m_generation = 0;
+        SpectrogramFormat m_format = SPECTROGRAM_FORMAT_F32;
+        int m_numFrequencies = 0;
+        int m_blockBins = 0;
+        int m_numBins = 0;         // uploaded so far
+        uint64_t m_lastFrame = 0;  // drawn
+    };
+
+    static void setupRenderState(const ImDrawList* pDrawList, const ImDrawCmd* pCmd);
+    static uint64_t getTextureBytes(const Texture& texture);
+    void updateColormap();
+    void deleteTexture(Texture& texture);
+
+    bool m_bInitialized = false;
+    uint32_t m_program = 0;
+    int32_t m_projectionLocation = -1;
+    int32_t m_rangeLocation = -1;
+    int32_t m_maxTextureSize = 0;
+    uint32_t m_colormapTexture = 0;
+    ImPlotColormap m_colormap = -1;
+    float m_minDb = 0.0f;
+    float m_maxDb = 1.0f;
+    std::map<SpectrogramBlockKey, Texture> m_textures;
+    uint64_t m_maxBytes = 0;
+    uint64_t m_bytes = 0;
+    uint64_t m_frame = 0;
+};
+
+const uint64_t kWaveformBlockPoints = 1 << 16;
+
+struct WaveformBlockKey
+{
+    int32_t m_trace;
+    int32_t m_level;
+    uint64_t m_index;
+
+    bool operator<(const WaveformBlockKey& other) const
+    {
+        if (m_trace != other.m_trace) {
+            return m_trace < other.m_trace;
+        }
+        if (m_level != other.m_level) {
+            return m_level < other.m_level;
+        }
+        return m_index < other.m_index;
+    }
+};
+
+// Points of the detail levels of the traces kept in OpenGL vertex buffers, in blocks of
+// kWaveformBlockPoints, and drawn as line strips by a shader that places each point from its
+// index. Points are uploaded once, as they come into view, so panning and zooming only change
+// the shader's transform, and drawing a trace costs a few GL calls however many points it has.
+class WaveformBuffers
+{
+public:
+    WaveformBuffers();
+
+    // Build the shader, with the OpenGL context current and ImGui's GLSL version, keeping
+    // up to maxBytes of buffers. Returns false if it can't be, and then draw() always fails.
+    bool initialize(const char* glslVersion, uint64_t maxBytes);
+    void shutdown();
+
+    // Draw points [startIdx, endIdx) of a level of a trace as a line item of the current plot,
+    // with its line color. Point i is at i * pointTime seconds, with value points[i] * yScale
+    // + yOffset, and only the first numPoints are published. Points not uploaded yet are read
+    // from points. Returns false if they can't be drawn this way.
+    bool draw(const char* label, int32_t trace, int32_t level, const SampleView& points, uint64_t numPoints,
+              uint64_t startIdx, uint64_t endIdx, double pointTime, double yScale, double yOffset);
+
+    // Call once a frame, after drawing, to delete the buffers least recently drawn before
+    // this frame while they take up more than maxBytes
+    void endFrame();
+
+private:
+    WaveformBuffers(const WaveformBuffers&);
+    WaveformBuffers& operator=(const WaveformBuffers&);
+
+    struct Block
+    {
+        uint32_t m_buffer = 0;
+        uint64_t m_numPoints = 0;  // uploaded, each block also has the first point of the next
+        uint64_t m_lastFrame = 0;  // drawn
+    };
+
+    // A line strip of points of a block, from ImGui's pixels to a value's pixels
+    struct Line
+    {
+        const WaveformBuffers* m_pBuffers;
+        uint32_t m_buffer;
+        int32_t m_first;         // point of the block
+        int32_t m_count;
+        float m_transform[4];    // pixels a point, pixel of the first point, and pixels a value and at 0
+        float m_color[4];
+    };
+
+    static void drawLine(const ImDrawList* pDrawList, const ImDrawCmd* pCmd);
+    void deleteBlock(Block& block);
+
+    bool m_bInitialized = false;
+    uint32_t m_program = 0;
+    uint32_t m_vertexArray = 0;
+    int32_t m_projectionLocation = -1;
+    int32_t m_firstLocation = -1;
+    int32_t m_transformLocation = -1;
+    int32_t m_colorLocation = -1;
+    std::map<WaveformBlockKey, Block> m_blocks;
+    std::deque<Line> m_lines;      // drawn this frame, which stay put for its callbacks
+    std::vector<float> m_points;   // read to upload
+    uint64_t m_maxBytes = 0;
+    uint64_t m_bytes = 0;
+    uint64_t m_frame = 0;
+    uint64_t m_linesFrame = 0;
+};
+
+// What the points of a plot item were drawn from
+struct PlotItemKey
+{
+    uint32_t m_level = 0;
+    uint64_t m_startIdx = 0;
+    uint64_t m_endIdx = 0;
+    double m_yScale = 1.0;
+    double m_yOffset = 0.0;
+    uint64_t m_dataVersion = 0;
+
+    bool operator==(const PlotItemKey& other) const
+    {
+        return (m_level == other.m_level) && (m_startIdx == other.m_startIdx) && (m_endIdx == other.m_endIdx) &&
+               (m_yScale == other.m_yScale) && (m_yOffset == other.m_yOffset) && (m_dataVersion == other.m_dataVersion);
+    }
+};
+
+// The vertices ImPlot draws for items of the current plot, kept in OpenGL buffers once an item
+// is drawn the same way two frames in a row, and from then on drawn from them with ImGui's
+// shader for as long as its points, its plot's place and limits and its style stay the same.
+// Frames where only the mouse or the cursor moved then cost a draw call an item.
+class PlotItemBuffers
+{
+public:
+    PlotItemBuffers();
+
+    // Build the shader, with the OpenGL context current and ImGui's GLSL version. Returns
+    // false if it can't be, and then draw() always fails.
+    bool initialize(const char* glslVersion);
+    void shutdown();
+
+    // Draw item id of the current plot, with its label, from its buffers if they were kept
+    // from key in the same plot and style. Returns false if ImPlot must draw it.
+    bool draw(int32_t id, const char* label, const PlotItemKey& key);
+
+    // Call before and after ImPlot draws item id with its label, to keep what it adds to the
+    // draw list if it was drawn from key in the same plot and style last frame
+    void beginCapture(const char* label);
+    void endCapture(int32_t id, const PlotItemKey& key);
+
+    // Call once a frame, after drawing, to delete the buffers of items not drawn this frame
+    void endFrame();
+
+    uint64_t getNumDrawn() const { return m_numDrawn; }  // from buffers, last frame
+    uint64_t getBytes() const { return m_bytes; }
+
+private:
+    PlotItemBuffers(const PlotItemBuffers&);
+    PlotItemBuffers& operator=(const PlotItemBuffers&);
+
+    // Everything besides its points that places and styles an item's vertices
+    struct PlotState
+    {
+        ImVec2 m_pos;
+        ImVec2 m_size;
+        ImPlotRect m_limits;
+        ImVec4 m_color;
+        float m_lineWeight = 0.0f;
+        ImPlotMarker m_marker = ImPlotMarker_None;
+        float m_markerSize = 0.0f;
+        float m_markerWeight = 0.0f;
+        bool m_bHovered = false;  // in the legend, which highlights it
+        bool m_bHidden = false;
+
+        bool operator==(const PlotState& other) const;
+    };
+
+    struct Item
+    {
+        const PlotItemBuffers* m_pBuffers = nullptr;  // for drawing it
+        PlotItemKey m_key;
+        PlotState m_state;
+        bool m_bKept = false;        // in the buffers, or only drawn from key last frame
+        uint32_t m_vertexArray = 0;
+        uint32_t m_vertexBuffer = 0;
+        uint32_t m_indexBuffer = 0;
+        int32_t m_numIndices = 0;
+        ImTextureID m_texture = 0;   // of ImGui's font atlas, with the lines' texels
+        uint64_t m_bytes = 0;
+        uint64_t m_lastFrame = 0;    // drawn
+    };
+
+    static PlotState getPlotState(const char* label);
+    static void drawItem(const ImDrawList* pDrawList, const ImDrawCmd* pCmd);
+    void deleteItem(Item& item);
+
+    bool m_bInitialized = false;
+    uint32_t m_program = 0;
+    int32_t m_projectionLocation = -1;
+    std::map<int32_t, Item> m_items;
+    PlotState m_captureState;
+    ImDrawList* m_pCaptureDrawList = nullptr;
+    int m_captureVtxStart = 0;
+    int m_captureIdxStart = 0;
+    unsigned int m_captureVtxIdx = 0;     // written to the indices for the first vertex
+    unsigned int m_captureVtxOffset = 0;
+    std::vector<uint32_t> m_indices;      // read to upload, from the first vertex
+    uint64_t m_bytes = 0;
+    uint64_t m_frame = 0;
+    uint64_t m_numDrawn = 0;
+    uint64_t m_numDrawnFrame = 0;
+};
+
+#endif // AUDIOPLOT_GL_H
@@ -1,99 +1,862 @@
 #include "audioplot_kiss_fft.h"
+#include "audioplot_decibel.h"
+#include "audioplot_fft.h"
+#include "audioplot_mmap.h"
+#include "audioplot_thread_pool.h"
 
-#include <kiss_fftr.h>
 #include <complex>
 #include <vector>
 #include <array>
+#include <cmath>
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <limits>
+#include <list>
+#include <map>
+#include <set>
+#include <thread>
+
+static const double kPi = 3.14159265358979323846;
+static const int kReferenceFftSize = 1024;  // frames are scaled to the levels of an unwindowed FFT of this size
+static const double kKaiserBeta = 8.6;
+static const float kNepersPerDecibel = 0.230258509f;  // ln(10) / 10
+static const float kMinPower = 1.17549435e-38f;       // as for powerToDecibels()
+
+bool isValidSpectrogramSettings(const SpectrogramSettings& settings)
+{
+    return (settings.m_fftSize >= kMinSpectrogramFftSize) && (settings.m_fftSize <= kMaxSpectrogramFftSize) &&
+           ((settings.m_fftSize & (settings.m_fftSize - 1)) == 0) &&
+           (settings.m_hop >= 1) && (settings.m_hop <= settings.m_fftSize) &&
+           (settings.m_window >= 0) && (settings.m_window < NUM_SPECTROGRAM_WINDOWS) &&
+           (settings.m_format >= 0) && (settings.m_format < NUM_SPECTROGRAM_FORMATS);
+}
+
+const char* getSpectrogramWindowName(SpectrogramWindow window)
+{
+    static const char* names[NUM_SPECTROGRAM_WINDOWS] = {"Rectangular", "Hann", "Hamming", "Blackman-Harris", "Kaiser"};
+    return ((window >= 0) && (window < NUM_SPECTROGRAM_WINDOWS) ? names[window] : "");
+}
+
+bool getSpectrogramPercentile(const uint64_t* pHistogram, double fraction, float* pDb)
+{
+    uint64_t total = 0;
+    for (int i = 0; i < kSpectrogramHistogramBins; i++) {
+        total += pHistogram[i];
+    }
+    if (total == 0) {
+        return false;
+    }
+
+    // Interpolated within the bin it falls in
+    const double target = std::min(std::max(fraction, 0.0), 1.0) * (double)total;
+    double count = 0.0;
+    int bin = 0;
+    while (bin < kSpectrogramHistogramBins - 1 && count + (double)pHistogram[bin] < target) {
+        count += (double)pHistogram[bin];
+        bin++;
+    }
+    const double part = (pHistogram[bin] > 0 ? std::min((target - count) / (double)pHistogram[bin], 1.0) : 0.0);
+    *pDb = (float)(kSpectrogramHistogramMinDb + (bin + part) * kSpectrogramHistogramStep);
+    return true;
+}
+
+const char* getSpectrogramScaleName(SpectrogramScale scale)
+{
+    static const char* names[NUM_SPECTROGRAM_SCALES] = {"Linear", "Mel", "Log", "Constant-Q"};
+    return ((scale >= 0) && (scale < NUM_SPECTROGRAM_SCALES) ? names[scale] : "");
+}
+
+const char* getSpectrogramFormatName(SpectrogramFormat format)
+{
+    static const char* names[NUM_SPECTROGRAM_FORMATS] = {"f32", "u16", "u8"};
+    return ((format >= 0) && (format < NUM_SPECTROGRAM_FORMATS) ? names[format] : "");
+}
+
+uint32_t getSpectrogramFormatSize(SpectrogramFormat format)
+{
+    switch (format) {
+        case SPECTROGRAM_FORMAT_U16: return 2;
+        case SPECTROGRAM_FORMAT_U8: return 1;
+        default: return 4;
+    }
+}
+
+float getSpectrogramFormatOffset(SpectrogramFormat format)
+{
+    switch (format) {
+        case SPECTROGRAM_FORMAT_U16: return -140.0f;
+        case SPECTROGRAM_FORMAT_U8: return -120.0f;
+        default: return 0.0f;
+    }
+}
+
+float getSpectrogramFormatStep(SpectrogramFormat format)
+{
+    switch (format) {
+        case SPECTROGRAM_FORMAT_U16: return 1.0f / 256.0f;
+        case SPECTROGRAM_FORMAT_U8: return 0.75f;
+        default: return 1.0f;
+    }
+}
+
+template<typename T>
+static void quantizeAs(const float* pDb, int count, SpectrogramFormat format, T* pValues)
+{
+    const float offset = getSpectrogramFormatOffset(format);
+    const float scale = 1.0f / getSpectrogramFormatStep(format);
+    const float maxValue = (float)std::numeric_limits<T>::max();
+    for (int i = 0; i < count; i++) {
+        pValues[i] = (T)(std::min(std::max((pDb[i] - offset) * scale, 0.0f), maxValue) + 0.5f);
+    }
+}
+
+template<typename T>
+static void dequantizeAs(const T* pValues, int count, SpectrogramFormat format, float* pDb)
+{
+    const float offset = getSpectrogramFormatOffset(format);
+    const float step = getSpectrogramFormatStep(format);
+    for (int i = 0; i < count; i++) {
+        pDb[i] = offset + (float)pValues[i] * step;
+    }
+}
+
+void quantizeSpectrogramValues(const float* pDb, int count, SpectrogramFormat format, uint8_t* pValues)
+{
+    switch (format) {
+        case SPECTROGRAM_FORMAT_U16: quantizeAs(pDb, count, format, (uint16_t*)pValues); break;
+        case SPECTROGRAM_FORMAT_U8: quantizeAs(pDb, count, format, pValues); break;
+        default: memcpy(pValues, pDb, (size_t)count * sizeof(float)); break;
+    }
+}
+
+void dequantizeSpectrogramValues(const uint8_t* pValues, int count, SpectrogramFormat format, float* pDb)
+{
+    switch (format) {
+        case SPECTROGRAM_FORMAT_U16: dequantizeAs((const uint16_t*)pValues, count, format, pDb); break;
+        case SPECTROGRAM_FORMAT_U8: dequantizeAs(pValues, count, format, pDb); break;
+        default: memcpy(pDb, pValues, (size_t)count * sizeof(float)); break;
+    }
+}
+
+// Zeroth order modified Bessel function of the first kind, for the Kaiser window
+static double besselI0(double x)
+{
+    double sum = 1.0;
+    double term = 1.0;
+    for (int k = 1; k < 50 && term > sum * 1e-12; k++) {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+    }
+    return sum;
+}
+
+typedef std::shared_ptr<const std::vector<float>> WindowPtr;
+
+// The window for the settings, scaled so a tone shows at the same level whatever the
+// window and FFT size
+static WindowPtr createWindow(const SpectrogramSettings& settings)
+{
+    const int size = settings.m_fftSize;
+    std::vector<double> window(size);
+    for (int i = 0; i < size; i++) {
+        const double x = 2.0 * kPi * i / size;
+        switch (settings.m_window) {
+            case SPECTROGRAM_WINDOW_HANN:
+                window[i] = 0.5 - 0.5 * cos(x);
+                break;
+            case SPECTROGRAM_WINDOW_HAMMING:
+                window[i] = 0.54 - 0.46 * cos(x);
+                break;
+            case SPECTROGRAM_WINDOW_BLACKMAN_HARRIS:
+                window[i] = 0.35875 - 0.48829 * cos(x) + 0.14128 * cos(2.0 * x) - 0.01168 * cos(3.0 * x);
+                break;
+            case SPECTROGRAM_WINDOW_KAISER: {
+                const double r = (2.0 * i / size) - 1.0;
+                window[i] = besselI0(kKaiserBeta * sqrt(1.0 - r * r)) / besselI0(kKaiserBeta);
+                break;
+            }
+            default:
+                window[i] = 1.0;
+                break;
+        }
+    }
+
+    double sum = 0.0;
+    for (int i = 0; i < size; i++) {
+        sum += window[i];
+    }
+    std::shared_ptr<std::vector<float>> pWindow = std::make_shared<std::vector<float>>(size);
+    for (int i = 0; i < size; i++) {
+        (*pWindow)[i] = (float)(window[i] * (kReferenceFftSize / sum));
+    }
+    return pWindow;
+}
+
+// Window numFrames frames of fft_in in place and write the dB magnitude of their FFTs to
+// columns, one after another, highest frequency first
+static void transformFrames(RealFft& fft, const std::vector<float>& window, float* fft_in, int numFrames,
+                            std::vector<std::complex<float>>& fft_out, float* columns)
+{
+    const int fftSize = (int)window.size();
+    const int numFrequencies = fftSize / 2 + 1;
+    for (int b = 0; b < numFrames; ++b) {
+        float* frame = fft_in + (size_t)b * fftSize;
+        for (int i = 0; i < fftSize; ++i) {
+            frame[i] *= window[i];
+        }
+    }
+    fft_out.resize((size_t)numFrequencies * numFrames);
+    fft.transform(fft_in, numFrames, fft_out.data());
+    for (int b = 0; b < numFrames; ++b) {
+        powerToDecibels(reinterpret_cast<const float*>(&fft_out[(size_t)b * numFrequencies]), numFrequencies,
+                        columns + (size_t)b * numFrequencies);
+    }
+}
 
 class Spectrogram::SpectrogramImpl
 {
 public:
-    void initialize(const std::vector<std::vector<double>>& samples, float sampleRate)
+    ~SpectrogramImpl()
+    {
+        stopTiles();
+        freeFfts();
+    }
+
+    void initialize(size_t numChannels, float sampleRate, uint64_t expectedNumSamples, const SpectrogramSettings& settings)
+    {
+        m_sampleRate = sampleRate;
+        m_expectedNumSamples = expectedNumSamples;
+        m_nextSettings = settings;
+        m_pNextWindow = createWindow(settings);
+        m_nextGeneration++;
+        m_channels.resize(numChannels);
+        applySettings();
+        setTileSettings(m_pNextWindow, m_nextSettings.m_format, m_nextGeneration);
+    }
+
+    void initializeTiles(const std::vector<SampleView>& views, std::mutex& mutex, uint32_t numThreads,
+                         uint64_t cacheSize, std::function<void()> onFramesReady)
+    {
+        m_pViews = &views;
+        m_pMutex = &mutex;
+        m_numTileThreads = std::max(numThreads, 1u);
+        m_tileCacheSize = cacheSize;
+        m_onFramesReady = onFramesReady;
+    }
+
+    void stopTiles()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_tileMutex);
+            m_bStopTiles = true;
+        }
+        m_tileRequested.notify_all();
+        for (std::thread& thread : m_tileThreads) {
+            thread.join();
+        }
+        m_tileThreads.clear();
+    }
+
+    void setLazy(bool bLazy)
+    {
+        m_bLazy = bLazy;
+    }
+
+    bool isLazy() const
     {
-        for (int f = 0; f < (int)m_fft_frq.size(); ++f) {
-            m_fft_frq[f] = f * sampleRate / (float)N_FFT;
+        return m_bLazy;
+    }
+
+    void setSettings(const SpectrogramSettings& settings)
+    {
+        if (!isValidSpectrogramSettings(settings) || isSameSettings(settings, m_nextSettings)) {
+            return;
+        }
+        m_nextSettings = settings;
+        m_pNextWindow = createWindow(settings);
+        m_nextGeneration++;
+        m_bSettingsChanged = true;
+        clearHistograms();
+        setTileSettings(m_pNextWindow, m_nextSettings.m_format, m_nextGeneration);
+    }
+
+    const SpectrogramSettings& settings() const
+    {
+        return m_settings;
+    }
+
+    const SpectrogramSettings& requestedSettings() const
+    {
+        return m_nextSettings;
+    }
+
+    uint64_t generation() const
+    {
+        return m_generation;
+    }
+
+    bool hasPendingSettings() const
+    {
+        return m_bSettingsChanged;
+    }
+
+    void spill(const std::string& directory)
+    {
+        m_scratchDirectory = directory;
+        for (size_t ch = 0; ch < m_channels.size(); ch++) {
+            for (Level& level : m_channels[ch].m_levels) {
+                level.m_frames.spill(directory);
+                level.m_pData = level.m_frames.data();
+            }
+        }
+    }
+
+    void update(const std::vector<SampleView>& samples, ThreadPool& threadPool, std::mutex& mutex, const std::atomic<bool>& bCancel)
+    {
+        const size_t numChannels = std::min(samples.size(), m_channels.size());
+        while (!bCancel) {
+            // Settings are changed between batches of frames, when nothing is being computed
+            int binStart = 0;
+            int binEnd = 0;
+            int numLevels = 0;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (m_bSettingsChanged) {
+                    applySettings();
+                }
+                if (m_bLazy || numChannels == 0) {
+                    return;
+                }
+
+                binStart = m_channels[0].m_levels[0].m_numBins;
+                binEnd = std::min(getNumBins(samples[0].size(), m_settings.m_hop), binStart + N_UPDATE_BINS);
+                if (binEnd <= binStart) {
+                    return;
+                }
+                numLevels = std::max(getNumLevels(binEnd), (int)m_channels[0].m_levels.size());
+                for (size_t ch = 0; ch < numChannels; ch++) {
+                    std::vector<Level>& levels = m_channels[ch].m_levels;
+                    while ((int)levels.size() < numLevels) {
+                        levels.emplace_back();
+                        if (!m_scratchDirectory.empty()) {
+                            levels.back().m_frames.spill(m_scratchDirectory);
+                        }
+                        levels.back().m_frames.reserve(frame_bytes() * (getExpectedBins() >> (levels.size() - 1)));
+                    }
+                    for (int l = 0; l < numLevels; l++) {
+                        levels[l].m_frames.resize(frame_bytes() * (binEnd >> l));
+                        levels[l].m_pData = levels[l].m_frames.data();
+                    }
+                }
+            }
+
+            // FFT plans use their own scratch space, so each thread needs its own
+            if (m_fftSize != m_settings.m_fftSize) {
+                freeFfts();
+                m_fftSize = m_settings.m_fftSize;
+            }
+            while (m_ffts.size() < threadPool.getNumThreads()) {
+                m_ffts.emplace_back(new RealFft(m_fftSize));
+            }
+
+            // Each thread counts values in its own histograms, added up once the frames are published
+            m_threadHistograms.assign((size_t)threadPool.getNumThreads() * numChannels * kSpectrogramHistogramBins, 0);
+
+            // Compute FFTs for any complete frames of samples not yet in the spectrogram, in
+            // segments of frames across all channels, each writing only its own columns
+            const uint64_t numSegments = (binEnd - binStart + N_SEGMENT_BINS - 1) / N_SEGMENT_BINS;
+            threadPool.parallelFor(numChannels * numSegments, [&](uint64_t task, uint32_t thread) {
+                const size_t ch = (size_t)(task / numSegments);
+                const int segmentStart = binStart + (int)(task % numSegments) * N_SEGMENT_BINS;
+                const int segmentEnd = std::min(segmentStart + N_SEGMENT_BINS, binEnd);
+                Level& level = m_channels[ch].m_levels[0];
+                const int batchSize = RealFft::getBatchSize();
+                std::vector<float> fft_in((size_t)batchSize * m_fftSize);
+                std::vector<std::complex<float>> fft_out;
+                std::vector<float> columns((size_t)batchSize * n_frq());
+                uint64_t* pHistogram = &m_threadHistograms[((size_t)thread * numChannels + ch) * kSpectrogramHistogramBins];
+                for (int b = segmentStart; b < segmentEnd; b += batchSize) {
+                    const int numFrames = std::min(batchSize, segmentEnd - b);
+                    for (int i = 0; i < numFrames; ++i) {
+                        samples[ch].read((uint64_t)(b + i) * m_settings.m_hop, m_fftSize, &fft_in[(size_t)i * m_fftSize]);
+                    }
+                    transformFrames(*m_ffts[thread], *m_pWindow, fft_in.data(), numFrames, fft_out, columns.data());
+                    addToHistogram(columns.data(), numFrames * n_frq(), pHistogram);
+                    quantizeSpectrogramValues(columns.data(), numFrames * n_frq(), m_settings.m_format,
+                                              &level.m_frames[(size_t)b * frame_bytes()]);
+                }
+            });
+
+            // Each level needs the one below it to be complete
+            threadPool.parallelFor(numChannels, [&](uint64_t ch, uint32_t) {
+                std::vector<Level>& levels = m_channels[ch].m_levels;
+                for (int l = 1; l < numLevels; l++) {
+                    poolFrames(levels[l - 1], levels[l], levels[l].m_numBins, binEnd >> l, n_frq(), m_settings.m_format);
+                }
+            });
+
+            // Frames computed with settings that have since changed are dropped
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!m_bSettingsChanged) {
+                    for (size_t ch = 0; ch < numChannels; ch++) {
+                        for (int l = 0; l < numLevels; l++) {
+                            m_channels[ch].m_levels[l].m_numBins = binEnd >> l;
+                        }
+                        for (uint32_t thread = 0; thread < threadPool.getNumThreads(); thread++) {
+                            const uint64_t* pCounts = &m_threadHistograms[((size_t)thread * numChannels + ch) * kSpectrogramHistogramBins];
+                            for (int i = 0; i < kSpectrogramHistogramBins; i++) {
+                                m_channels[ch].m_histogram[i] += pCounts[i];
+                            }
+                        }
+                    }
+                }
+            }
+            if (m_onFramesReady) {
+                m_onFramesReady();
+            }
+        }
+    }
+
+    void load(size_t ch, int level, const uint8_t* pData, int numBins)
+    {
+        if (ch >= m_channels.size()) {
+            return;
+        }
+        std::vector<Level>& levels = m_channels[ch].m_levels;
+        if ((int)levels.size() <= level) {
+            levels.resize(level + 1);
+        }
+        levels[level].m_frames.clear();
+        levels[level].m_pData = pData;
+        levels[level].m_numBins = numBins;
+    }
+
+    void loadHistogram(size_t ch, const uint64_t* pHistogram)
+    {
+        if (ch < m_channels.size()) {
+            std::copy(pHistogram, pHistogram + kSpectrogramHistogramBins, m_channels[ch].m_histogram.begin());
+        }
+    }
+
+    const uint64_t* histogram(size_t ch) const
+    {
+        return m_channels[ch].m_histogram.data();
+    }
+
+    std::shared_ptr<const SpectrogramTile> tile(size_t ch, uint64_t hop, uint64_t index)
+    {
+        const TileKey key = {ch, hop, index};
+        std::lock_guard<std::mutex> lock(m_tileMutex);
+        std::map<TileKey, std::list<CachedTile>::iterator>::iterator it = m_tileIndex.find(key);
+        if (it == m_tileIndex.end()) {
+            queueTile(m_tileRequests, key);
+            return nullptr;
         }
 
-        m_channels.reserve(samples.size());    
-        for (size_t ch = 0; ch < samples.size(); ch++) {
-            m_channels.emplace_back(samples[ch]);
+        // Tiles cut short by the end of the samples are computed again as more are loaded
+        std::shared_ptr<const SpectrogramTile> pTile = it->second->m_pTile;
+        m_tiles.splice(m_tiles.begin(), m_tiles, it->second);
+        const uint64_t numBins = getNumTileBins((*m_pViews)[ch].size(), pTile->m_fftSize, hop, index);
+        if ((uint64_t)pTile->m_numBins < numBins) {
+            queueTile(m_tileRequests, key);
         }
+        return pTile;
     }
 
-    const std::vector<float>& data(size_t ch) const
-    { 
-        return m_channels[ch].m_spectrogram;
+    void prefetchTile(size_t ch, uint64_t hop, uint64_t index)
+    {
+        const TileKey key = {ch, hop, index};
+        std::lock_guard<std::mutex> lock(m_tileMutex);
+        if (m_tileIndex.find(key) == m_tileIndex.end()) {
+            queueTile(m_tilePrefetches, key);
+        }
+    }
+
+    void clearTileRequests()
+    {
+        std::lock_guard<std::mutex> lock(m_tileMutex);
+        m_tileRequests.clear();
+        m_tilePrefetches.clear();
+    }
+
+    int tile_bins() const
+    {
+        return N_TILE_BINS;
+    }
+
+    const uint8_t* data(size_t ch, int level) const
+    {
+        return m_channels[ch].m_levels[level].m_pData;
+    }
+
+    size_t frame_bytes() const
+    {
+        return (size_t)n_frq() * getSpectrogramFormatSize(m_settings.m_format);
     }
 
     int n_frq() const
     {
-        return N_FRQ;
+        return m_settings.m_fftSize / 2 + 1;
     }
 
-    int n_bin() const
+    int n_levels() const
     {
-        return m_channels[0].m_fft_bins;
+        return m_channels.empty() ? 0 : (int)m_channels[0].m_levels.size();
     }
 
-    double min_db() const
+    int n_bin(int level) const
     {
-        return m_min_db;
+        return (level < n_levels()) ? m_channels[0].m_levels[level].m_numBins : 0;
     }
 
-    double max_db() const
+    int n_fft() const
     {
-        return m_max_db;
+        return m_settings.m_fftSize;
+    }
+
+    int hop() const
+    {
+        return m_settings.m_hop;
     }
 
     float min_frq() const
     {
-        return m_fft_frq.front();
+        return 0.0f;
     }
 
     float max_frq() const
     {
-        return m_fft_frq.back();
+        return m_sampleRate / 2.0f;
     }
 
 private:
-    static constexpr int N_FFT = 1024;           // FFT size
-    static constexpr int N_FRQ = N_FFT / 2 + 1;  // FFT frequency count
-    static constexpr double m_min_db = -25;      // minimum spectrogram dB
-    static constexpr double m_max_db =  40;      // maximum spectrogram dB
-    std::array<float, N_FRQ> m_fft_frq;          // FFT output frequencies
+    static constexpr int N_SEGMENT_BINS = 64;      // FFT frames computed by each parallel task
+    static constexpr int N_UPDATE_BINS = 16384;    // FFT frames computed between publishing them
+    static constexpr int N_MIN_LEVEL_BINS = 1024;  // frames of the coarsest level, at least
+    static constexpr int N_MAX_LEVELS = 24;
+    static constexpr int N_TILE_BINS = 256;        // FFT frames in each tile
 
-    struct Channel
+    struct Level
     {
-        Channel(const std::vector<double>& samples)
+        int m_numBins = 0;                 // frames published
+        PagedArray<uint8_t> m_frames;      // values in the format of the settings, one FFT frame after another (column major)
+        const uint8_t* m_pData = nullptr;  // m_frames, or frames loaded from elsewhere
+    };
+
+    struct TileKey
+    {
+        size_t m_ch;
+        uint64_t m_hop;
+        uint64_t m_index;
+
+        bool operator<(const TileKey& other) const
+        {
+            if (m_ch != other.m_ch) {
+                return m_ch < other.m_ch;
+            }
+            if (m_hop != other.m_hop) {
+                return m_hop < other.m_hop;
+            }
+            return m_index < other.m_index;
+        }
+
+        bool operator==(const TileKey& other) const
         {
-            // convert samples to float
-            std::vector<float> float_samples;
-            float_samples.reserve(samples.size());
-            for (size_t s = 0; s < samples.size(); s++) {
-                float_samples.push_back((float)samples[s]);
-            }
-
-            // compute FFTs to create a spectrogram  
-            kiss_fftr_cfg fft = kiss_fftr_alloc(N_FFT, 0, nullptr, nullptr);
-            m_fft_bins = samples.size() / N_FFT;
-            m_spectrogram.resize(N_FRQ * m_fft_bins);
-            std::complex<float> fft_out[N_FFT];
-            int idx = 0;
-            for (int b = 0; b < m_fft_bins; ++b) {
-                kiss_fftr(fft, &float_samples[idx], reinterpret_cast<kiss_fft_cpx*>(fft_out));
-                for (int f = 0; f < N_FRQ; ++f) {
-                    m_spectrogram[f*m_fft_bins+b] = 20*log10f(std::abs(fft_out[N_FRQ-1-f]));
+            return !(*this < other) && !(other < *this);
+        }
+    };
+
+    struct CachedTile
+    {
+        TileKey m_key;
+        std::shared_ptr<const SpectrogramTile> m_pTile;
+    };
+
+    static bool isSameSettings(const SpectrogramSettings& a, const SpectrogramSettings& b)
+    {
+        return (a.m_fftSize == b.m_fftSize) && (a.m_hop == b.m_hop) && (a.m_window == b.m_window) && (a.m_format == b.m_format);
+    }
+
+    // Start level 0 again with the latest settings, called holding the mutex
+    void applySettings()
+    {
+        m_settings = m_nextSettings;
+        m_pWindow = m_pNextWindow;
+        m_generation = m_nextGeneration;
+        m_bSettingsChanged = false;
+        for (size_t ch = 0; ch < m_channels.size(); ch++) {
+            std::vector<Level>& levels = m_channels[ch].m_levels;
+            levels.clear();
+            levels.resize(1);
+            if (!m_scratchDirectory.empty()) {
+                levels[0].m_frames.spill(m_scratchDirectory);
+            }
+            levels[0].m_frames.reserve(frame_bytes() * getExpectedBins());
+        }
+        clearHistograms();
+    }
+
+    void clearHistograms()
+    {
+        for (size_t ch = 0; ch < m_channels.size(); ch++) {
+            m_channels[ch].m_histogram.assign(kSpectrogramHistogramBins, 0);
+        }
+    }
+
+    // Count each dB value in its bin of a histogram, leaving out those below its range
+    static void addToHistogram(const float* pValues, int count, uint64_t* pHistogram)
+    {
+        const float maxBin = (float)(kSpectrogramHistogramBins - 1);
+        for (int i = 0; i < count; i++) {
+            const float bin = (pValues[i] - kSpectrogramHistogramMinDb) * (1.0f / kSpectrogramHistogramStep);
+            if (bin >= 0.0f) {
+                pHistogram[(int)std::min(bin, maxBin)]++;
+            }
+        }
+    }
+
+    void setTileSettings(const WindowPtr& pWindow, SpectrogramFormat format, uint64_t generation)
+    {
+        std::lock_guard<std::mutex> lock(m_tileMutex);
+        m_pTileWindow = pWindow;
+        m_tileFormat = format;
+        m_tileGeneration = generation;
+        m_tileRequests.clear();
+        m_tilePrefetches.clear();
+        m_tiles.clear();
+        m_tileIndex.clear();
+        m_tileCacheUsed = 0;
+    }
+
+    void freeFfts()
+    {
+        m_ffts.clear();
+    }
+
+    uint64_t getExpectedBins() const
+    {
+        return (uint64_t)getNumBins(m_expectedNumSamples, m_settings.m_hop);
+    }
+
+    int getNumBins(uint64_t numSamples, int hop) const
+    {
+        return (numSamples >= (uint64_t)m_settings.m_fftSize ? (int)((numSamples - m_settings.m_fftSize) / hop) + 1 : 0);
+    }
+
+    static int getNumLevels(int numBins)
+    {
+        int numLevels = 1;
+        while (numLevels < N_MAX_LEVELS && (numBins >> numLevels) >= N_MIN_LEVEL_BINS) {
+            numLevels++;
+        }
+        return numLevels;
+    }
+
+    // Frames of a tile whose FFTs fit in numSamples
+    static uint64_t getNumTileBins(uint64_t numSamples, int fftSize, uint64_t hop, uint64_t index)
+    {
+        const uint64_t numBins = (numSamples >= (uint64_t)fftSize ? ((numSamples - fftSize) / hop) + 1 : 0);
+        const uint64_t binStart = index * N_TILE_BINS;
+        return (numBins > binStart ? std::min(numBins - binStart, (uint64_t)N_TILE_BINS) : 0);
+    }
+
+    // Call with m_tileMutex held
+    void queueTile(std::deque<TileKey>& queue, const TileKey& key)
+    {
+        if (m_pViews == nullptr || m_bStopTiles || m_tilesInProgress.count(key) > 0 ||
+            std::find(m_tileRequests.begin(), m_tileRequests.end(), key) != m_tileRequests.end() ||
+            std::find(m_tilePrefetches.begin(), m_tilePrefetches.end(), key) != m_tilePrefetches.end()) {
+            return;
+        }
+        queue.push_back(key);
+        if (m_tileThreads.empty()) {
+            for (uint32_t i = 0; i < m_numTileThreads; i++) {
+                m_tileThreads.emplace_back(&SpectrogramImpl::tileLoop, this);
+            }
+        }
+        m_tileRequested.notify_one();
+    }
+
+    void tileLoop()
+    {
+        std::unique_ptr<RealFft> pFft;
+        int fftSize = 0;
+        std::vector<float> samples;
+        std::vector<std::complex<float>> fft_out;
+        std::vector<float> columns;  // dB values of a batch of frames
+        std::vector<uint64_t> histogram;
+        while (true) {
+            TileKey key;
+            uint64_t generation = 0;
+            WindowPtr pWindow;
+            SpectrogramFormat format = SPECTROGRAM_FORMAT_F32;
+            {
+                std::unique_lock<std::mutex> lock(m_tileMutex);
+                m_tileRequested.wait(lock, [this]() {
+                    return m_bStopTiles || !m_tileRequests.empty() || !m_tilePrefetches.empty();
+                });
+                if (m_bStopTiles) {
+                    break;
+                }
+                std::deque<TileKey>& queue = (m_tileRequests.empty() ? m_tilePrefetches : m_tileRequests);
+                key = queue.front();
+                queue.pop_front();
+                m_tilesInProgress.insert(key);
+                generation = m_tileGeneration;
+                pWindow = m_pTileWindow;
+                format = m_tileFormat;
+            }
+
+            // The plan is kept for as long as the FFT size stays the same
+            if (fftSize != (int)pWindow->size()) {
+                fftSize = (int)pWindow->size();
+                pFft.reset(new RealFft(fftSize));
+                samples.resize((size_t)N_TILE_BINS * fftSize);
+                columns.resize((size_t)RealFft::getBatchSize() * (fftSize / 2 + 1));
+            }
+
+            // Samples are copied out while the loading thread can't move them, then transformed
+            std::shared_ptr<SpectrogramTile> pTile = std::make_shared<SpectrogramTile>();
+            pTile->m_binStart = key.m_index * N_TILE_BINS;
+            pTile->m_fftSize = fftSize;
+            pTile->m_format = format;
+            pTile->m_generation = generation;
+            {
+                std::lock_guard<std::mutex> lock(*m_pMutex);
+                const SampleView& view = (*m_pViews)[key.m_ch];
+                pTile->m_numBins = (int)getNumTileBins(view.size(), fftSize, key.m_hop, key.m_index);
+                for (int b = 0; b < pTile->m_numBins; ++b) {
+                    view.read((pTile->m_binStart + b) * key.m_hop, fftSize, &samples[(size_t)b * fftSize]);
+                }
+            }
+            // With no levels, the histograms are of the tiles computed so far
+            const int numFrequencies = fftSize / 2 + 1;
+            const size_t frameBytes = (size_t)numFrequencies * getSpectrogramFormatSize(format);
+            pTile->m_frames.resize(frameBytes * pTile->m_numBins);
+            histogram.assign(kSpectrogramHistogramBins, 0);
+            for (int b = 0; b < pTile->m_numBins; b += RealFft::getBatchSize()) {
+                const int numFrames = std::min(RealFft::getBatchSize(), pTile->m_numBins - b);
+                transformFrames(*pFft, *pWindow, &samples[(size_t)b * fftSize], numFrames, fft_out, columns.data());
+                addToHistogram(columns.data(), numFrames * numFrequencies, histogram.data());
+                quantizeSpectrogramValues(columns.data(), numFrames * numFrequencies, format, &pTile->m_frames[(size_t)b * frameBytes]);
+            }
+            if (m_bLazy) {
+                std::lock_guard<std::mutex> lock(*m_pMutex);
+                if (generation == m_nextGeneration) {
+                    for (int i = 0; i < kSpectrogramHistogramBins; i++) {
+                        m_channels[key.m_ch].m_histogram[i] += histogram[i];
+                    }
                 }
-                idx += N_FFT;
             }
-            kiss_fftr_free(fft);
+
+            {
+                std::lock_guard<std::mutex> lock(m_tileMutex);
+                m_tilesInProgress.erase(key);
+                if (generation != m_tileGeneration) {
+                    continue;  // computed with settings that have since changed
+                }
+                std::map<TileKey, std::list<CachedTile>::iterator>::iterator it = m_tileIndex.find(key);
+                if (it != m_tileIndex.end()) {
+                    m_tileCacheUsed -= it->second->m_pTile->m_frames.size();
+                    m_tiles.erase(it->second);
+                }
+                CachedTile cachedTile;
+                cachedTile.m_key = key;
+                cachedTile.m_pTile = pTile;
+                m_tiles.push_front(cachedTile);
+                m_tileIndex[key] = m_tiles.begin();
+                m_tileCacheUsed += pTile->m_frames.size();
+
+                // Drop the least recently drawn tiles, which the GUI thread may still hold
+                while (m_tileCacheUsed > m_tileCacheSize && m_tiles.size() > 1) {
+                    m_tileCacheUsed -= m_tiles.back().m_pTile->m_frames.size();
+                    m_tileIndex.erase(m_tiles.back().m_key);
+                    m_tiles.pop_back();
+                }
+            }
+            if (m_onFramesReady) {
+                m_onFramesReady();
+            }
         }
+    }
 
-        int m_fft_bins = 0; // spectrogram bin count
-        std::vector<float>  m_spectrogram; // spectrogram matrix data
+    // Compute frames [binStart, binEnd) of a level from the maximum of pairs of frames of the
+    // level below. Quantizing keeps the order of values, so pools quantized values exactly.
+    static void poolFrames(const Level& src, Level& dst, int binStart, int binEnd, int numFrequencies, SpectrogramFormat format)
+    {
+        switch (format) {
+            case SPECTROGRAM_FORMAT_U16:
+                poolFramesAs((const uint16_t*)src.m_frames.data(), (uint16_t*)dst.m_frames.data(), binStart, binEnd, numFrequencies);
+                break;
+            case SPECTROGRAM_FORMAT_U8:
+                poolFramesAs(src.m_frames.data(), dst.m_frames.data(), binStart, binEnd, numFrequencies);
+                break;
+            default:
+                poolFramesAs((const float*)src.m_frames.data(), (float*)dst.m_frames.data(), binStart, binEnd, numFrequencies);
+                break;
+        }
+    }
+
+    template<typename T>
+    static void poolFramesAs(const T* pSrc, T* pDst, int binStart, int binEnd, int numFrequencies)
+    {
+        for (int b = binStart; b < binEnd; ++b) {
+            const T* a = &pSrc[(size_t)(2 * b) * numFrequencies];
+            const T* c = a + numFrequencies;
+            T* column = &pDst[(size_t)b * numFrequencies];
+            for (int f = 0; f < numFrequencies; ++f) {
+                column[f] = std::max(a[f], c[f]);
+            }
+        }
+    }
+
+    struct Channel
+    {
+        std::vector<Level> m_levels;       // spectrogram at decreasing time resolution
+        std::vector<uint64_t> m_histogram; // of the values of level 0
     };
 
+    float m_sampleRate = 0.0f;
+    uint64_t m_expectedNumSamples = 0;
+    std::string m_scratchDirectory;     // for spilled levels, if the spectrogram is spilled
     std::vector<Channel> m_channels;
+    bool m_bLazy = false;
+
+    // Settings of the levels, and the latest settings, which replace them at the next
+    // update(). Both are guarded by the mutex passed to update().
+    SpectrogramSettings m_settings;
+    WindowPtr m_pWindow;
+    uint64_t m_generation = 0;
+    SpectrogramSettings m_nextSettings;
+    WindowPtr m_pNextWindow;
+    uint64_t m_nextGeneration = 0;      // incremented when the settings change
+    bool m_bSettingsChanged = false;
+    std::vector<std::unique_ptr<RealFft>> m_ffts;  // FFT plan for each thread
+    std::vector<uint64_t> m_threadHistograms;  // of each channel for each thread, in update()
+    int m_fftSize = 0;                  // of the plans
+
+    // Tiles, computed by their own threads as they are drawn, separately from loading
+    const std::vector<SampleView>* m_pViews = nullptr;
+    std::mutex* m_pMutex = nullptr;     // held while reading m_pViews
+    uint32_t m_numTileThreads = 1;
+    uint64_t m_tileCacheSize = 0;
+    std::function<void()> m_onFramesReady;
+    std::vector<std::thread> m_tileThreads;
+    std::mutex m_tileMutex;             // guards everything below
+    std::condition_variable m_tileRequested;
+    bool m_bStopTiles = false;
+    WindowPtr m_pTileWindow;
+    SpectrogramFormat m_tileFormat = SPECTROGRAM_FORMAT_F32;
+    uint64_t m_tileGeneration = 0;      // of the settings of the tiles
+    std::deque<TileKey> m_tileRequests;    // tiles being drawn, computed first
+    std::deque<TileKey> m_tilePrefetches;  // tiles likely to be drawn next
+    std::set<TileKey> m_tilesInProgress;
+    std::list<CachedTile> m_tiles;      // most recently drawn first
+    std::map<TileKey, std::list<CachedTile>::iterator> m_tileIndex;
+    uint64_t m_tileCacheUsed = 0;
 };
 
 Spectrogram::Spectrogram()
@@ -107,14 +870,110 @@ Spectrogram::~Spectrogram()
     m_pImpl = nullptr;
 }
 
-void Spectrogram::initialize(const std::vector<std::vector<double>>& samples, float sampleRate)
+void Spectrogram::initialize(size_t numChannels, float sampleRate, uint64_t expectedNumSamples, const SpectrogramSettings& settings)
+{
+    m_pImpl->initialize(numChannels, sampleRate, expectedNumSamples, settings);
+}
+
+void Spectrogram::initializeTiles(const std::vector<SampleView>& views, std::mutex& mutex, uint32_t numThreads,
+                                  uint64_t cacheSize, std::function<void()> onFramesReady)
+{
+    m_pImpl->initializeTiles(views, mutex, numThreads, cacheSize, onFramesReady);
+}
+
+void Spectrogram::stopTiles()
 {
-    m_pImpl->initialize(samples, sampleRate);
+    m_pImpl->stopTiles();
 }
 
-const std::vector<float>& Spectrogram::data(size_t ch) const
-{ 
-    return m_pImpl->data(ch); 
+void Spectrogram::setLazy(bool bLazy)
+{
+    m_pImpl->setLazy(bLazy);
+}
+
+bool Spectrogram::isLazy() const
+{
+    return m_pImpl->isLazy();
+}
+
+void Spectrogram::setSettings(const SpectrogramSettings& settings)
+{
+    m_pImpl->setSettings(settings);
+}
+
+const SpectrogramSettings& Spectrogram::settings() const
+{
+    return m_pImpl->settings();
+}
+
+const SpectrogramSettings& Spectrogram::requestedSettings() const
+{
+    return m_pImpl->requestedSettings();
+}
+
+uint64_t Spectrogram::generation() const
+{
+    return m_pImpl->generation();
+}
+
+bool Spectrogram::hasPendingSettings() const
+{
+    return m_pImpl->hasPendingSettings();
+}
+
+void Spectrogram::update(const std::vector<SampleView>& samples, ThreadPool& threadPool, std::mutex& mutex, const std::atomic<bool>& bCancel)
+{
+    m_pImpl->update(samples, threadPool, mutex, bCancel);
+}
+
+void Spectrogram::spill(const std::string& directory)
+{
+    m_pImpl->spill(directory);
+}
+
+void Spectrogram::load(size_t ch, int level, const uint8_t* pData, int numBins)
+{
+    m_pImpl->load(ch, level, pData, numBins);
+}
+
+void Spectrogram::loadHistogram(size_t ch, const uint64_t* pHistogram)
+{
+    m_pImpl->loadHistogram(ch, pHistogram);
+}
+
+const uint64_t* Spectrogram::histogram(size_t ch) const
+{
+    return m_pImpl->histogram(ch);
+}
+
+std::shared_ptr<const SpectrogramTile> Spectrogram::tile(size_t ch, uint64_t hop, uint64_t index)
+{
+    return m_pImpl->tile(ch, hop, index);
+}
+
+void Spectrogram::prefetchTile(size_t ch, uint64_t hop, uint64_t index)
+{
+    m_pImpl->prefetchTile(ch, hop, index);
+}
+
+void Spectrogram::clearTileRequests()
+{
+    m_pImpl->clearTileRequests();
+}
+
+int Spectrogram::tile_bins() const
+{
+    return m_pImpl->tile_bins();
+}
+
+const uint8_t* Spectrogram::data(size_t ch, int level) const
+{
+    return m_pImpl->data(ch, level);
+}
+
+size_t Spectrogram::frame_bytes() const
+{
+    return m_pImpl->frame_bytes();
 }
 
 int Spectrogram::n_frq() const
@@ -122,19 +981,24 @@ int Spectrogram::n_frq() const
     return m_pImpl->n_frq();
 }
 
-int Spectrogram::n_bin() const
+int Spectrogram::n_levels() const
 {
-    return m_pImpl->n_bin();
+    return m_pImpl->n_levels();
 }
 
-double Spectrogram::min_db() const
+int Spectrogram::n_bin(int level) const
 {
-    return m_pImpl->min_db();
+    return m_pImpl->n_bin(level);
 }
 
-double Spectrogram::max_db() const
+int Spectrogram::n_fft() const
 {
-    return m_pImpl->max_db();
+    return m_pImpl->n_fft();
+}
+
+int Spectrogram::hop() const
+{
+    return m_pImpl->hop();
 }
 
 float Spectrogram::min_frq() const
@@ -147,3 +1011,89 @@ float Spectrogram::max_frq() const
     return m_pImpl->max_frq();
 }
 
+Spectrum::Spectrum()
+{
+    m_settings.m_fftSize = 0;
+}
+
+Spectrum::~Spectrum()
+{
+}
+
+void Spectrum::update(const std::vector<SampleView>& channels, uint64_t position, const SpectrogramSettings& settings)
+{
+    if (!isValidSpectrogramSettings(settings)) {
+        return;
+    }
+    if (settings.m_fftSize != m_settings.m_fftSize || settings.m_window != m_settings.m_window) {
+        if (settings.m_fftSize != m_settings.m_fftSize) {
+            m_pFft.reset(new RealFft(settings.m_fftSize));
+        }
+        m_settings = settings;
+        m_pWindow = createWindow(settings);
+        m_power.clear();
+    }
+    if (m_power.size() != channels.size() || (!m_power.empty() && m_power[0].size() != (size_t)n_frq())) {
+        m_power.assign(channels.size(), std::vector<float>(n_frq()));
+        m_spectra.assign(channels.size(), std::vector<float>(n_frq()));
+        m_peaks.assign(channels.size(), std::vector<float>(n_frq()));
+        m_bReset = true;
+    }
+
+    // Only the samples within each channel are read, the rest are zero, and the channels
+    // are transformed together
+    const int fftSize = m_settings.m_fftSize;
+    const int numFrequencies = n_frq();
+    const int64_t start = (int64_t)position - (fftSize / 2);
+    m_input.assign(channels.size() * fftSize, 0.0f);
+    m_frames.resize(channels.size() * numFrequencies);
+    for (size_t ch = 0; ch < channels.size(); ch++) {
+        const int64_t numSamples = (int64_t)channels[ch].size();
+        const int64_t first = std::min(std::max(start, (int64_t)0), numSamples);
+        const int64_t last = std::min(std::max(start + fftSize, (int64_t)0), numSamples);
+        if (last > first) {
+            channels[ch].read((uint64_t)first, (uint64_t)(last - first), &m_input[ch * fftSize + (first - start)]);
+        }
+    }
+    transformFrames(*m_pFft, *m_pWindow, m_input.data(), (int)channels.size(), m_output, m_frames.data());
+
+    const float weight = (m_bReset ? 1.0f : 1.0f / m_numAverages);
+    for (size_t ch = 0; ch < channels.size(); ch++) {
+        const float* frame = &m_frames[ch * numFrequencies];
+        std::vector<float>& power = m_power[ch];
+        std::vector<float>& spectrum = m_spectra[ch];
+        std::vector<float>& peaks = m_peaks[ch];
+        for (int f = 0; f < numFrequencies; f++) {
+            const float db = frame[numFrequencies - 1 - f];
+            power[f] += (std::exp(db * kNepersPerDecibel) - power[f]) * weight;
+            spectrum[f] = std::log(std::max(power[f], kMinPower)) / kNepersPerDecibel;
+            peaks[f] = (m_bReset ? spectrum[f] : std::max(peaks[f], spectrum[f]));
+        }
+    }
+    m_bReset = false;
+}
+
+void Spectrum::reset()
+{
+    m_bReset = true;
+}
+
+void Spectrum::setNumAverages(int numAverages)
+{
+    m_numAverages = std::max(numAverages, 1);
+}
+
+int Spectrum::n_frq() const
+{
+    return m_settings.m_fftSize / 2 + 1;
+}
+
+const float* Spectrum::spectrum(size_t ch) const
+{
+    return m_spectra[ch].data();
+}
+
+const float* Spectrum::peaks(size_t ch) const
+{
+    return m_peaks[ch].data();
+}
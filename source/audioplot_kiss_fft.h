@@ -1,21 +1,187 @@
 #ifndef AUDIOPLOT_KISS_FFT_H
 #define AUDIOPLOT_KISS_FFT_H
 
+#include <cstddef>
+#include <atomic>
+#include <complex>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
 #include <vector>
 
+#include "audioplot_samples.h"
+
+class ThreadPool;
+class RealFft;
+
+enum SpectrogramWindow
+{
+    SPECTROGRAM_WINDOW_RECTANGULAR,
+    SPECTROGRAM_WINDOW_HANN,
+    SPECTROGRAM_WINDOW_HAMMING,
+    SPECTROGRAM_WINDOW_BLACKMAN_HARRIS,
+    SPECTROGRAM_WINDOW_KAISER,
+    NUM_SPECTROGRAM_WINDOWS
+};
+
+// Spacing of the rows of a spectrogram view, from its frequencies or bands of them
+enum SpectrogramScale
+{
+    SPECTROGRAM_SCALE_LINEAR,
+    SPECTROGRAM_SCALE_MEL,
+    SPECTROGRAM_SCALE_LOG,
+    SPECTROGRAM_SCALE_CONSTANT_Q,
+    NUM_SPECTROGRAM_SCALES
+};
+
+// Storage of spectrogram values, as dB, or to save memory quantized to steps of dB above
+// an offset and clamped to their range. In every format a value is offset + value * step dB.
+enum SpectrogramFormat
+{
+    SPECTROGRAM_FORMAT_F32,
+    SPECTROGRAM_FORMAT_U16,  // 1/256 dB steps from -140 dB
+    SPECTROGRAM_FORMAT_U8,   // 0.75 dB steps from -120 dB
+    NUM_SPECTROGRAM_FORMATS
+};
+
+const int kMinSpectrogramFftSize = 256;
+const int kMaxSpectrogramFftSize = 16384;
+
+// Histograms of spectrogram values have bins of kSpectrogramHistogramStep dB from kSpectrogramHistogramMinDb
+const int kSpectrogramHistogramBins = 440;
+const float kSpectrogramHistogramMinDb = -140.0f;
+const float kSpectrogramHistogramStep = 0.5f;
+
+struct SpectrogramSettings
+{
+    int m_fftSize = 1024;     // a power of two
+    int m_hop = 1024;         // samples between frames, at most m_fftSize
+    SpectrogramWindow m_window = SPECTROGRAM_WINDOW_RECTANGULAR;
+    SpectrogramFormat m_format = SPECTROGRAM_FORMAT_F32;  // of the frames
+};
+
+bool isValidSpectrogramSettings(const SpectrogramSettings& settings);
+const char* getSpectrogramWindowName(SpectrogramWindow window);
+const char* getSpectrogramScaleName(SpectrogramScale scale);
+const char* getSpectrogramFormatName(SpectrogramFormat format);
+
+// Bytes of a value, and the offset and step of its dB level
+uint32_t getSpectrogramFormatSize(SpectrogramFormat format);
+float getSpectrogramFormatOffset(SpectrogramFormat format);
+float getSpectrogramFormatStep(SpectrogramFormat format);
+
+// Convert count dB values to a format, rounding to the nearest step, and back
+void quantizeSpectrogramValues(const float* pDb, int count, SpectrogramFormat format, uint8_t* pValues);
+void dequantizeSpectrogramValues(const uint8_t* pValues, int count, SpectrogramFormat format, float* pDb);
+
+// The dB value below which fraction of the values counted in a histogram fall, if any are
+bool getSpectrogramPercentile(const uint64_t* pHistogram, double fraction, float* pDb);
+
+// A block of spectrogram frames of a trace, from the levels or from tiles, every hop
+// samples, with rows in a scale
+struct SpectrogramBlockKey
+{
+    int32_t m_trace;
+    uint64_t m_hop;
+    uint64_t m_index;
+    bool m_bTile;
+    SpectrogramScale m_scale;
+
+    bool operator<(const SpectrogramBlockKey& other) const
+    {
+        if (m_trace != other.m_trace) {
+            return m_trace < other.m_trace;
+        }
+        if (m_hop != other.m_hop) {
+            return m_hop < other.m_hop;
+        }
+        if (m_index != other.m_index) {
+            return m_index < other.m_index;
+        }
+        if (m_bTile != other.m_bTile) {
+            return m_bTile < other.m_bTile;
+        }
+        return m_scale < other.m_scale;
+    }
+};
+
+// Frames of a spectrogram at one hop, computed on request
+struct SpectrogramTile
+{
+    uint64_t m_binStart = 0;      // in frames of the tile's hop
+    int m_numBins = 0;            // fewer than Spectrogram::tile_bins() at the end of the samples
+    int m_fftSize = 0;            // of the settings it was computed with
+    SpectrogramFormat m_format = SPECTROGRAM_FORMAT_F32;
+    uint64_t m_generation = 0;    // of those settings, as for Spectrogram::generation()
+    std::vector<uint8_t> m_frames;  // values in m_format, one FFT frame after another (column major)
+};
+
 class Spectrogram
 {
 public:
     Spectrogram();
     ~Spectrogram();
 
-    void initialize(const std::vector<std::vector<double>>& samples, float sampleRate);
+    void initialize(size_t numChannels, float sampleRate, uint64_t expectedNumSamples, const SpectrogramSettings& settings);
+
+    // Compute tiles on numThreads background threads, reading samples from views while
+    // holding mutex, keeping at most cacheSize bytes of them. onFramesReady is called as
+    // each tile is done, and as update() publishes each batch of frames.
+    void initializeTiles(const std::vector<SampleView>& views, std::mutex& mutex, uint32_t numThreads,
+                         uint64_t cacheSize, std::function<void()> onFramesReady);
+    void stopTiles();
+
+    // In lazy mode no frames are computed as samples are loaded, only tiles as they are viewed
+    void setLazy(bool bLazy);
+    bool isLazy() const;
+
+    // New settings apply to tiles straight away, and to the levels from the next update(),
+    // which computes them again from the start. Call with the mutex held.
+    void setSettings(const SpectrogramSettings& settings);
+    const SpectrogramSettings& settings() const;           // of the levels
+    const SpectrogramSettings& requestedSettings() const;  // latest set
+    uint64_t generation() const;                           // changes whenever settings() do
+    bool hasPendingSettings() const;
+
+    // Keep the FFT frames in scratch files in directory, rather than RAM
+    void spill(const std::string& directory);
+    // Compute any new FFT frames, a batch at a time until they are done or bCancel is set,
+    // holding the mutex only while frames are resized or published
+    void update(const std::vector<SampleView>& samples, ThreadPool& threadPool, std::mutex& mutex, const std::atomic<bool>& bCancel);
+
+    // Use FFT frames computed earlier for a level of a channel, e.g. mapped from a cache
+    // file, n_frq() * numBins values in the format of the settings, which must outlive the
+    // spectrogram
+    void load(size_t ch, int level, const uint8_t* pData, int numBins);
+    void loadHistogram(size_t ch, const uint64_t* pHistogram);
+
+    // kSpectrogramHistogramBins counts of the level 0 values of a channel, gathered as
+    // frames are published (or in lazy mode, as tiles are computed) and cleared when the
+    // settings change. Values below the range, e.g. of silence, aren't counted, and those
+    // above it are counted in the last bin. Call with the mutex held.
+    const uint64_t* histogram(size_t ch) const;
+
+    // Tiles of tile_bins() frames every hop samples, for views zoomed in beyond level 0, or
+    // any view in lazy mode. tile() returns a tile if it has been computed, queueing it if
+    // not, and prefetchTile() queues a tile behind those being drawn. They must be called
+    // with the mutex held. clearTileRequests() drops queued tiles that are out of view.
+    std::shared_ptr<const SpectrogramTile> tile(size_t ch, uint64_t hop, uint64_t index);
+    void prefetchTile(size_t ch, uint64_t hop, uint64_t index);
+    void clearTileRequests();
+    int tile_bins() const;
 
-    const std::vector<float>& data(size_t ch) const;
+    // Level 0 holds the FFT of n_fft() samples every hop() samples, and each level above
+    // it the maximum of pairs of frames of the level below, for zoomed out views. Values
+    // are in the format of settings(), frame_bytes() for each frame.
+    const uint8_t* data(size_t ch, int level = 0) const;
+    size_t frame_bytes() const;
     int n_frq() const;
-    int n_bin() const;
-    double min_db() const;
-    double max_db() const;
+    int n_levels() const;
+    int n_bin(int level = 0) const;
+    int n_fft() const;
+    int hop() const;
     float min_frq() const;
     float max_frq() const;
 
@@ -24,4 +190,45 @@ private:
     SpectrogramImpl* m_pImpl;
 };
 
+// Spectra of the samples of each channel around a position, e.g. the cursor, windowed and
+// scaled as spectrogram frames are, averaged over those computed before and with the peak
+// of each frequency held. The FFT plan and buffers are kept between updates, so an update
+// allocates nothing unless the settings or number of channels change.
+class Spectrum
+{
+public:
+    Spectrum();
+    ~Spectrum();
+
+    // Compute the spectra of settings.m_fftSize samples centred on position, with samples
+    // beyond the ends taken as zero. Averages and peaks start again if the settings change.
+    void update(const std::vector<SampleView>& channels, uint64_t position, const SpectrogramSettings& settings);
+    void reset();
+
+    // Average the power of each frequency exponentially over about numAverages updates, or
+    // not at all for 1
+    void setNumAverages(int numAverages);
+
+    // dB values of each frequency from 0 Hz, averaged, and the highest of them since reset()
+    int n_frq() const;
+    const float* spectrum(size_t ch) const;
+    const float* peaks(size_t ch) const;
+
+private:
+    Spectrum(const Spectrum&);
+    Spectrum& operator=(const Spectrum&);
+
+    SpectrogramSettings m_settings;
+    std::unique_ptr<RealFft> m_pFft;
+    std::shared_ptr<const std::vector<float>> m_pWindow;
+    std::vector<float> m_input;   // of each channel
+    std::vector<std::complex<float>> m_output;
+    std::vector<float> m_frames;  // dB values of each channel, highest frequency first
+    std::vector<std::vector<float>> m_power;  // averaged, of each channel
+    std::vector<std::vector<float>> m_spectra;
+    std::vector<std::vector<float>> m_peaks;
+    int m_numAverages = 1;
+    bool m_bReset = true;
+};
+
 #endif // AUDIOPLOT_KISS_FFT_H
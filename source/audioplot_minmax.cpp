@@ -0,0 +1,451 @@
+#include "audioplot_minmax.h"
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__)))
+#define AUDIOPLOT_MINMAX_SSE2 1
+#define AUDIOPLOT_MINMAX_AVX2 1
+#include <emmintrin.h>
+#include <immintrin.h>
+#define AUDIOPLOT_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+static const float kScaleS16 = 1.0f / 32768.0f;
+
+static MinMaxKernel s_maxKernel = MINMAX_KERNEL_AVX2;
+
+static inline float toFloat(float value)
+{
+    return value;
+}
+
+static inline float toFloat(int16_t value)
+{
+    return (float)value * kScaleS16;  // exact, matching sampleToDouble()
+}
+
+// Scalar
+
+template<typename T>
+static void reduceMinMax4ScalarT(const T* pValues, uint64_t numWindows, float* pMinMaxOut)
+{
+    for (uint64_t window = 0; window < numWindows; window++) {
+        const T* pWindow = pValues + 4 * window;
+        float yMin = toFloat(pWindow[0]);
+        float yMax = yMin;
+        int indexMin = 0;
+        int indexMax = 0;
+        for (int index = 1; index < 4; index++) {
+            const float y = toFloat(pWindow[index]);
+            if (y < yMin) {
+                indexMin = index;
+                yMin = y;
+            }
+            if (y > yMax) {
+                indexMax = index;
+                yMax = y;
+            }
+        }
+
+        if (indexMin < indexMax) {
+            pMinMaxOut[2 * window] = yMin;
+            pMinMaxOut[2 * window + 1] = yMax;
+        }
+        else {
+            pMinMaxOut[2 * window] = yMax;
+            pMinMaxOut[2 * window + 1] = yMin;
+        }
+    }
+}
+
+template<typename T>
+static MinMax findMinMaxScalarT(const T* pValues, uint64_t count)
+{
+    MinMax result;
+    if (count == 0) {
+        return result;
+    }
+
+    result.m_min = toFloat(pValues[0]);
+    result.m_max = result.m_min;
+    for (uint64_t index = 1; index < count; index++) {
+        const float y = toFloat(pValues[index]);
+        if (y < result.m_min) {
+            result.m_indexMin = index;
+            result.m_min = y;
+        }
+        if (y > result.m_max) {
+            result.m_indexMax = index;
+            result.m_max = y;
+        }
+    }
+    return result;
+}
+
+void reduceMinMax4Scalar(const float* pValues, uint64_t numWindows, float* pMinMaxOut)
+{
+    reduceMinMax4ScalarT(pValues, numWindows, pMinMaxOut);
+}
+
+void reduceMinMax4Scalar(const int16_t* pValues, uint64_t numWindows, float* pMinMaxOut)
+{
+    reduceMinMax4ScalarT(pValues, numWindows, pMinMaxOut);
+}
+
+MinMax findMinMaxScalar(const float* pValues, uint64_t count)
+{
+    return findMinMaxScalarT(pValues, count);
+}
+
+MinMax findMinMaxScalar(const int16_t* pValues, uint64_t count)
+{
+    return findMinMaxScalarT(pValues, count);
+}
+
+#if defined(AUDIOPLOT_MINMAX_SSE2)
+
+// SSE2
+//
+// Windows are processed 4 at a time, transposed so that each register holds the
+// same position of each window, and the first occurrence of the min and max is
+// tracked with compare and select exactly as in the scalar loop.
+
+static inline __m128 select(__m128 mask, __m128 a, __m128 b)
+{
+    return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+static inline void loadWindows(const float* pValues, __m128* pRows)
+{
+    for (int i = 0; i < 4; i++) {
+        pRows[i] = _mm_loadu_ps(pValues + 4 * i);
+    }
+}
+
+static inline void loadWindows(const int16_t* pValues, __m128* pRows)
+{
+    const __m128 scale = _mm_set1_ps(kScaleS16);
+    for (int i = 0; i < 2; i++) {
+        const __m128i values = _mm_loadu_si128((const __m128i*)(pValues + 8 * i));
+        const __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(values, values), 16);
+        const __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(values, values), 16);
+        pRows[2 * i] = _mm_mul_ps(_mm_cvtepi32_ps(lo), scale);
+        pRows[2 * i + 1] = _mm_mul_ps(_mm_cvtepi32_ps(hi), scale);
+    }
+}
+
+template<typename T>
+static void reduceMinMax4Sse2(const T* pValues, uint64_t numWindows, float* pMinMaxOut)
+{
+    const uint64_t numBlocks = numWindows / 4;
+    for (uint64_t block = 0; block < numBlocks; block++) {
+        __m128 rows[4];
+        loadWindows(pValues + 16 * block, rows);
+        _MM_TRANSPOSE4_PS(rows[0], rows[1], rows[2], rows[3]);
+
+        __m128 yMin = rows[0];
+        __m128 yMax = rows[0];
+        __m128 indexMin = _mm_setzero_ps();
+        __m128 indexMax = _mm_setzero_ps();
+        for (int index = 1; index < 4; index++) {
+            const __m128 y = rows[index];
+            const __m128 position = _mm_set1_ps((float)index);
+            const __m128 bLess = _mm_cmplt_ps(y, yMin);
+            const __m128 bGreater = _mm_cmpgt_ps(y, yMax);
+            yMin = select(bLess, y, yMin);
+            indexMin = select(bLess, position, indexMin);
+            yMax = select(bGreater, y, yMax);
+            indexMax = select(bGreater, position, indexMax);
+        }
+
+        const __m128 bMinFirst = _mm_cmplt_ps(indexMin, indexMax);
+        const __m128 first = select(bMinFirst, yMin, yMax);
+        const __m128 second = select(bMinFirst, yMax, yMin);
+        _mm_storeu_ps(pMinMaxOut + 8 * block, _mm_unpacklo_ps(first, second));
+        _mm_storeu_ps(pMinMaxOut + 8 * block + 4, _mm_unpackhi_ps(first, second));
+    }
+
+    reduceMinMax4ScalarT(pValues + 16 * numBlocks, numWindows - 4 * numBlocks, pMinMaxOut + 8 * numBlocks);
+}
+
+// The min and max values are found first, ignoring positions, then the first
+// occurrence of each is searched for. Values equal under == are not always
+// bit-identical (0.0 and -0.0), so the result takes the value found in the data.
+static MinMax findMinMaxSse2(const float* pValues, uint64_t count)
+{
+    if (count < 8 || pValues[0] != pValues[0]) {
+        return findMinMaxScalarT(pValues, count);  // a leading NaN is kept by the scalar loop
+    }
+
+    // Operand order makes a NaN in the data keep the running value, as y < yMin would
+    __m128 yMin = _mm_set1_ps(pValues[0]);
+    __m128 yMax = yMin;
+    uint64_t index = 0;
+    for (; index + 4 <= count; index += 4) {
+        const __m128 y = _mm_loadu_ps(pValues + index);
+        yMin = _mm_min_ps(y, yMin);
+        yMax = _mm_max_ps(y, yMax);
+    }
+    float mins[4];
+    float maxs[4];
+    _mm_storeu_ps(mins, yMin);
+    _mm_storeu_ps(maxs, yMax);
+    float valueMin = mins[0];
+    float valueMax = maxs[0];
+    for (int i = 1; i < 4; i++) {
+        valueMin = (mins[i] < valueMin) ? mins[i] : valueMin;
+        valueMax = (maxs[i] > valueMax) ? maxs[i] : valueMax;
+    }
+    for (; index < count; index++) {
+        valueMin = (pValues[index] < valueMin) ? pValues[index] : valueMin;
+        valueMax = (pValues[index] > valueMax) ? pValues[index] : valueMax;
+    }
+
+    MinMax result;
+    const __m128 targetMin = _mm_set1_ps(valueMin);
+    const __m128 targetMax = _mm_set1_ps(valueMax);
+    bool bFoundMin = false;
+    bool bFoundMax = false;
+    for (index = 0; index + 4 <= count && !(bFoundMin && bFoundMax); index += 4) {
+        const __m128 y = _mm_loadu_ps(pValues + index);
+        if (!bFoundMin) {
+            const int mask = _mm_movemask_ps(_mm_cmpeq_ps(y, targetMin));
+            if (mask != 0) {
+                bFoundMin = true;
+                result.m_indexMin = index + __builtin_ctz(mask);
+            }
+        }
+        if (!bFoundMax) {
+            const int mask = _mm_movemask_ps(_mm_cmpeq_ps(y, targetMax));
+            if (mask != 0) {
+                bFoundMax = true;
+                result.m_indexMax = index + __builtin_ctz(mask);
+            }
+        }
+    }
+    for (; index < count && !(bFoundMin && bFoundMax); index++) {
+        if (!bFoundMin && pValues[index] == valueMin) {
+            bFoundMin = true;
+            result.m_indexMin = index;
+        }
+        if (!bFoundMax && pValues[index] == valueMax) {
+            bFoundMax = true;
+            result.m_indexMax = index;
+        }
+    }
+    result.m_min = pValues[result.m_indexMin];
+    result.m_max = pValues[result.m_indexMax];
+    return result;
+}
+
+static uint64_t findFirst(const int16_t* pValues, uint64_t count, int16_t target)
+{
+    const __m128i targets = _mm_set1_epi16(target);
+    uint64_t index = 0;
+    for (; index + 8 <= count; index += 8) {
+        const __m128i values = _mm_loadu_si128((const __m128i*)(pValues + index));
+        const int mask = _mm_movemask_epi8(_mm_cmpeq_epi16(values, targets));
+        if (mask != 0) {
+            return index + __builtin_ctz(mask) / 2;
+        }
+    }
+    for (; index < count; index++) {
+        if (pValues[index] == target) {
+            break;
+        }
+    }
+    return index;
+}
+
+static MinMax findMinMaxSse2(const int16_t* pValues, uint64_t count)
+{
+    if (count < 16) {
+        return findMinMaxScalarT(pValues, count);
+    }
+
+    __m128i yMin = _mm_set1_epi16(pValues[0]);
+    __m128i yMax = yMin;
+    uint64_t index = 0;
+    for (; index + 8 <= count; index += 8) {
+        const __m128i y = _mm_loadu_si128((const __m128i*)(pValues + index));
+        yMin = _mm_min_epi16(y, yMin);
+        yMax = _mm_max_epi16(y, yMax);
+    }
+    int16_t mins[8];
+    int16_t maxs[8];
+    _mm_storeu_si128((__m128i*)mins, yMin);
+    _mm_storeu_si128((__m128i*)maxs, yMax);
+    int16_t valueMin = mins[0];
+    int16_t valueMax = maxs[0];
+    for (int i = 1; i < 8; i++) {
+        valueMin = (mins[i] < valueMin) ? mins[i] : valueMin;
+        valueMax = (maxs[i] > valueMax) ? maxs[i] : valueMax;
+    }
+    for (; index < count; index++) {
+        valueMin = (pValues[index] < valueMin) ? pValues[index] : valueMin;
+        valueMax = (pValues[index] > valueMax) ? pValues[index] : valueMax;
+    }
+
+    MinMax result;
+    result.m_indexMin = findFirst(pValues, count, valueMin);
+    result.m_indexMax = findFirst(pValues, count, valueMax);
+    result.m_min = toFloat(valueMin);
+    result.m_max = toFloat(valueMax);
+    return result;
+}
+
+#endif // AUDIOPLOT_MINMAX_SSE2
+
+#if defined(AUDIOPLOT_MINMAX_AVX2)
+
+// AVX2
+//
+// As for SSE2, but 8 windows at a time. The 4x4 transpose is done within each
+// 128-bit lane, so the windows end up in the order 0 2 4 6 | 1 3 5 7, which the
+// interleaving of the results puts back in order.
+
+AUDIOPLOT_TARGET_AVX2 static inline __m256 select256(__m256 mask, __m256 a, __m256 b)
+{
+    return _mm256_blendv_ps(b, a, mask);
+}
+
+AUDIOPLOT_TARGET_AVX2 static inline void loadWindows256(const float* pValues, __m256* pRows)
+{
+    for (int i = 0; i < 4; i++) {
+        pRows[i] = _mm256_loadu_ps(pValues + 8 * i);
+    }
+}
+
+AUDIOPLOT_TARGET_AVX2 static inline void loadWindows256(const int16_t* pValues, __m256* pRows)
+{
+    const __m256 scale = _mm256_set1_ps(kScaleS16);
+    for (int i = 0; i < 4; i++) {
+        const __m128i values = _mm_loadu_si128((const __m128i*)(pValues + 8 * i));
+        pRows[i] = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(values)), scale);
+    }
+}
+
+template<typename T>
+AUDIOPLOT_TARGET_AVX2 static void reduceMinMax4Avx2(const T* pValues, uint64_t numWindows, float* pMinMaxOut)
+{
+    const uint64_t numBlocks = numWindows / 8;
+    for (uint64_t block = 0; block < numBlocks; block++) {
+        __m256 rows[4];
+        loadWindows256(pValues + 32 * block, rows);
+        const __m256 t0 = _mm256_unpacklo_ps(rows[0], rows[1]);
+        const __m256 t1 = _mm256_unpacklo_ps(rows[2], rows[3]);
+        const __m256 t2 = _mm256_unpackhi_ps(rows[0], rows[1]);
+        const __m256 t3 = _mm256_unpackhi_ps(rows[2], rows[3]);
+        rows[0] = _mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(1, 0, 1, 0));
+        rows[1] = _mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(3, 2, 3, 2));
+        rows[2] = _mm256_shuffle_ps(t2, t3, _MM_SHUFFLE(1, 0, 1, 0));
+        rows[3] = _mm256_shuffle_ps(t2, t3, _MM_SHUFFLE(3, 2, 3, 2));
+
+        __m256 yMin = rows[0];
+        __m256 yMax = rows[0];
+        __m256 indexMin = _mm256_setzero_ps();
+        __m256 indexMax = _mm256_setzero_ps();
+        for (int index = 1; index < 4; index++) {
+            const __m256 y = rows[index];
+            const __m256 position = _mm256_set1_ps((float)index);
+            const __m256 bLess = _mm256_cmp_ps(y, yMin, _CMP_LT_OQ);
+            const __m256 bGreater = _mm256_cmp_ps(y, yMax, _CMP_GT_OQ);
+            yMin = select256(bLess, y, yMin);
+            indexMin = select256(bLess, position, indexMin);
+            yMax = select256(bGreater, y, yMax);
+            indexMax = select256(bGreater, position, indexMax);
+        }
+
+        const __m256 bMinFirst = _mm256_cmp_ps(indexMin, indexMax, _CMP_LT_OQ);
+        const __m256 first = select256(bMinFirst, yMin, yMax);
+        const __m256 second = select256(bMinFirst, yMax, yMin);
+        const __m256d lo = _mm256_castps_pd(_mm256_unpacklo_ps(first, second));  // 0 2 | 1 3
+        const __m256d hi = _mm256_castps_pd(_mm256_unpackhi_ps(first, second));  // 4 6 | 5 7
+        _mm256_storeu_ps(pMinMaxOut + 16 * block, _mm256_castpd_ps(_mm256_permute4x64_pd(lo, _MM_SHUFFLE(3, 1, 2, 0))));
+        _mm256_storeu_ps(pMinMaxOut + 16 * block + 8, _mm256_castpd_ps(_mm256_permute4x64_pd(hi, _MM_SHUFFLE(3, 1, 2, 0))));
+    }
+    _mm256_zeroupper();  // avoid AVX to SSE transition stalls in the code that follows
+
+    reduceMinMax4Sse2(pValues + 32 * numBlocks, numWindows - 8 * numBlocks, pMinMaxOut + 16 * numBlocks);
+}
+
+static bool hasAvx2()
+{
+    static const bool bAvx2 = __builtin_cpu_supports("avx2");
+    return bAvx2;
+}
+
+#endif // AUDIOPLOT_MINMAX_AVX2
+
+// Dispatch
+
+bool isMinMaxKernelSupported(MinMaxKernel kernel)
+{
+    switch (kernel) {
+        case MINMAX_KERNEL_SCALAR:
+            return true;
+#if defined(AUDIOPLOT_MINMAX_SSE2)
+        case MINMAX_KERNEL_SSE2:
+            return true;
+#endif
+#if defined(AUDIOPLOT_MINMAX_AVX2)
+        case MINMAX_KERNEL_AVX2:
+            return hasAvx2();
+#endif
+        default:
+            return false;
+    }
+}
+
+void setMaxMinMaxKernel(MinMaxKernel kernel)
+{
+    s_maxKernel = kernel;
+}
+
+template<typename T>
+static void reduceMinMax4T(const T* pValues, uint64_t numWindows, float* pMinMaxOut)
+{
+#if defined(AUDIOPLOT_MINMAX_AVX2)
+    if (s_maxKernel >= MINMAX_KERNEL_AVX2 && hasAvx2()) {
+        reduceMinMax4Avx2(pValues, numWindows, pMinMaxOut);
+        return;
+    }
+#endif
+#if defined(AUDIOPLOT_MINMAX_SSE2)
+    if (s_maxKernel >= MINMAX_KERNEL_SSE2) {
+        reduceMinMax4Sse2(pValues, numWindows, pMinMaxOut);
+        return;
+    }
+#endif
+    reduceMinMax4ScalarT(pValues, numWindows, pMinMaxOut);
+}
+
+// There is no AVX2 kernel, so the SSE2 one is also used when AVX2 is allowed
+template<typename T>
+static MinMax findMinMaxT(const T* pValues, uint64_t count)
+{
+#if defined(AUDIOPLOT_MINMAX_SSE2)
+    if (s_maxKernel >= MINMAX_KERNEL_SSE2) {
+        return findMinMaxSse2(pValues, count);
+    }
+#endif
+    return findMinMaxScalarT(pValues, count);
+}
+
+void reduceMinMax4(const float* pValues, uint64_t numWindows, float* pMinMaxOut)
+{
+    reduceMinMax4T(pValues, numWindows, pMinMaxOut);
+}
+
+void reduceMinMax4(const int16_t* pValues, uint64_t numWindows, float* pMinMaxOut)
+{
+    reduceMinMax4T(pValues, numWindows, pMinMaxOut);
+}
+
+MinMax findMinMax(const float* pValues, uint64_t count)
+{
+    return findMinMaxT(pValues, count);
+}
+
+MinMax findMinMax(const int16_t* pValues, uint64_t count)
+{
+    return findMinMaxT(pValues, count);
+}
@@ -0,0 +1,46 @@
+#ifndef AUDIOPLOT_MINMAX_H
+#define AUDIOPLOT_MINMAX_H
+
+#include <cstdint>
+
+// Min/max reduction kernels, vectorized with SSE2 or AVX2 (chosen at runtime on x86)
+// and with a scalar fallback. All implementations give bit-identical results.
+// int16 samples are scaled to -1 to +1, as by sampleToDouble().
+
+// Reduce each window of 4 consecutive values to its min and max, written in the
+// order they occur in the window (the first occurrence of each wins ties, and an
+// all-equal window gives max then min).
+void reduceMinMax4(const float* pValues, uint64_t numWindows, float* pMinMaxOut);
+void reduceMinMax4(const int16_t* pValues, uint64_t numWindows, float* pMinMaxOut);
+
+// Min and max of a range of values, with the index of the first occurrence of each
+struct MinMax
+{
+    float m_min = 0.0f;
+    float m_max = 0.0f;
+    uint64_t m_indexMin = 0;
+    uint64_t m_indexMax = 0;
+};
+
+MinMax findMinMax(const float* pValues, uint64_t count);
+MinMax findMinMax(const int16_t* pValues, uint64_t count);
+
+// Scalar reference implementations
+void reduceMinMax4Scalar(const float* pValues, uint64_t numWindows, float* pMinMaxOut);
+void reduceMinMax4Scalar(const int16_t* pValues, uint64_t numWindows, float* pMinMaxOut);
+MinMax findMinMaxScalar(const float* pValues, uint64_t count);
+MinMax findMinMaxScalar(const int16_t* pValues, uint64_t count);
+
+// The kernels the functions above can choose from, fastest last. Limiting them to a kernel
+// lets each be tested against the scalar implementations.
+enum MinMaxKernel
+{
+    MINMAX_KERNEL_SCALAR,
+    MINMAX_KERNEL_SSE2,
+    MINMAX_KERNEL_AVX2,
+};
+
+bool isMinMaxKernelSupported(MinMaxKernel kernel);  // by this build and CPU
+void setMaxMinMaxKernel(MinMaxKernel kernel);       // the fastest supported kernel up to this one is used (AVX2 by default)
+
+#endif // AUDIOPLOT_MINMAX_H
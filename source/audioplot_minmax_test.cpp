@@ -0,0 +1,148 @@
+// Checks that each vectorized min/max kernel the CPU supports gives bit-identical results
+// to the scalar reference implementations, for float and int16 inputs with ties, mixed
+// 0.0 and -0.0, NaNs and lengths that leave a tail after the vector loops.
+//
+//     audioplot_minmax_test
+
+#include "audioplot_minmax.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <random>
+#include <vector>
+
+static const int kMaxCount = 300;   // covers several 4, 8 and 16 value blocks plus every tail length
+static const int kMaxOffset = 3;    // unaligned starts
+static const int kNumRandomRuns = 200;
+
+static const char* const kKernelNames[] = {"scalar", "SSE2", "AVX2"};
+
+static int g_numFailures = 0;
+static const char* g_pKernelName = "";
+
+static void fail(const char* pName, const char* pKind, uint64_t count, uint64_t offset)
+{
+    if (g_numFailures < 20) {
+        fprintf(stderr, "FAIL %s %s (%s): count %llu, offset %llu\n", g_pKernelName, pName, pKind,
+                (unsigned long long)count, (unsigned long long)offset);
+    }
+    g_numFailures++;
+}
+
+static bool sameBits(float a, float b)
+{
+    return memcmp(&a, &b, sizeof(float)) == 0;
+}
+
+template<typename T>
+static void checkReduceMinMax4(const char* pKind, const std::vector<T>& values)
+{
+    for (uint64_t offset = 0; offset <= kMaxOffset; offset++) {
+        for (uint64_t numWindows = 0; 4 * numWindows + offset <= values.size(); numWindows++) {
+            // Padding after the output catches writes past the last window
+            std::vector<float> expected(2 * numWindows + 4, 123.0f);
+            std::vector<float> actual(2 * numWindows + 4, 123.0f);
+            reduceMinMax4Scalar(values.data() + offset, numWindows, expected.data());
+            reduceMinMax4(values.data() + offset, numWindows, actual.data());
+            if (memcmp(expected.data(), actual.data(), expected.size() * sizeof(float)) != 0) {
+                fail("reduceMinMax4", pKind, numWindows, offset);
+            }
+        }
+    }
+}
+
+template<typename T>
+static void checkFindMinMax(const char* pKind, const std::vector<T>& values)
+{
+    for (uint64_t offset = 0; offset <= kMaxOffset; offset++) {
+        for (uint64_t count = 0; count + offset <= values.size(); count++) {
+            const MinMax expected = findMinMaxScalar(values.data() + offset, count);
+            const MinMax actual = findMinMax(values.data() + offset, count);
+            if (!sameBits(expected.m_min, actual.m_min) || !sameBits(expected.m_max, actual.m_max) ||
+                expected.m_indexMin != actual.m_indexMin || expected.m_indexMax != actual.m_indexMax) {
+                fail("findMinMax", pKind, count, offset);
+            }
+        }
+    }
+}
+
+template<typename T>
+static void check(const char* pKind, const std::vector<T>& values)
+{
+    checkReduceMinMax4(pKind, values);
+    checkFindMinMax(pKind, values);
+}
+
+static void checkAll()
+{
+    const float nan = std::numeric_limits<float>::quiet_NaN();
+    std::mt19937 random(1);
+
+    // A few distinct values, so windows and ranges have many ties
+    static const float floatValues[] = {0.0f, -0.0f, 0.5f, -0.5f, 1.0f, -1.0f, 0.25f};
+    static const int16_t intValues[] = {0, 1, -1, 16384, -16384, 32767, -32768};
+    std::uniform_int_distribution<int> pick(0, 6);
+    std::uniform_real_distribution<float> uniform(-1.0f, 1.0f);
+    std::uniform_int_distribution<int> uniform16(-32768, 32767);
+    std::uniform_int_distribution<int> position(0, kMaxCount - 1);
+
+    for (int run = 0; run < kNumRandomRuns; run++) {
+        std::vector<float> floats(kMaxCount);
+        std::vector<int16_t> ints(kMaxCount);
+        for (int i = 0; i < kMaxCount; i++) {
+            floats[i] = (run % 2 == 0) ? floatValues[pick(random)] : uniform(random);
+            ints[i] = (run % 2 == 0) ? intValues[pick(random)] : (int16_t)uniform16(random);
+        }
+        check("int16", ints);
+        check("float", floats);
+
+        // NaNs scattered through the data, and at the start of the range and of windows
+        for (int i = 0; i < 1 + run % 4; i++) {
+            floats[position(random)] = nan;
+        }
+        floats[run % (kMaxOffset + 1)] = nan;
+        check("float with NaNs", floats);
+    }
+
+    // Constant runs: every window and range is all ties
+    check("float zeros", std::vector<float>(kMaxCount, 0.0f));
+    check("float negative zeros", std::vector<float>(kMaxCount, -0.0f));
+    check("int16 constant", std::vector<int16_t>(kMaxCount, (int16_t)-7));
+
+    // Zeros of alternating sign, which compare equal but differ in their bits
+    std::vector<float> zeros(kMaxCount);
+    for (int i = 0; i < kMaxCount; i++) {
+        zeros[i] = (i % 3 == 0) ? -0.0f : 0.0f;
+    }
+    check("float mixed zeros", zeros);
+
+    // All NaN, and a leading NaN before ordinary values
+    check("float all NaN", std::vector<float>(kMaxCount, nan));
+    std::vector<float> leadingNan(kMaxCount, 0.5f);
+    leadingNan[0] = nan;
+    leadingNan[kMaxCount / 2] = -0.5f;
+    check("float leading NaN", leadingNan);
+}
+
+int main()
+{
+    for (int kernel = MINMAX_KERNEL_SSE2; kernel <= MINMAX_KERNEL_AVX2; kernel++) {
+        g_pKernelName = kKernelNames[kernel];
+        if (!isMinMaxKernelSupported((MinMaxKernel)kernel)) {
+            printf("%s kernels not supported, skipped\n", g_pKernelName);
+            continue;
+        }
+        setMaxMinMaxKernel((MinMaxKernel)kernel);
+        checkAll();
+        printf("%s kernels checked\n", g_pKernelName);
+    }
+
+    if (g_numFailures != 0) {
+        fprintf(stderr, "%d failure(s)\n", g_numFailures);
+        return 1;
+    }
+    printf("min/max kernels match the scalar implementations\n");
+    return 0;
+}
@@ -0,0 +1,368 @@
+#include "audioplot_mmap.h"
+
+#include <cstdlib>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+ScratchFile::ScratchFile()
+{
+}
+
+ScratchFile::~ScratchFile()
+{
+    close();
+}
+
+ScratchFile::ScratchFile(ScratchFile&& other) noexcept
+{
+    *this = std::move(other);
+}
+
+ScratchFile& ScratchFile::operator=(ScratchFile&& other) noexcept
+{
+    if (this != &other) {
+        close();
+        std::swap(m_pData, other.m_pData);
+        std::swap(m_size, other.m_size);
+#if defined(_WIN32)
+        std::swap(m_hFile, other.m_hFile);
+        std::swap(m_hMapping, other.m_hMapping);
+#else
+        std::swap(m_fd, other.m_fd);
+#endif
+    }
+    return *this;
+}
+
+MappedFile::MappedFile()
+{
+}
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+#if defined(_WIN32)
+
+bool MappedFile::open(const char* filename)
+{
+    close();
+
+    HANDLE hFile = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                               FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (hFile == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(hFile, &fileSize) || fileSize.QuadPart == 0) {
+        CloseHandle(hFile);
+        return false;
+    }
+
+    HANDLE hMapping = CreateFileMappingA(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (hMapping == NULL) {
+        CloseHandle(hFile);
+        return false;
+    }
+
+    void* pData = MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0);
+    if (pData == NULL) {
+        CloseHandle(hMapping);
+        CloseHandle(hFile);
+        return false;
+    }
+
+    m_hFile = hFile;
+    m_hMapping = hMapping;
+    m_pData = (const uint8_t*)pData;
+    m_size = (uint64_t)fileSize.QuadPart;
+    return true;
+}
+
+void MappedFile::close()
+{
+    if (m_pData) {
+        UnmapViewOfFile(m_pData);
+        CloseHandle((HANDLE)m_hMapping);
+        CloseHandle((HANDLE)m_hFile);
+        m_pData = nullptr;
+        m_hMapping = nullptr;
+        m_hFile = nullptr;
+        m_size = 0;
+    }
+}
+
+bool ScratchFile::create(const char* directory, uint64_t size)
+{
+    close();
+
+    char path[MAX_PATH];
+    if (GetTempFileNameA(directory, "aps", 0, path) == 0) {
+        return false;
+    }
+    HANDLE hFile = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+                               FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, NULL);
+    if (hFile == INVALID_HANDLE_VALUE) {
+        DeleteFileA(path);
+        return false;
+    }
+
+    m_hFile = hFile;
+    if (!map(size)) {
+        CloseHandle(hFile);
+        m_hFile = nullptr;
+        return false;
+    }
+    return true;
+}
+
+void ScratchFile::close()
+{
+    unmap();
+    if (m_hFile) {
+        CloseHandle((HANDLE)m_hFile);
+        m_hFile = nullptr;
+    }
+}
+
+// Mapping a view larger than the file extends it
+bool ScratchFile::map(uint64_t size)
+{
+    size = std::max(size, (uint64_t)1);
+    HANDLE hMapping = CreateFileMappingA((HANDLE)m_hFile, NULL, PAGE_READWRITE,
+                                         (DWORD)(size >> 32), (DWORD)(size & 0xFFFFFFFF), NULL);
+    if (hMapping == NULL) {
+        return false;
+    }
+
+    void* pData = MapViewOfFile(hMapping, FILE_MAP_WRITE, 0, 0, 0);
+    if (pData == NULL) {
+        CloseHandle(hMapping);
+        return false;
+    }
+
+    m_hMapping = hMapping;
+    m_pData = (uint8_t*)pData;
+    m_size = size;
+    return true;
+}
+
+void ScratchFile::unmap()
+{
+    if (m_pData) {
+        UnmapViewOfFile(m_pData);
+        CloseHandle((HANDLE)m_hMapping);
+        m_pData = nullptr;
+        m_hMapping = nullptr;
+        m_size = 0;
+    }
+}
+
+// The file is mapped at the new size before the old view is removed, so if it
+// cannot grow, the old view is kept
+bool ScratchFile::resize(uint64_t size)
+{
+    if (!isOpen()) {
+        return false;
+    }
+    uint8_t* pOldData = m_pData;
+    void* hOldMapping = m_hMapping;
+    if (!map(size)) {
+        return false;
+    }
+    UnmapViewOfFile(pOldData);
+    CloseHandle((HANDLE)hOldMapping);
+    return true;
+}
+
+void adviseWillNeed(const void* pData, uint64_t size)
+{
+    (void)pData;
+    (void)size;
+}
+
+void adviseDontNeed(const void* pData, uint64_t size)
+{
+    // Removes the pages from the working set, without discarding them
+    VirtualUnlock((void*)pData, (SIZE_T)size);
+}
+
+#else
+
+bool MappedFile::open(const char* filename)
+{
+    close();
+
+    int fd = ::open(filename, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        ::close(fd);
+        return false;
+    }
+
+    void* pData = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);  // the mapping keeps its own reference to the file
+    if (pData == MAP_FAILED) {
+        return false;
+    }
+
+    m_pData = (const uint8_t*)pData;
+    m_size = (uint64_t)st.st_size;
+    return true;
+}
+
+void MappedFile::close()
+{
+    if (m_pData) {
+        munmap((void*)m_pData, (size_t)m_size);
+        m_pData = nullptr;
+        m_size = 0;
+    }
+}
+
+bool ScratchFile::create(const char* directory, uint64_t size)
+{
+    close();
+
+    std::string path = std::string(directory) + "/scratchXXXXXX";
+    std::vector<char> pathBuffer(path.begin(), path.end());
+    pathBuffer.push_back('\0');
+    int fd = mkstemp(pathBuffer.data());
+    if (fd < 0) {
+        return false;
+    }
+    unlink(pathBuffer.data());  // the file is deleted once closed
+
+    m_fd = fd;
+    if (!map(size)) {
+        ::close(fd);
+        m_fd = -1;
+        return false;
+    }
+    return true;
+}
+
+void ScratchFile::close()
+{
+    unmap();
+    if (m_fd >= 0) {
+        ::close(m_fd);
+        m_fd = -1;
+    }
+}
+
+// Disk space is allocated as the file grows, as writing to a page of a sparse file that
+// the disk has no room for raises SIGBUS, rather than failing here
+static bool setFileSize(int fd, uint64_t size)
+{
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) != 0) {
+        return false;
+    }
+    const uint64_t oldSize = (uint64_t)fileStat.st_size;
+    if (size <= oldSize) {
+        return ftruncate(fd, (off_t)size) == 0;
+    }
+#if defined(__APPLE__)
+    fstore_t store = {F_ALLOCATEALL, F_PEOFPOSMODE, 0, (off_t)(size - oldSize), 0};
+    if (fcntl(fd, F_PREALLOCATE, &store) == -1) {
+        return false;
+    }
+    return ftruncate(fd, (off_t)size) == 0;
+#else
+    return posix_fallocate(fd, (off_t)oldSize, (off_t)(size - oldSize)) == 0;
+#endif
+}
+
+bool ScratchFile::map(uint64_t size)
+{
+    size = std::max(size, (uint64_t)1);
+    if (!setFileSize(m_fd, size)) {
+        return false;
+    }
+
+    void* pData = mmap(NULL, (size_t)size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+    if (pData == MAP_FAILED) {
+        return false;
+    }
+
+    m_pData = (uint8_t*)pData;
+    m_size = size;
+    return true;
+}
+
+void ScratchFile::unmap()
+{
+    if (m_pData) {
+        munmap(m_pData, (size_t)m_size);
+        m_pData = nullptr;
+        m_size = 0;
+    }
+}
+
+// The file is mapped at the new size before the old mapping is removed, so if it
+// cannot grow, the old mapping is kept
+bool ScratchFile::resize(uint64_t size)
+{
+    if (!isOpen()) {
+        return false;
+    }
+    uint8_t* pOldData = m_pData;
+    const uint64_t oldSize = m_size;
+    if (!map(size)) {
+        return false;
+    }
+    munmap(pOldData, (size_t)oldSize);
+    return true;
+}
+
+// Advice is only given for whole pages inside the range
+static bool getPageRange(const void* pData, uint64_t size, void** ppStart, size_t* pSize)
+{
+    static const uintptr_t pageSize = (uintptr_t)sysconf(_SC_PAGESIZE);
+    const uintptr_t start = ((uintptr_t)pData + pageSize - 1) & ~(pageSize - 1);
+    const uintptr_t end = ((uintptr_t)pData + size) & ~(pageSize - 1);
+    if (end <= start) {
+        return false;
+    }
+    *ppStart = (void*)start;
+    *pSize = (size_t)(end - start);
+    return true;
+}
+
+void adviseWillNeed(const void* pData, uint64_t size)
+{
+    void* pStart;
+    size_t pageRangeSize;
+    if (getPageRange(pData, size, &pStart, &pageRangeSize)) {
+        posix_madvise(pStart, pageRangeSize, POSIX_MADV_WILLNEED);
+    }
+}
+
+void adviseDontNeed(const void* pData, uint64_t size)
+{
+    void* pStart;
+    size_t pageRangeSize;
+    if (getPageRange(pData, size, &pStart, &pageRangeSize)) {
+#if defined(MADV_PAGEOUT)
+        madvise(pStart, pageRangeSize, MADV_PAGEOUT);
+#else
+        posix_madvise(pStart, pageRangeSize, POSIX_MADV_DONTNEED);  // only a hint, unlike MADV_DONTNEED on Linux
+#endif
+    }
+}
+
+#endif
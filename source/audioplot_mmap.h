@@ -0,0 +1,162 @@
+#ifndef AUDIOPLOT_MMAP_H
+#define AUDIOPLOT_MMAP_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// Read-only memory mapping of a whole file
+class MappedFile
+{
+public:
+    MappedFile();
+    ~MappedFile();
+
+    bool open(const char* filename);
+    void close();
+
+    bool isOpen() const { return m_pData != nullptr; }
+    const uint8_t* data() const { return m_pData; }
+    uint64_t size() const { return m_size; }
+
+private:
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+
+    const uint8_t* m_pData = nullptr;
+    uint64_t m_size = 0;
+#if defined(_WIN32)
+    void* m_hFile = nullptr;
+    void* m_hMapping = nullptr;
+#endif
+};
+
+// Read-write mapping of a temporary file in directory, which is deleted once closed,
+// for data larger than RAM, whose pages the OS writes out and drops as needed
+class ScratchFile
+{
+public:
+    ScratchFile();
+    ~ScratchFile();
+    ScratchFile(ScratchFile&& other) noexcept;
+    ScratchFile& operator=(ScratchFile&& other) noexcept;
+    ScratchFile(const ScratchFile&) = delete;
+    ScratchFile& operator=(const ScratchFile&) = delete;
+
+    bool create(const char* directory, uint64_t size);
+    bool resize(uint64_t size);  // keeps the contents, but may move them, or if it fails, leaves them as they were
+    void close();
+
+    bool isOpen() const { return m_pData != nullptr; }
+    uint8_t* data() const { return m_pData; }
+    uint64_t size() const { return m_size; }
+
+private:
+    bool map(uint64_t size);
+    void unmap();
+
+    uint8_t* m_pData = nullptr;
+    uint64_t m_size = 0;
+#if defined(_WIN32)
+    void* m_hFile = nullptr;
+    void* m_hMapping = nullptr;
+#else
+    int m_fd = -1;
+#endif
+};
+
+// Hints that a range of mapped memory will be read soon, or not for a while, so its
+// pages can be dropped, or written out first if they were changed. Must only be
+// used for memory mapped from files.
+void adviseWillNeed(const void* pData, uint64_t size);
+void adviseDontNeed(const void* pData, uint64_t size);
+
+// Growable array kept in RAM, or once spilled, in a scratch file. Like std::vector,
+// growing it may move its contents.
+template<typename T>
+class PagedArray
+{
+public:
+    // Keep the array in a scratch file in directory from now on, if one can be created
+    bool spill(const std::string& directory)
+    {
+        if (m_file.isOpen()) {
+            return true;
+        }
+        if (directory.empty() || !m_file.create(directory.c_str(), std::max(m_vector.capacity(), (size_t)1) * sizeof(T))) {
+            return false;
+        }
+        m_size = m_vector.size();
+        if (m_size > 0) {
+            memcpy(m_file.data(), m_vector.data(), m_size * sizeof(T));
+        }
+        std::vector<T>().swap(m_vector);
+        return true;
+    }
+
+    bool isSpilled() const { return m_file.isOpen(); }
+
+    // Growing a spilled array returns false if its scratch file cannot grow, in which
+    // case the array is moved back to RAM, keeping its values, and stays there
+    bool reserve(uint64_t count)
+    {
+        if (!m_file.isOpen()) {
+            m_vector.reserve(count);
+            return true;
+        }
+        if (count * sizeof(T) > m_file.size() && !m_file.resize(count * sizeof(T))) {
+            unspill(count);
+            return false;
+        }
+        return true;
+    }
+
+    // New values are zero, as long as the array has not been shrunk
+    bool resize(uint64_t count)
+    {
+        if (!m_file.isOpen()) {
+            m_vector.resize(count);
+            return true;
+        }
+        if (count * sizeof(T) > m_file.size() && !m_file.resize(std::max(count * sizeof(T), 2 * m_file.size()))) {
+            unspill(count);
+            m_vector.resize(count);
+            return false;
+        }
+        m_size = count;
+        return true;
+    }
+
+    void clear()
+    {
+        std::vector<T>().swap(m_vector);
+        m_file.close();
+        m_size = 0;
+    }
+
+    uint64_t size() const { return (m_file.isOpen() ? m_size : m_vector.size()); }
+    bool empty() const { return size() == 0; }
+    T* data() { return (m_file.isOpen() ? (T*)m_file.data() : m_vector.data()); }
+    const T* data() const { return (m_file.isOpen() ? (const T*)m_file.data() : m_vector.data()); }
+    T& operator[](uint64_t index) { return data()[index]; }
+    const T& operator[](uint64_t index) const { return data()[index]; }
+
+private:
+    void unspill(uint64_t capacity)
+    {
+        std::vector<T> values;
+        values.reserve(std::max(capacity, m_size));
+        values.assign((const T*)m_file.data(), (const T*)m_file.data() + m_size);
+        m_vector.swap(values);
+        m_file.close();
+        m_size = 0;
+    }
+
+    std::vector<T> m_vector;
+    ScratchFile m_file;
+    uint64_t m_size = 0;  // of the spilled array
+};
+
+#endif // AUDIOPLOT_MMAP_H
@@ -0,0 +1,188 @@
+#ifndef AUDIOPLOT_SAMPLES_H
+#define AUDIOPLOT_SAMPLES_H
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "audioplot_mmap.h"
+
+enum SampleFormat
+{
+    SAMPLE_FORMAT_S16,
+    SAMPLE_FORMAT_S24,
+    SAMPLE_FORMAT_S32,
+    SAMPLE_FORMAT_F32,
+    SAMPLE_FORMAT_F64,
+};
+
+// Packed little-endian 24-bit sample
+struct Sample24
+{
+    uint8_t m_bytes[3];
+};
+
+inline uint32_t sampleFormatSize(SampleFormat format)
+{
+    switch (format) {
+        case SAMPLE_FORMAT_S16: return 2;
+        case SAMPLE_FORMAT_S24: return 3;
+        case SAMPLE_FORMAT_S32: return 4;
+        case SAMPLE_FORMAT_F32: return 4;
+        case SAMPLE_FORMAT_F64: return 8;
+    }
+    return 0;
+}
+
+// Conversion of each stored sample type to a -1 to +1 value
+inline double sampleToDouble(int16_t sample)
+{
+    return sample * (1.0 / 32768.0);
+}
+
+inline double sampleToDouble(Sample24 sample)
+{
+    const int32_t value = (int32_t)(((uint32_t)sample.m_bytes[0] << 8) |
+                                    ((uint32_t)sample.m_bytes[1] << 16) |
+                                    ((uint32_t)sample.m_bytes[2] << 24)) >> 8;
+    return value * (1.0 / 8388608.0);
+}
+
+inline double sampleToDouble(int32_t sample)
+{
+    return sample * (1.0 / 2147483648.0);
+}
+
+inline double sampleToDouble(float sample)
+{
+    return sample;
+}
+
+inline double sampleToDouble(double sample)
+{
+    return sample;
+}
+
+template<typename T> struct SampleFormatOf;
+template<> struct SampleFormatOf<int16_t>  { static const SampleFormat value = SAMPLE_FORMAT_S16; };
+template<> struct SampleFormatOf<Sample24> { static const SampleFormat value = SAMPLE_FORMAT_S24; };
+template<> struct SampleFormatOf<int32_t>  { static const SampleFormat value = SAMPLE_FORMAT_S32; };
+template<> struct SampleFormatOf<float>    { static const SampleFormat value = SAMPLE_FORMAT_F32; };
+template<> struct SampleFormatOf<double>   { static const SampleFormat value = SAMPLE_FORMAT_F64; };
+
+// Strided view of one channel's samples in their stored format, e.g. interleaved
+// in a memory mapped file, so samples are read in place rather than copied
+class SampleView
+{
+public:
+    SampleView()
+    {
+    }
+
+    SampleView(const void* pData, uint64_t numSamples, uint32_t stride, SampleFormat format)
+    : m_pData((const uint8_t*)pData)
+    , m_numSamples(numSamples)
+    , m_stride(stride)
+    , m_format(format)
+    {
+    }
+
+    const uint8_t* data() const { return m_pData; }
+    uint64_t size() const { return m_numSamples; }
+    uint32_t stride() const { return m_stride; }
+    SampleFormat format() const { return m_format; }
+
+    // Typed access for loops specialized on the stored sample type
+    template<typename T>
+    T get(uint64_t index) const
+    {
+        T sample;
+        memcpy(&sample, m_pData + (index * m_stride), sizeof(T));  // mapped samples may be unaligned
+        return sample;
+    }
+
+    double operator[](uint64_t index) const
+    {
+        switch (m_format) {
+            case SAMPLE_FORMAT_S16: return sampleToDouble(get<int16_t>(index));
+            case SAMPLE_FORMAT_S24: return sampleToDouble(get<Sample24>(index));
+            case SAMPLE_FORMAT_S32: return sampleToDouble(get<int32_t>(index));
+            case SAMPLE_FORMAT_F32: return sampleToDouble(get<float>(index));
+            case SAMPLE_FORMAT_F64: return sampleToDouble(get<double>(index));
+        }
+        return 0.0;
+    }
+
+    // Convert a block of samples to float
+    void read(uint64_t index, uint64_t count, float* pOut) const
+    {
+        switch (m_format) {
+            case SAMPLE_FORMAT_S16: readAs<int16_t>(index, count, pOut); break;
+            case SAMPLE_FORMAT_S24: readAs<Sample24>(index, count, pOut); break;
+            case SAMPLE_FORMAT_S32: readAs<int32_t>(index, count, pOut); break;
+            case SAMPLE_FORMAT_F32: readAs<float>(index, count, pOut); break;
+            case SAMPLE_FORMAT_F64: readAs<double>(index, count, pOut); break;
+        }
+    }
+
+private:
+    template<typename T>
+    void readAs(uint64_t index, uint64_t count, float* pOut) const
+    {
+        for (uint64_t i = 0; i < count; i++) {
+            pOut[i] = (float)sampleToDouble(get<T>(index + i));
+        }
+    }
+
+    const uint8_t* m_pData = nullptr;
+    uint64_t m_numSamples = 0;
+    uint32_t m_stride = 0;
+    SampleFormat m_format = SAMPLE_FORMAT_F64;
+};
+
+// Decoded samples of one channel, owned in their native width
+class ChannelBuffer
+{
+public:
+    virtual ~ChannelBuffer() {}
+    virtual SampleView view() const = 0;
+};
+
+template<typename T>
+class SampleBuffer : public ChannelBuffer
+{
+public:
+    // Keep the samples in a scratch file in directory, rather than RAM
+    bool spill(const std::string& directory)
+    {
+        return m_samples.spill(directory);
+    }
+
+    // Returns false if spilled samples had to be moved back to RAM, as for PagedArray
+    bool reserve(uint64_t numSamples)
+    {
+        return m_samples.reserve(numSamples);
+    }
+
+    bool append(const T* pInterleaved, uint64_t numFrames, uint32_t channelCount)
+    {
+        const uint64_t offset = m_samples.size();
+        const bool bResized = m_samples.resize(offset + numFrames);
+        T* pSamples = &m_samples[offset];
+        for (uint64_t frame = 0; frame < numFrames; frame++) {
+            pSamples[frame] = pInterleaved[frame * channelCount];
+        }
+        return bResized;
+    }
+
+    SampleView view() const
+    {
+        return SampleView(m_samples.data(), m_samples.size(), sizeof(T), SampleFormatOf<T>::value);
+    }
+
+private:
+    PagedArray<T> m_samples;
+};
+
+#endif // AUDIOPLOT_SAMPLES_H
@@ -3,54 +3,80 @@
 #include "stb_vorbis.c"
 
 #include <cinttypes>
-#include <vector>
 
-#define stb_clamp(x,xmin,xmax)  ((x) < (xmin) ? (xmin) : (x) > (xmax) ? (xmax) : (x))
+class OggDecoder : public AudioDecoder
+{
+public:
+   ~OggDecoder()
+   {
+      close();
+   }
 
-static std::vector<float>* s_pSampleVec;
+   bool open(const char* filename)
+   {
+      close();
+      int error;
+      m_pVorbis = stb_vorbis_open_filename(filename, &error, NULL);
+      if (!m_pVorbis) {
+         return false;
+      }
+      m_channels = m_pVorbis->channels;
+      m_sampleRate = m_pVorbis->sample_rate;
+      m_totalFrameCount = stb_vorbis_stream_length_in_samples(m_pVorbis);
+      m_nativeFormat = SAMPLE_FORMAT_F32;
+      return true;
+   }
 
-float* openOggFileAndReadPcmFramesF32(const char* filename, unsigned int* channels,
-                                      unsigned int* sampleRate, uint64_t* totalFrameCount)
-{
-   *channels = 0;
-   *sampleRate = 0;
-   *totalFrameCount = 0;
-
-   int error;
-   stb_vorbis* v = stb_vorbis_open_filename(filename, &error, NULL);
-   if (!v) {
-      return NULL;
+   uint64_t readPcmFramesF32(uint64_t framesToRead, float* pFramesOut)
+   {
+      return readPcmFrames(framesToRead, pFramesOut, stb_vorbis_get_samples_float_interleaved);
    }
 
-   *channels = v->channels;
-   *sampleRate = v->sample_rate;
+   uint64_t readPcmFramesS16(uint64_t framesToRead, int16_t* pFramesOut)
+   {
+      return readPcmFrames(framesToRead, pFramesOut, stb_vorbis_get_samples_short_interleaved);
+   }
 
-   s_pSampleVec = new std::vector<float>;
-   s_pSampleVec->reserve(10 * v->sample_rate * v->channels);  // reserve 10 seconds of space
+   bool seekToPcmFrame(uint64_t frameIndex)
+   {
+      return m_pVorbis && stb_vorbis_seek(m_pVorbis, (unsigned int)frameIndex);
+   }
 
-   for(;;) {
-      float** outputs;
-      int num_c;
-      int n = stb_vorbis_get_frame_float(v, &num_c, &outputs);
-      for (int s = 0; s < n; s++) {
-         for (int c = 0; c < num_c; c++) {
-            s_pSampleVec->push_back(outputs[c][s]);
-         }
+   void close()
+   {
+      if (m_pVorbis) {
+         stb_vorbis_close(m_pVorbis);
+         m_pVorbis = NULL;
       }
-      *totalFrameCount += n;
-      if (n == 0) {
-         break;
+   }
+
+private:
+   template<typename T>
+   uint64_t readPcmFrames(uint64_t framesToRead, T* pFramesOut, int (*getSamples)(stb_vorbis*, int, T*, int))
+   {
+      if (!m_pVorbis || m_channels == 0) {
+         return 0;
+      }
+
+      // stb_vorbis counts the interleaved output in samples, limited to int range
+      uint64_t framesRead = 0;
+      while (framesRead < framesToRead) {
+         const uint64_t maxFrames = (uint64_t)(INT32_MAX / m_channels);
+         const uint64_t frames = (framesToRead - framesRead < maxFrames ? framesToRead - framesRead : maxFrames);
+         const int n = getSamples(m_pVorbis, m_channels, &pFramesOut[framesRead * m_channels],
+                                  (int)(frames * m_channels));
+         if (n <= 0) {
+            break;
+         }
+         framesRead += n;
       }
+      return framesRead;
    }
 
-   return s_pSampleVec->data();
-}
+   stb_vorbis* m_pVorbis = NULL;
+};
 
-void freeOggSampleData(float* pSampleData)
+AudioDecoder* createOggDecoder()
 {
-   if (s_pSampleVec != NULL &&
-       pSampleData == s_pSampleVec->data()) {
-      delete s_pSampleVec;
-      s_pSampleVec = NULL;
-   }
-}
\ No newline at end of file
+   return new OggDecoder();
+}
@@ -1,11 +1,8 @@
 #ifndef AUDIOPLOT_STB_VORBIS_H
 #define AUDIOPLOT_STB_VORBIS_H
 
-#include <cinttypes>
+#include "audioplot_decoder.h"
 
-float* openOggFileAndReadPcmFramesF32(const char* filename, unsigned int* channels,
-                                      unsigned int* sampleRate, uint64_t* totalFrameCount);
+AudioDecoder* createOggDecoder();
 
-void freeOggSampleData(float* pSampleData);
-
-#endif // AUDIOPLOT_STB_VORBIS_H
\ No newline at end of file
+#endif // AUDIOPLOT_STB_VORBIS_H
@@ -0,0 +1,83 @@
+#include "audioplot_thread_pool.h"
+
+#include <algorithm>
+
+ThreadPool::ThreadPool(uint32_t numThreads)
+: m_nextIndex(0)
+{
+    if (numThreads == 0) {
+        numThreads = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+    for (uint32_t thread = 1; thread < numThreads; thread++) {
+        m_workers.push_back(std::thread(&ThreadPool::workerLoop, this, thread));
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_bStopping = true;
+    }
+    m_workAvailable.notify_all();
+    for (size_t i = 0; i < m_workers.size(); i++) {
+        m_workers[i].join();
+    }
+}
+
+void ThreadPool::parallelFor(uint64_t count, const Task& task)
+{
+    if (m_workers.empty() || count <= 1) {
+        for (uint64_t index = 0; index < count; index++) {
+            task(index, 0);
+        }
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_pTask = &task;
+        m_count = count;
+        m_nextIndex = 0;
+        m_numBusy = (uint32_t)m_workers.size();
+        m_generation++;
+    }
+    m_workAvailable.notify_all();
+
+    runTasks(0);
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_workFinished.wait(lock, [this] { return m_numBusy == 0; });
+    m_pTask = nullptr;
+}
+
+void ThreadPool::workerLoop(uint32_t thread)
+{
+    uint64_t generation = 0;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_workAvailable.wait(lock, [&] { return m_bStopping || m_generation != generation; });
+            if (m_bStopping) {
+                return;
+            }
+            generation = m_generation;
+        }
+
+        runTasks(thread);
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_numBusy--;
+        }
+        m_workFinished.notify_one();
+    }
+}
+
+void ThreadPool::runTasks(uint32_t thread)
+{
+    // Tasks are handed out one index at a time, so uneven tasks still balance
+    for (uint64_t index = m_nextIndex++; index < m_count; index = m_nextIndex++) {
+        (*m_pTask)(index, thread);
+    }
+}
@@ -0,0 +1,48 @@
+#ifndef AUDIOPLOT_THREAD_POOL_H
+#define AUDIOPLOT_THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads for running independent tasks in parallel
+class ThreadPool
+{
+public:
+    typedef std::function<void(uint64_t index, uint32_t thread)> Task;
+
+    // numThreads includes the calling thread, 0 uses one per hardware thread
+    explicit ThreadPool(uint32_t numThreads = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    uint32_t getNumThreads() const { return (uint32_t)m_workers.size() + 1; }
+
+    // Run task for every index in [0, count), on the workers and the calling thread,
+    // returning once all have finished. thread is in [0, getNumThreads()), for
+    // indexing per-thread scratch data. Must not be called from inside a task.
+    void parallelFor(uint64_t count, const Task& task);
+
+private:
+    void workerLoop(uint32_t thread);
+    void runTasks(uint32_t thread);
+
+    std::vector<std::thread> m_workers;
+    std::mutex m_mutex;
+    std::condition_variable m_workAvailable;
+    std::condition_variable m_workFinished;
+    const Task* m_pTask = nullptr;
+    uint64_t m_count = 0;
+    std::atomic<uint64_t> m_nextIndex;
+    uint64_t m_generation = 0;   // incremented for each parallelFor, to wake the workers
+    uint32_t m_numBusy = 0;      // workers still running tasks of the current parallelFor
+    bool m_bStopping = false;
+};
+
+#endif // AUDIOPLOT_THREAD_POOL_H
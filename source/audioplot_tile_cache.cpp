@@ -0,0 +1,57 @@
+#include "audioplot_tile_cache.h"
+#include "audioplot_mmap.h"
+
+#include <algorithm>
+
+static const uintptr_t kTileSize = 1 << 20;  // aligned in the address space, so tiles are whole pages
+
+TileCache::TileCache(uint64_t budget)
+: m_budget(budget)
+{
+}
+
+void TileCache::use(const void* pArray, uint64_t arraySize, uint64_t offset, uint64_t size)
+{
+    if (size == 0 || offset >= arraySize) {
+        return;
+    }
+
+    const uintptr_t arrayStart = (uintptr_t)pArray;
+    const uintptr_t arrayEnd = arrayStart + arraySize;
+    const uintptr_t firstTile = (arrayStart + offset) & ~(kTileSize - 1);
+    const uintptr_t lastTile = (arrayStart + std::min(offset + size, arraySize) - 1) & ~(kTileSize - 1);
+    uint64_t numTilesUsed = 0;
+    for (uintptr_t tile = firstTile; tile <= lastTile; tile += kTileSize) {
+        numTilesUsed++;
+        std::unordered_map<uintptr_t, std::list<Tile>::iterator>::iterator it = m_tileIndex.find(tile);
+        if (it != m_tileIndex.end()) {
+            m_tiles.splice(m_tiles.begin(), m_tiles, it->second);
+            continue;
+        }
+
+        // Tiles at the ends of the array only cover the array
+        Tile newTile;
+        newTile.m_start = std::max(tile, arrayStart);
+        newTile.m_size = std::min(tile + kTileSize, arrayEnd) - newTile.m_start;
+        adviseWillNeed((const void*)newTile.m_start, newTile.m_size);
+        m_tiles.push_front(newTile);
+        m_tileIndex[tile] = m_tiles.begin();
+        m_residentSize += newTile.m_size;
+    }
+
+    // Drop the least recently used tiles, other than those just viewed
+    while (m_residentSize > m_budget && m_tiles.size() > numTilesUsed) {
+        const Tile& tile = m_tiles.back();
+        adviseDontNeed((const void*)tile.m_start, tile.m_size);
+        m_residentSize -= tile.m_size;
+        m_tileIndex.erase(tile.m_start & ~(kTileSize - 1));
+        m_tiles.pop_back();
+    }
+}
+
+void TileCache::clear()
+{
+    m_tiles.clear();
+    m_tileIndex.clear();
+    m_residentSize = 0;
+}
@@ -0,0 +1,35 @@
+#ifndef AUDIOPLOT_TILE_CACHE_H
+#define AUDIOPLOT_TILE_CACHE_H
+
+#include <cstdint>
+#include <list>
+#include <unordered_map>
+
+// Keeps the most recently viewed tiles of memory mapped data resident, within a
+// budget of bytes, asking the OS to read newly viewed tiles ahead and to drop the
+// least recently viewed ones
+class TileCache
+{
+public:
+    explicit TileCache(uint64_t budget);
+
+    // Mark the tiles covering [offset, offset + size) of a mapped array as viewed
+    void use(const void* pArray, uint64_t arraySize, uint64_t offset, uint64_t size);
+
+    // Forget every tile without advising the OS, once the arrays they were in have moved
+    void clear();
+
+private:
+    struct Tile
+    {
+        uintptr_t m_start;
+        uint64_t m_size;
+    };
+
+    std::list<Tile> m_tiles;  // most recently used first
+    std::unordered_map<uintptr_t, std::list<Tile>::iterator> m_tileIndex;
+    uint64_t m_budget;
+    uint64_t m_residentSize = 0;
+};
+
+#endif // AUDIOPLOT_TILE_CACHE_H